@@ -0,0 +1,97 @@
+#include "bench.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::size_t> g_allocations { 0 };
+
+// Count every allocation so benchmarks can report how many mallocs a phase makes
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+/// @brief Whether benchmarks were requested with VIPER_BENCH
+bool bench_enabled() {
+    const char* env = std::getenv("VIPER_BENCH");
+    return env != nullptr && env[0] != '\0' && env[0] != '0';
+}
+
+
+/// @brief Generate viper source made of procedures, structs and global variables
+/// @param approx_bytes Roughly how large the source should be
+std::string bench_generate_corpus(std::size_t approx_bytes) {
+    std::string out;
+    out.reserve(approx_bytes + 1024);
+
+    for (std::size_t i = 0; out.size() < approx_bytes; i++) {
+        std::string n = std::to_string(i);
+        out += "// generated item " + n + "\n";
+        out += "let global_counter_" + n + ": i64 = " + n + ";\n";
+        out += "struct generated_record_" + n + " {\n"
+               "    identifier_field :: u64;\n"
+               "    accumulated_total_value :: f64;\n"
+               "}\n";
+        out += "define compute_value_" + n + "(input_parameter: i32, scale: f32): i32 {\n"
+               "    let result: i32 = input_parameter * 2 + (scale - 1);\n"
+               "    for (let i: i32 = 0; i < 10; i += 1) {\n"
+               "        result = result + global_counter_" + n + " * i;\n"
+               "    }\n"
+               "    if (result > 100) {\n"
+               "        return result % 7;\n"
+               "    } elif (result == 0) {\n"
+               "        return helper_procedure(result, input_parameter);\n"
+               "    } else {\n"
+               "        return !result;\n"
+               "    }\n"
+               "    while (result < 1000) {\n"
+               "        result = result * 3;\n"
+               "    }\n"
+               "    return result;\n"
+               "}\n";
+    }
+
+    return out;
+}
+
+
+/// @brief Print one benchmark result line
+void bench_report(const char* name, double seconds, std::size_t bytes) {
+    std::printf("    %-44s %10.3f ms  %9.1f MB/s\n",
+        name,
+        seconds * 1000.0,
+        (bytes / (1024.0 * 1024.0)) / seconds
+    );
+}
+
+
+/// @brief Calls to operator new made so far by the whole test binary
+std::size_t bench_allocation_count() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+
+void bench_register_tests(TestManager& manager) {
+    interner_register_benchmarks(manager);
+    scan_register_benchmarks(manager);
+    lexer_register_benchmarks(manager);
+    stream_register_benchmarks(manager);
+    parallel_register_benchmarks(manager);
+    comment_register_benchmarks(manager);
+    number_register_benchmarks(manager);
+    parser_register_benchmarks(manager);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+ *  bench.h
+ *
+ *  Helpers for the benchmarks. Benchmarks are registered with the test manager
+ *  like any other test but are skipped unless VIPER_BENCH is set in the environment
+ */
+
+#include "test_manager.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+constexpr uint8_t BENCH_SKIPPED = 2; // TestManager treats this result as skipped
+
+/// @brief Whether benchmarks were requested with VIPER_BENCH
+bool bench_enabled();
+
+/// @brief Generate viper source made of procedures, structs and global variables
+/// @param approx_bytes Roughly how large the source should be
+std::string bench_generate_corpus(std::size_t approx_bytes);
+
+/// @brief Run a function `iterations` times and return the best time in seconds
+template <typename F>
+double bench_best_of(int iterations, F&& func) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        func();
+        auto finish = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(finish - start).count();
+        if (seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+/// @brief Print one benchmark result line
+void bench_report(const char* name, double seconds, std::size_t bytes);
+
+/// @brief Calls to operator new made so far by the whole test binary
+std::size_t bench_allocation_count();
+
+void interner_register_benchmarks(TestManager& manager);
+void scan_register_benchmarks(TestManager& manager);
+void lexer_register_benchmarks(TestManager& manager);
+void stream_register_benchmarks(TestManager& manager);
+void parallel_register_benchmarks(TestManager& manager);
+void comment_register_benchmarks(TestManager& manager);
+void number_register_benchmarks(TestManager& manager);
+void parser_register_benchmarks(TestManager& manager);
+
+void bench_register_tests(TestManager& manager);
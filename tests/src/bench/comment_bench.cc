@@ -0,0 +1,60 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <string>
+
+/// @brief Source that is mostly documentation comments, with a little code between them
+static std::string doc_comment_source(std::size_t approx_bytes) {
+    std::string out;
+    out.reserve(approx_bytes + 1024);
+
+    for (std::size_t i = 0; out.size() < approx_bytes; i++) {
+        std::string n = std::to_string(i);
+        out += "/*\n"
+               " * Compute the value of item " + n + ".\n"
+               " *\n"
+               " * The result is scaled by the factor passed in and clamped to the\n"
+               " * range of an i32. Callers are expected to check the sign themselves.\n"
+               " * /* Nested: see the notes on scaling in the module header. */\n"
+               " */\n";
+        out += "// @param factor How much to scale the value by\n"
+               "// @returns \"the scaled value\"\n";
+        out += "define item_" + n + "(factor: i32): i32 { return factor * " + n + "; }\n";
+    }
+    return out;
+}
+
+// Tokenizing doc comment heavy source must take time in proportion to its size
+uint8_t bench_doc_comments() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile small;
+    small.name = "small.viper";
+    small.content = doc_comment_source(32 * 1024 * 1024);
+
+    viper::VFile large;
+    large.name = "large.viper";
+    large.content = doc_comment_source(64 * 1024 * 1024);
+
+    double small_time = bench_best_of(3, [&]() {
+        viper::Tokenizer::create_streaming(&small).tokenize_file();
+    });
+    double large_time = bench_best_of(3, [&]() {
+        viper::Tokenizer::create_streaming(&large).tokenize_file();
+    });
+
+    bench_report("32 MB of doc comments", small_time, small.content.size());
+    bench_report("64 MB of doc comments", large_time, large.content.size());
+    std::printf("    twice the input took %.2fx the time\n", large_time / small_time);
+
+    return true;
+}
+
+void comment_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_doc_comments, "Benchmark tokenizing source that is mostly doc comments");
+}
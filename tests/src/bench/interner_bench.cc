@@ -0,0 +1,108 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <core/interner.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Heap bytes a std::string of this length needs beyond its own size
+static std::size_t string_heap_bytes(std::size_t length) {
+    constexpr std::size_t SSO_CAPACITY = 15; // libstdc++
+    return length > SSO_CAPACITY ? length + 1 : 0;
+}
+
+// Compare carrying identifier names as std::string copies (token + AST node)
+// against interning them once and carrying 32 bit symbols
+uint8_t bench_interner_vs_strings() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = bench_generate_corpus(32 * 1024 * 1024);
+
+    std::vector<std::string_view> identifiers;
+    for (const viper::token& tok : viper::Tokenizer::create_new(&file).tokenize_file()) {
+        if (tok.kind == viper::TK_IDENT) {
+            identifiers.push_back(tok.text(&file));
+        }
+    }
+
+    // String path: read_identifier substr, copy into the token, copy into the node
+    std::size_t string_bytes = 0;
+    double string_time = bench_best_of(3, [&]() {
+        std::vector<std::string> token_names;
+        std::vector<std::string> node_names;
+        token_names.reserve(identifiers.size());
+        node_names.reserve(identifiers.size());
+        for (std::string_view id : identifiers) {
+            std::string read(id);
+            token_names.push_back(read);
+            node_names.push_back(token_names.back());
+        }
+
+        string_bytes = 0;
+        for (const std::string& name : token_names) {
+            string_bytes += 2 * (sizeof(std::string) + string_heap_bytes(name.size()));
+        }
+    });
+
+    // Interned path: one hash per identifier, symbols are copied by value
+    viper::Interner& interner = viper::Interner::global();
+    std::vector<viper::symbol> symbols(identifiers.size());
+    double intern_time = bench_best_of(3, [&]() {
+        for (std::size_t i = 0; i < identifiers.size(); i++) {
+            symbols[i] = interner.intern(identifiers[i]);
+        }
+    });
+    std::size_t symbol_bytes = identifiers.size() * 2 * sizeof(viper::symbol) + interner.memory_used();
+
+    // What a lexer does: recent names are found in its cache without taking the lock
+    viper::InternCache cache(&interner);
+    double cached_time = bench_best_of(3, [&]() {
+        for (std::size_t i = 0; i < identifiers.size(); i++) {
+            symbols[i] = cache.intern(identifiers[i]);
+        }
+    });
+
+    // Name comparison as later phases would do it
+    std::size_t matches = 0;
+    viper::symbol target = interner.intern("result");
+    double compare_symbol_time = bench_best_of(3, [&]() {
+        matches = 0;
+        for (viper::symbol sym : symbols) {
+            matches += sym == target;
+        }
+    });
+    double compare_string_time = bench_best_of(3, [&]() {
+        matches = 0;
+        for (std::string_view id : identifiers) {
+            matches += id == "result";
+        }
+    });
+
+    std::printf("    %zu identifiers, %zu distinct\n", identifiers.size(), (std::size_t)interner.symbol_count());
+    bench_report("identifier names as std::string copies", string_time, file.content.size());
+    bench_report("identifier names interned", intern_time, file.content.size());
+    bench_report("identifier names interned through a cache", cached_time, file.content.size());
+    std::printf("    name memory: strings %.1f MB, symbols + interner %.1f MB\n",
+        string_bytes / (1024.0 * 1024.0),
+        symbol_bytes / (1024.0 * 1024.0)
+    );
+    std::printf("    name compare: strings %.3f ms, symbols %.3f ms (%zu matches)\n",
+        compare_string_time * 1000.0,
+        compare_symbol_time * 1000.0,
+        matches
+    );
+
+    return true;
+}
+
+void interner_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_interner_vs_strings, "Benchmark interned identifiers against std::string copies");
+}
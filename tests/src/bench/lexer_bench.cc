@@ -0,0 +1,38 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <string>
+
+// Throughput of the table driven lexer against the switch lexer
+uint8_t bench_lexer_modes() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    // Dense operators on top of the generated corpus so punctuators dominate
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = bench_generate_corpus(16 * 1024 * 1024);
+    while (file.content.size() < 32 * 1024 * 1024) {
+        file.content += "a<<=b>>=c&&d||e::f/=g!=h==i<=j>=k+=l-=m*=n%=o&=p|=q^=r~=s;(t)[u]{v},w.x:y\n";
+    }
+
+    double table = bench_best_of(3, [&]() {
+        viper::Tokenizer::create_new(&file, viper::lexer_mode::TABLE).tokenize_file();
+    });
+    double switched = bench_best_of(3, [&]() {
+        viper::Tokenizer::create_new(&file, viper::lexer_mode::SWITCH).tokenize_file();
+    });
+
+    bench_report("switch lexer", switched, file.content.size());
+    bench_report("table lexer", table, file.content.size());
+
+    return true;
+}
+
+void lexer_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_lexer_modes, "Benchmark table driven lexer against the switch lexer");
+}
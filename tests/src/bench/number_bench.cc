@@ -0,0 +1,85 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/// @brief Source made of large constant tables, the way generated lookup tables look
+static std::string data_table_source(std::size_t approx_bytes) {
+    std::string out;
+    out.reserve(approx_bytes + 1024);
+
+    u64 state = 88172645463325252u;
+    for (std::size_t table = 0; out.size() < approx_bytes; table++) {
+        out += "let table_" + std::to_string(table) + ": u64 = {\n";
+        for (int row = 0; row < 64; row++) {
+            out += "   ";
+            for (int col = 0; col < 8; col++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                switch (col % 4) {
+                    case 0: out += std::to_string(state % 100000); break;
+                    case 1: out += std::to_string(state); break;
+                    case 2: out += std::to_string(state % 1000) + "." + std::to_string(state % 997); break;
+                    default: out += "0x" + std::to_string(state % 0xFFFFFF); break;
+                }
+                out += ", ";
+            }
+            out += "\n";
+        }
+        out += "};\n";
+    }
+    return out;
+}
+
+// Tokenizing numeric tables, with the literals decoded once by the tokenizer,
+// against tokenizing and converting the text of each literal afterwards the way the parser used to
+uint8_t bench_number_literals() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "tables.viper";
+    file.content = data_table_source(32 * 1024 * 1024);
+
+    u64 sum = 0;
+    double decoded = bench_best_of(3, [&]() {
+        viper::Tokenizer tokenizer = viper::Tokenizer::create_streaming(&file);
+        for (viper::token tok = tokenizer.next_token(); tok.kind != viper::TK_EOF; tok = tokenizer.next_token()) {
+            if (tok.kind == viper::TK_NUM_INT) {
+                sum += tokenizer.integer_value(tok);
+            } else if (tok.kind == viper::TK_NUM_FLOAT) {
+                sum += static_cast<u64>(tokenizer.float_value(tok));
+            }
+        }
+    });
+
+    double reparsed = bench_best_of(3, [&]() {
+        viper::Tokenizer tokenizer = viper::Tokenizer::create_streaming(&file);
+        for (viper::token tok = tokenizer.next_token(); tok.kind != viper::TK_EOF; tok = tokenizer.next_token()) {
+            if (tok.kind == viper::TK_NUM_INT) {
+                std::string text(tok.text(&file));
+                sum += std::strtoull(text.c_str(), nullptr, 0);
+            } else if (tok.kind == viper::TK_NUM_FLOAT) {
+                std::string text(tok.text(&file));
+                sum += static_cast<u64>(std::atof(text.c_str()));
+            }
+        }
+    });
+
+    bench_report("tokenize tables, decoded in tokenizer", decoded, file.content.size());
+    bench_report("tokenize tables, then convert text", reparsed, file.content.size());
+    std::printf("    checksum %lu\n", sum);
+
+    return true;
+}
+
+void number_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_number_literals, "Benchmark decoding number literals in numeric data tables");
+}
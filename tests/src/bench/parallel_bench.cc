@@ -0,0 +1,45 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// How tokenizing a large file scales from one thread to every hardware thread
+uint8_t bench_parallel_tokenize() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = bench_generate_corpus(128 * 1024 * 1024);
+
+    // Intern the corpus once so every run does the same work
+    viper::Tokenizer::create_new(&file).tokenize_file_parallel(1);
+
+    u32 hardware = std::thread::hardware_concurrency();
+    std::printf("    %u hardware threads\n", hardware);
+
+    double serial = bench_best_of(3, [&]() {
+        viper::Tokenizer::create_new(&file).tokenize_file();
+    });
+    bench_report("serial", serial, file.content.size());
+
+    for (u32 threads = 1; threads <= (hardware > 8 ? hardware : 8); threads *= 2) {
+        double seconds = bench_best_of(3, [&]() {
+            viper::Tokenizer::create_new(&file).tokenize_file_parallel(threads);
+        });
+
+        std::string name = std::to_string(threads) + " threads";
+        bench_report(name.c_str(), seconds, file.content.size());
+    }
+
+    return true;
+}
+
+void parallel_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_parallel_tokenize, "Benchmark parallel tokenizing from 1 to N threads");
+}
@@ -0,0 +1,702 @@
+#include "bench.h"
+
+#include <core/ast_image.h>
+#include <core/core.h>
+#include <parser/incremental.h>
+#include <parser/parser.h>
+#include <tokenizer/tokenizer.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+/// @brief Source built from the constructs of the parser tests, repeated with new names
+static std::string parser_corpus(std::size_t approx_bytes) {
+    std::string out;
+    out.reserve(approx_bytes + 1024);
+
+    for (std::size_t i = 0; out.size() < approx_bytes; i++) {
+        std::string n = std::to_string(i);
+        out += "let global_" + n + ": i32 = 1 + 2 * -3 + 4;\n"
+               "let name_" + n + ": str = \"test string\";\n";
+        out += "struct record_" + n + " {\n"
+               "   name :: i32;\n"
+               "   define test(): i32 {\n"
+               "       let i: i32 = 0;\n"
+               "   }\n"
+               "}\n";
+        out += "define proc_" + n + "(param1: User, param2: f32): i32 {\n"
+               "   let i: i32 = 5.0;\n"
+               "   if 1 + 2 {\n"
+               "       let u: i32 = 0 + i;\n"
+               "   } elif i + 5 {\n"
+               "       let v: i32 = (1 + 2) * 3;\n"
+               "   } else {\n"
+               "       let t: i32 = num_seconds.method((1 + 2), num_seconds.field);\n"
+               "   }\n"
+               "   for (let i: i32 = 0; i < 5; i += 1 * 3) {\n"
+               "       let u: i32 = 0 + i;\n"
+               "   }\n"
+               "   while (i + 2) {\n"
+               "       let i: i32 = 5 + 1;\n"
+               "   }\n"
+               "   do {\n"
+               "       let i: i32 = 5 + 1;\n"
+               "   } while (i + 2);\n"
+               "   return i;\n"
+               "}\n";
+    }
+    return out;
+}
+
+// Time spent per token parsing the parser test constructs
+uint8_t bench_parser_tokens() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = parser_corpus(8 * 1024 * 1024);
+    std::size_t token_count = viper::Tokenizer::create_new(&file).tokenize_file().size();
+
+    std::size_t nodes = 0;
+    std::size_t allocations = 0;
+    double parse = bench_best_of(3, [&]() {
+        std::size_t before = bench_allocation_count();
+        viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file);
+        viper::Parser parser = viper::Parser::create_new(&lexer);
+        nodes = parser.parse()->get_nodes().size();
+        allocations = bench_allocation_count() - before;
+    });
+
+    bench_report("parse parser test corpus", parse, file.content.size());
+    std::printf("    %zu tokens, %zu top level nodes, %.1f ns per token, %zu allocations\n",
+        token_count, nodes, parse * 1e9 / token_count, allocations);
+
+    return true;
+}
+
+// Time per operator parsing long arithmetic chains: many statements of a few dozen
+// operators each, and a single statement with a very long chain
+uint8_t bench_expression_chains() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    static const char* ops[] = { " + ", " * ", " - ", " / ", " < ", " % ", " == ", " || " };
+    auto chain = [](std::string& out, std::size_t operands) {
+        for (std::size_t i = 0; i < operands; i++) {
+            if (i > 0) {
+                out += ops[i % 8];
+            }
+            out += (i % 3 == 0) ? "x" + std::to_string(i % 97) : std::to_string(i);
+        }
+    };
+
+    struct chain_case {
+        const char* name;
+        std::size_t statements;
+        std::size_t operands;
+    };
+    const chain_case cases[] = {
+        { "32 operand chains", 64 * 1024, 32 },
+        { "one 1M operand chain", 1, 1024 * 1024 },
+    };
+
+    for (const chain_case& c : cases) {
+        viper::VFile file;
+        file.name = "bench.viper";
+        for (std::size_t i = 0; i < c.statements; i++) {
+            file.content += "let v: i32 = ";
+            chain(file.content, c.operands);
+            file.content += ";\n";
+        }
+
+        double parse = bench_best_of(3, [&]() {
+            viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file);
+            viper::Parser parser = viper::Parser::create_new(&lexer);
+            (void) parser.parse();
+        });
+
+        std::size_t operators = c.statements * (c.operands - 1);
+        bench_report(c.name, parse, file.content.size());
+        std::printf("    %zu operators, %.1f ns per operator\n", operators, parse * 1e9 / operators);
+    }
+
+    return true;
+}
+
+// Time to parse code nested 10000 and 100000 levels deep
+uint8_t bench_deep_nesting() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    auto repeat = [](const char* text, u32 times) {
+        std::string out;
+        for (u32 i = 0; i < times; i++) {
+            out += text;
+        }
+        return out;
+    };
+
+    for (u32 depth : { 10000u, 100000u }) {
+        struct nesting_case {
+            const char* name;
+            std::string content;
+        };
+        const std::string proc = "define main(): i32 {\n";
+        const nesting_case cases[] = {
+            { "nested while blocks", proc + repeat("while a {\n", depth) + repeat("}\n", depth) + "}\n" },
+            { "elif arms", proc + "if a {}" + repeat(" elif a { a; }", depth) + " else {}\n}\n" },
+            { "nested groups", "let x: i32 = " + repeat("(", depth) + "1" + repeat(")", depth) + ";\n" },
+            { "nested calls", "let x: i32 = " + repeat("f(", depth) + "1" + repeat(")", depth) + ";\n" },
+        };
+
+        std::printf("    %u levels\n", depth);
+        for (const nesting_case& c : cases) {
+            viper::VFile file;
+            file.name = "bench.viper";
+            file.content = c.content;
+            double parse = bench_best_of(3, [&]() {
+                viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file);
+                viper::Parser parser = viper::Parser::create_new(&lexer);
+                (void) parser.parse();
+            });
+            std::printf("    %-44s %10.3f ms  %9.1f ns/level\n", c.name, parse * 1e3, parse * 1e9 / depth);
+        }
+    }
+
+    return true;
+}
+
+using BenchResultNode = viper::result::Result<viper::ASTNode*, viper::VError>;
+using BenchResultToken = viper::result::Result<viper::token, viper::VError>;
+
+static viper::ErrorStore bench_errors;
+
+// The two results the parser returns everywhere: a node from a parse function
+// and a token from eat. Not inlined, so the result crosses a real return
+[[gnu::noinline]] static BenchResultNode bench_return_node(viper::ASTNode* node, bool fail) {
+    if (fail) {
+        return viper::result::Err(bench_errors.report(viper::error_type::PARSER_ERR, "bench"));
+    }
+    return viper::result::Ok(node);
+}
+
+[[gnu::noinline]] static BenchResultToken bench_return_token(const viper::token& tok, bool fail) {
+    if (fail) {
+        return viper::result::Err(bench_errors.report(viper::error_type::PARSER_ERR, "bench"));
+    }
+    return viper::result::Ok(tok);
+}
+
+// Cost of returning, checking and unwrapping the parser's results
+uint8_t bench_result_returns() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    const u64 calls = 20 * 1000 * 1000;
+    volatile bool fail = false;
+    viper::ASTNode node;
+    viper::token tok = viper::token::create_new(viper::TK_IDENT, 0, 1);
+
+    u64 node_sum = 0;
+    double nodes = bench_best_of(3, [&]() {
+        node_sum = 0;
+        for (u64 i = 0; i < calls; i++) {
+            BenchResultNode r = bench_return_node(&node, fail);
+            if (r.is_ok()) {
+                node_sum += reinterpret_cast<std::uintptr_t>(r.unwrap()) & 0xff;
+            }
+        }
+    });
+
+    u64 token_sum = 0;
+    double tokens = bench_best_of(3, [&]() {
+        token_sum = 0;
+        for (u64 i = 0; i < calls; i++) {
+            BenchResultToken r = bench_return_token(tok, fail);
+            if (r.is_ok()) {
+                token_sum += r.unwrap().offset;
+            }
+        }
+    });
+
+    std::printf("    %-44s %10.3f ms  %9.2f ns/call  %zu bytes\n", "Result<ASTNode*, VError>", nodes * 1e3, nodes * 1e9 / calls, sizeof(BenchResultNode));
+    std::printf("    %-44s %10.3f ms  %9.2f ns/call  %zu bytes\n", "Result<token, VError>", tokens * 1e3, tokens * 1e9 / calls, sizeof(BenchResultToken));
+    std::printf("    trivially copyable: %s, %s (%llu %llu)\n",
+        std::is_trivially_copyable_v<BenchResultNode> ? "yes" : "no",
+        std::is_trivially_copyable_v<BenchResultToken> ? "yes" : "no",
+        (unsigned long long)node_sum, (unsigned long long)token_sum);
+
+    return true;
+}
+
+// Cost of handing tokens to the parser one call at a time against a batch per call
+uint8_t bench_token_delivery() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = parser_corpus(8 * 1024 * 1024);
+
+    std::size_t single_count = 0;
+    double single = bench_best_of(3, [&]() {
+        viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file);
+        single_count = 0;
+        while (lexer.next_token().kind != viper::TK_EOF) {
+            single_count++;
+        }
+    });
+
+    std::size_t batch_count = 0;
+    double batched = bench_best_of(3, [&]() {
+        viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file);
+        std::array<viper::token, viper::Tokenizer::TOKEN_BATCH> batch;
+        batch_count = 0;
+        u32 count;
+        do {
+            count = lexer.next_tokens(batch.data(), batch.size());
+            batch_count += count;
+        } while (batch[count - 1].kind != viper::TK_EOF);
+        batch_count--;
+    });
+
+    if (single_count != batch_count) {
+        std::printf("bench_token_delivery: %zu tokens one at a time but %zu in batches\n", single_count, batch_count);
+        return false;
+    }
+
+    bench_report("next_token", single, file.content.size());
+    bench_report("next_tokens", batched, file.content.size());
+    std::printf("    %.1f ns per token one at a time, %.1f ns per token in batches of %u\n",
+        single * 1e9 / single_count, batched * 1e9 / batch_count, viper::Tokenizer::TOKEN_BATCH);
+
+    return true;
+}
+
+// Parsing with every stage on one thread against the lexer, preprocessor and parser
+// on their own threads, from a small file up to a large one
+uint8_t bench_pipelined_parse() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    const std::size_t sizes[] = { 4 * 1024, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+    for (std::size_t size : sizes) {
+        viper::VFile file;
+        file.name = "bench.viper";
+        file.content = parser_corpus(size);
+
+        // Small files are parsed many times over so the time is measurable.
+        // Trees are never freed, so the volume is kept down
+        int repeat = size < 2 * 1024 * 1024 ? static_cast<int>(2 * 1024 * 1024 / size) : 1;
+        double serial = bench_best_of(2, [&]() {
+            for (int i = 0; i < repeat; i++) {
+                file.parse();
+            }
+        });
+        double pipelined = bench_best_of(2, [&]() {
+            for (int i = 0; i < repeat; i++) {
+                file.parse_pipelined();
+            }
+        });
+
+        std::printf("  %zu KB file, %d parses\n", size / 1024, repeat);
+        bench_report("parse", serial, file.content.size() * repeat);
+        bench_report("parse_pipelined", pipelined, file.content.size() * repeat);
+    }
+
+    return true;
+}
+
+// Time per line parsing files of 10000 and 50000 lines, clean and with mistakes in
+// them. Recovery skips what it can not parse, so mistakes should not cost more per line
+// than clean code, and five times the lines should take five times as long
+uint8_t bench_malformed_input() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    // Procedures five lines long. A mistake replaces a whole procedure
+    static const char* mistakes[] = {
+        "   let x: i32 = a + 1\n",       // Missing ';'
+        "   let x: i32 = a + ;\n",       // Missing operand
+        "   let x: i32 = f(a, 1;\n",     // Unclosed call
+        "   let x: i32 = a + 1;\n  }\n", // Extra '}', which leaves the procedure's own '}' stray
+    };
+    auto source = [](u32 lines, u32 mistake_every) {
+        std::string out;
+        for (u32 i = 0; i < lines / 5; i++) {
+            out += "define proc_" + std::to_string(i) + "(a: i32): i32 {\n";
+            if (mistake_every != 0 && i % mistake_every == 0) {
+                out += mistakes[(i / mistake_every) % 4];
+            } else {
+                out += "   let x: i32 = a + 1;\n";
+            }
+            out += "   while x { x = x - 1; }\n"
+                   "   return x;\n"
+                   "}\n";
+        }
+        return out;
+    };
+
+    struct malformed_case {
+        const char* name;
+        u32 mistake_every; // In procedures. 0 for none
+    };
+    const malformed_case cases[] = {
+        { "clean", 0 },
+        { "a mistake every 100 lines", 20 },
+        { "a mistake every 5 lines", 1 },
+    };
+
+    for (u32 lines : { 10000u, 50000u }) {
+        std::printf("    %u lines\n", lines);
+        for (const malformed_case& c : cases) {
+            viper::VFile file;
+            file.name = "bench.viper";
+            file.content = source(lines, c.mistake_every);
+            std::size_t errors = 0;
+            double parse = bench_best_of(3, [&]() {
+                viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file);
+                viper::Parser parser = viper::Parser::create_new(&lexer);
+                (void) parser.parse();
+                errors = parser.errors().size();
+            });
+            std::printf("    %-44s %10.3f ms  %9.1f ns/line  %zu errors\n", c.name, parse * 1e3, parse * 1e9 / lines, errors);
+        }
+    }
+
+    return true;
+}
+
+// Parsing one large file on one thread against parsing its declarations on a
+// pool of threads, for a few thread counts
+uint8_t bench_parallel_parse() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = parser_corpus(16 * 1024 * 1024);
+
+    double serial = bench_best_of(3, [&]() {
+        file.parse();
+    });
+    std::printf("    %zu top level nodes, %u hardware threads\n", file.ast->get_nodes().size(), std::thread::hardware_concurrency());
+    bench_report("parse", serial, file.content.size());
+
+    for (u32 threads : { 1u, 2u, 4u, 8u }) {
+        double parallel = bench_best_of(3, [&]() {
+            file.parse_parallel(threads);
+        });
+        std::string name = "parse_parallel, " + std::to_string(threads) + " threads";
+        bench_report(name.c_str(), parallel, file.content.size());
+    }
+
+    return true;
+}
+
+// Walking every node of the pointer tree against walking the flat tree by index
+uint8_t bench_ast_traversal() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = parser_corpus(8 * 1024 * 1024);
+    file.parse();
+    viper::AST& ast = *file.ast;
+
+    double build = bench_best_of(1, [&]() { ast.flat(); });
+    viper::FlatView flat = ast.flat();
+
+    // Each walk counts the nodes and adds up the integer literals
+    u64 pointer_nodes = 0;
+    u64 pointer_sum = 0;
+    double pointer = bench_best_of(3, [&]() {
+        std::vector<const viper::ASTNode*> stack(ast.get_nodes().begin(), ast.get_nodes().end());
+        pointer_nodes = 0;
+        pointer_sum = 0;
+        while (!stack.empty()) {
+            const viper::ASTNode* node = stack.back();
+            stack.pop_back();
+            if (node == nullptr) {
+                continue;
+            }
+            viper::flat_info info = node->flat();
+            pointer_nodes++;
+            pointer_sum += info.kind == viper::AST_INTEGER_LITERAL ? info.payload : 0;
+            node->children(&stack);
+        }
+    });
+
+    // Same walk with one switch per node, the visitor seeing the concrete type
+    u64 visit_nodes = 0;
+    u64 visit_sum = 0;
+    double visited = bench_best_of(3, [&]() {
+        std::vector<const viper::ASTNode*> stack(ast.get_nodes().begin(), ast.get_nodes().end());
+        visit_nodes = 0;
+        visit_sum = 0;
+        while (!stack.empty()) {
+            const viper::ASTNode* node = stack.back();
+            stack.pop_back();
+            if (node == nullptr) {
+                continue;
+            }
+            viper::visit(node, [&](const auto* typed) {
+                visit_nodes++;
+                if constexpr (std::is_same_v<decltype(typed), const viper::IntegerLiteralNode*>) {
+                    visit_sum += typed->describe().payload;
+                }
+                typed->append_children(&stack);
+            });
+        }
+    });
+
+    u64 flat_nodes = 0;
+    u64 flat_sum = 0;
+    double indexed = bench_best_of(3, [&]() {
+        std::vector<viper::node_id> stack(flat.roots().begin(), flat.roots().end());
+        flat_nodes = 0;
+        flat_sum = 0;
+        while (!stack.empty()) {
+            viper::node_id id = stack.back();
+            stack.pop_back();
+            if (id == viper::NO_NODE) {
+                continue;
+            }
+            flat_nodes++;
+            flat_sum += flat.kind(id) == viper::AST_INTEGER_LITERAL ? flat.payload(id) : 0;
+            std::span<const viper::node_id> children = flat.children(id);
+            stack.insert(stack.end(), children.begin(), children.end());
+        }
+    });
+
+    // Passes that do not need the structure loop over the arrays
+    u64 scan_sum = 0;
+    double scan = bench_best_of(3, [&]() {
+        scan_sum = 0;
+        for (viper::node_id id = 0; id < flat.size(); id++) {
+            scan_sum += flat.kind(id) == viper::AST_INTEGER_LITERAL ? flat.payload(id) : 0;
+        }
+    });
+
+    if (pointer_nodes != flat_nodes || visit_nodes != flat_nodes || visit_sum != flat_sum || flat_nodes != flat.size() || pointer_sum != flat_sum || flat_sum != scan_sum) {
+        std::printf("bench_ast_traversal: the walks disagree\n");
+        return false;
+    }
+
+    std::printf("    %llu nodes\n", (unsigned long long)flat_nodes);
+    std::printf("    %-44s %10.3f ms  %9.1f ns/node\n", "pointer tree walk, flat() and children()", pointer * 1e3, pointer * 1e9 / flat_nodes);
+    std::printf("    %-44s %10.3f ms  %9.1f ns/node\n", "pointer tree walk, one visit per node", visited * 1e3, visited * 1e9 / flat_nodes);
+    std::printf("    %-44s %10.3f ms  %9.1f ns/node\n", "flat tree walk by index", indexed * 1e3, indexed * 1e9 / flat_nodes);
+    std::printf("    %-44s %10.3f ms  %9.1f ns/node\n", "flat tree linear scan", scan * 1e3, scan * 1e9 / flat_nodes);
+    std::printf("    %-44s %10.3f ms\n", "building the flat tree", build * 1e3);
+    std::printf("    pointer tree %.1f bytes/node in the arena, flat tree %.1f bytes/node (%.1f without the pointer node table)\n",
+        (double)ast.memory_used() / flat_nodes,
+        (double)flat.memory_used() / flat_nodes,
+        (double)(flat.memory_used() - flat.size() * sizeof(void*)) / flat_nodes);
+
+    return true;
+}
+
+// Parsing a whole file against skimming its procedure bodies, then parsing a
+// tenth of them and all of them on demand
+uint8_t bench_skim_parse() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = parser_corpus(16 * 1024 * 1024);
+
+    double full = bench_best_of(3, [&]() {
+        file.parse();
+    });
+    u64 full_memory = file.ast->memory_used();
+
+    double skim = bench_best_of(3, [&]() {
+        file.skim();
+    });
+    u64 skim_memory = file.ast->memory_used();
+
+    // Top-level procedures of the skimmed tree, every'th one of them
+    auto procedures = [&](u32 every) {
+        std::vector<viper::ProcedureNode*> procs;
+        for (viper::ASTNode* node : file.ast->get_nodes()) {
+            if (viper::ProcedureNode* proc = viper::dyn_cast<viper::ProcedureNode>(node)) {
+                procs.push_back(proc);
+            }
+        }
+        std::vector<viper::ProcedureNode*> picked;
+        for (std::size_t i = 0; i < procs.size(); i += every) {
+            picked.push_back(procs[i]);
+        }
+        return picked;
+    };
+
+    std::printf("    %zu procedures\n", procedures(1).size());
+    bench_report("parse", full, file.content.size());
+    bench_report("skim", skim, file.content.size());
+
+    for (u32 every : { 10u, 1u }) {
+        double expand = bench_best_of(3, [&]() {
+            file.skim();
+            for (viper::ProcedureNode* proc : procedures(every)) {
+                (void) proc->get_body();
+            }
+        });
+        std::string name = every == 1 ? "skim, then every body" : "skim, then 1 body in " + std::to_string(every);
+        bench_report(name.c_str(), expand, file.content.size());
+    }
+    std::printf("    tree memory: parse %.1f MB, skim %.1f MB\n", full_memory / 1e6, skim_memory / 1e6);
+
+    return true;
+}
+
+// Time to reparse a 100k line file after each keystroke of typing a statement into
+// a procedure and deleting it again, against parsing the whole file
+uint8_t bench_incremental_parse() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    std::size_t lines = 0;
+    for (std::size_t bytes = 2 * 1024 * 1024; lines < 100000; bytes += bytes / 16) {
+        file.content = parser_corpus(bytes);
+        lines = std::ranges::count(file.content, '\n');
+    }
+
+    double full = bench_best_of(3, [&]() {
+        file.parse();
+    });
+    std::printf("    %zu lines, %zu top level nodes\n", lines, file.ast->get_nodes().size());
+    std::printf("    %-44s %10.3f ms\n", "parse", full * 1e3);
+
+    viper::IncrementalParser incremental = viper::IncrementalParser::create_new(&file);
+    const std::string typed = "let typed: i32 = 1 + 2;\n   ";
+    for (u32 percent : { 10u, 50u, 90u }) {
+        // Just inside a procedure body that far into the file
+        u32 offset = static_cast<u32>(file.content.find("return i;", file.content.size() * percent / 100));
+
+        double total = 0;
+        double slowest = 0;
+        auto keystroke = [&](viper::text_edit edit) {
+            double took = bench_best_of(1, [&]() { incremental.reparse(edit); });
+            total += took;
+            slowest = took > slowest ? took : slowest;
+        };
+        for (u32 i = 0; i < typed.size(); i++) {
+            keystroke({ offset + i, 0, std::string_view(typed).substr(i, 1) });
+        }
+        // Reading the tree moves what the typing left behind, once
+        double settle = bench_best_of(1, [&]() { (void) incremental.tree(); });
+        for (u32 i = typed.size(); i > 0; i--) {
+            keystroke({ offset + i - 1, 1, "" });
+        }
+
+        u32 keystrokes = 2 * typed.size();
+        std::string name = "keystroke " + std::to_string(percent) + "% into the file";
+        std::printf("    %-44s %10.3f ms mean  %9.3f ms slowest  %6.0fx faster than parse\n",
+            name.c_str(), total * 1e3 / keystrokes, slowest * 1e3, full * keystrokes / total);
+        std::printf("    %-44s %10.3f ms\n", "  tree() after typing the statement", settle * 1e3);
+    }
+
+    return true;
+}
+
+uint8_t bench_ast_image() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = parser_corpus(16 * 1024 * 1024);
+
+    double parse = bench_best_of(3, [&]() {
+        file.parse();
+        (void) file.ast->flat();
+    });
+    viper::FlatView flat = file.ast->flat();
+
+    char path[] = "/tmp/viper_image_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+
+    bool written = false;
+    double write = bench_best_of(3, [&]() {
+        written = viper::ASTImage::write(path, flat, file.source());
+    });
+
+    // Opening checks the whole image. The walk then reads every node the way a pass would
+    bool opened = true;
+    double open = bench_best_of(5, [&]() {
+        viper::ASTImage image;
+        opened = opened && viper::ASTImage::open(path, &image);
+    });
+    u64 visited = 0;
+    u64 image_bytes = 0;
+    double walk = bench_best_of(5, [&]() {
+        viper::ASTImage image;
+        opened = opened && viper::ASTImage::open(path, &image);
+        visited = 0;
+        const viper::FlatView& tree = image.tree();
+        for (viper::node_id id = 0; id < tree.size(); id++) {
+            visited += tree.kind(id) != viper::AST_NOOP && tree.tok(id).length != 0;
+        }
+        image_bytes = image.bytes();
+    });
+    std::remove(path);
+    if (!written || !opened) {
+        std::printf("bench_ast_image: the image could not be written or read back\n");
+        return false;
+    }
+
+    std::printf("    %u nodes, %llu with source text, %.1f MB source, %.1f MB image\n", flat.size(),
+        (unsigned long long)visited, file.content.size() / 1e6, image_bytes / 1e6);
+    bench_report("lex and parse, then flatten", parse, file.content.size());
+    bench_report("encode and write the image", write, file.content.size());
+    bench_report("map and check the image", open, file.content.size());
+    bench_report("map, check and walk every node", walk, file.content.size());
+    std::printf("    loading is %.1fx faster than parsing, %.1fx with the walk\n", parse / open, parse / walk);
+
+    return true;
+}
+
+void parser_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_token_delivery, "Benchmark handing tokens over one at a time and in batches");
+    manager.register_test(bench_parser_tokens, "Benchmark parsing time per token");
+    manager.register_test(bench_result_returns, "Benchmark returning parser results");
+    manager.register_test(bench_expression_chains, "Benchmark parsing long operator chains");
+    manager.register_test(bench_deep_nesting, "Benchmark parsing deeply nested code");
+    manager.register_test(bench_malformed_input, "Benchmark parsing files with mistakes in them");
+    manager.register_test(bench_ast_traversal, "Benchmark walking the pointer tree against the flat tree");
+    manager.register_test(bench_parallel_parse, "Benchmark parsing declarations on a pool of threads against one thread");
+    manager.register_test(bench_skim_parse, "Benchmark skimming procedure bodies against parsing them");
+    manager.register_test(bench_incremental_parse, "Benchmark reparsing a 100k line file after each keystroke");
+    manager.register_test(bench_ast_image, "Benchmark loading a mapped tree image against parsing");
+    manager.register_test(bench_pipelined_parse, "Benchmark pipelined parsing against parsing on one thread");
+}
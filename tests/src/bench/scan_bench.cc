@@ -0,0 +1,123 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <tokenizer/scan.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const viper::scan::isa k_bench_isas[] = {
+    viper::scan::isa::SCALAR,
+    viper::scan::isa::SSE2,
+    viper::scan::isa::AVX2,
+};
+
+/// @brief Time a kernel over the whole of a text, restarting after each run it stops at
+template <typename F>
+static double time_kernel(const std::string& text, F&& kernel) {
+    return bench_best_of(5, [&]() {
+        u64 pos = 0;
+        while (pos < text.size()) {
+            u64 end = kernel(text.data(), text.size(), pos);
+            pos = end > pos ? end : pos + 1;
+        }
+    });
+}
+
+// Throughput of each scanning kernel and of the whole tokenizer per instruction set
+uint8_t bench_scan_kernels() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    // Deeply indented code, long identifiers and long numeric literals
+    std::string whitespace;
+    std::string identifiers;
+    std::string digits;
+    while (whitespace.size() < 16 * 1024 * 1024) {
+        whitespace += "\n                                        \t\t\t\t  x";
+        identifiers += "some_rather_long_identifier_name_used_in_generated_code ";
+        digits += "1234567890123456789012345678901234567890 ";
+    }
+
+    viper::VFile file;
+    file.name = "bench.viper";
+    file.content = bench_generate_corpus(16 * 1024 * 1024);
+
+    viper::scan::isa original = viper::scan::active_isa();
+    for (viper::scan::isa set : k_bench_isas) {
+        if (!viper::scan::set_isa(set)) {
+            continue;
+        }
+        std::printf("    [%s]\n", viper::scan::isa_name(set));
+
+        bench_report("skip_whitespace", time_kernel(whitespace, viper::scan::skip_whitespace), whitespace.size());
+        bench_report("skip_identifier", time_kernel(identifiers, viper::scan::skip_identifier), identifiers.size());
+        bench_report("skip_digits", time_kernel(digits, viper::scan::skip_digits), digits.size());
+
+        double tokenize = bench_best_of(3, [&]() {
+            viper::Tokenizer::create_new(&file).tokenize_file();
+        });
+        bench_report("tokenize generated corpus", tokenize, file.content.size());
+    }
+    viper::scan::set_isa(original);
+
+    return true;
+}
+
+// Throughput of finding line starts and of lexing on mixed line endings,
+// against the same text with '\n' endings only
+uint8_t bench_line_endings() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    std::string lf = bench_generate_corpus(16 * 1024 * 1024);
+    std::string mixed;
+    mixed.reserve(lf.size() + lf.size() / 16);
+    u64 line = 0;
+    for (char c : lf) {
+        if (c == '\n') {
+            mixed += line % 3 == 0 ? "\r\n" : line % 3 == 1 ? "\r" : "\n";
+            line++;
+        } else {
+            mixed += c;
+        }
+    }
+
+    viper::scan::isa original = viper::scan::active_isa();
+    for (viper::scan::isa set : k_bench_isas) {
+        if (!viper::scan::set_isa(set)) {
+            continue;
+        }
+        std::printf("    [%s]\n", viper::scan::isa_name(set));
+
+        for (const std::string* text : { &lf, &mixed }) {
+            std::vector<u32> lines;
+            lines.reserve(line + 1);
+            bench_report(text == &lf ? "find line starts, \\n endings" : "find line starts, mixed endings", bench_best_of(3, [&]() {
+                lines.clear();
+                viper::scan::find_newlines(text->data(), text->size(), 0, &lines);
+            }), text->size());
+        }
+    }
+    viper::scan::set_isa(original);
+
+    for (const std::string* text : { &lf, &mixed }) {
+        viper::VFile file;
+        file.name = "bench.viper";
+        file.content = *text;
+        bench_report(text == &lf ? "tokenize, \\n endings" : "tokenize, mixed endings", bench_best_of(3, [&]() {
+            viper::Tokenizer::create_new(&file).tokenize_file();
+        }), text->size());
+    }
+
+    return true;
+}
+
+void scan_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_scan_kernels, "Benchmark simd scanning kernels against the scalar kernels");
+    manager.register_test(bench_line_endings, "Benchmark finding lines and lexing on mixed line endings");
+}
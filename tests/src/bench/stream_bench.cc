@@ -0,0 +1,111 @@
+#include "bench.h"
+
+#include <core/core.h>
+#include <tokenizer/tokenizer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+/// @brief Peak resident memory of the process in bytes, from VmHWM
+static u64 peak_rss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+/// @brief Reset the peak resident memory to the current resident memory
+static bool reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    return static_cast<bool>(clear_refs.flush());
+}
+
+/// @brief Write a generated file of about `bytes` bytes. One chunk is repeated
+///        so generating it does not itself need memory in proportion to the file
+static bool write_generated_file(const char* path, std::size_t bytes) {
+    std::string chunk = bench_generate_corpus(8 * 1024 * 1024);
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    for (std::size_t written = 0; written < bytes; written += chunk.size()) {
+        out.write(chunk.data(), chunk.size());
+    }
+    return static_cast<bool>(out.flush());
+}
+
+/// @brief Peak memory growth while running a function
+template <typename F>
+static u64 peak_rss_growth(F&& func) {
+    reset_peak_rss();
+    u64 before = peak_rss();
+    func();
+    u64 after = peak_rss();
+    return after > before ? after - before : 0;
+}
+
+// Streaming a multi-hundred-MB mapped file must stay within a fixed amount of memory
+uint8_t bench_streaming_peak_rss() {
+    if (!bench_enabled()) {
+        return BENCH_SKIPPED;
+    }
+
+    char big_path[] = "/tmp/viper_stream_big_XXXXXX";
+    char small_path[] = "/tmp/viper_stream_small_XXXXXX";
+    int big_fd = mkstemp(big_path);
+    int small_fd = mkstemp(small_path);
+    if (big_fd < 0 || small_fd < 0) {
+        return false;
+    }
+    close(big_fd);
+    close(small_fd);
+
+    constexpr std::size_t BIG = 384 * 1024 * 1024;
+    constexpr std::size_t SMALL = 32 * 1024 * 1024;
+    constexpr u64 LIMIT = 64 * 1024 * 1024; // Window, released chunks and allocator slack
+    bool result = write_generated_file(big_path, BIG) && write_generated_file(small_path, SMALL);
+
+    if (result) {
+        viper::VFile big = viper::VFile::from(big_path, nullptr);
+        viper::VFile small = viper::VFile::from(small_path, nullptr);
+
+        u64 tokens = 0;
+        double seconds = 0;
+        u64 streaming = peak_rss_growth([&]() {
+            seconds = bench_best_of(1, [&]() {
+                viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&big);
+                for (viper::token tok = lexer.next_token(); tok.kind != viper::TK_EOF; tok = lexer.next_token()) {
+                    lexer.peek_token(viper::Tokenizer::TOKEN_WINDOW - 1);
+                    tokens++;
+                }
+            });
+        });
+        u64 collected = peak_rss_growth([&]() {
+            viper::Tokenizer::create_new(&small).tokenize_file();
+        });
+
+        bench_report("streaming tokenizer", seconds, big.source().size());
+        std::printf("    streaming %zu MB file: %lu tokens, peak RSS growth %.1f MB\n",
+            big.source().size() >> 20, tokens, streaming / (1024.0 * 1024.0));
+        std::printf("    token vector %zu MB file: peak RSS growth %.1f MB\n",
+            small.source().size() >> 20, collected / (1024.0 * 1024.0));
+
+        if (streaming > LIMIT) {
+            std::printf("bench_streaming_peak_rss: streaming grew by more than %lu MB\n", LIMIT >> 20);
+            result = false;
+        }
+    }
+
+    unlink(big_path);
+    unlink(small_path);
+    return result;
+}
+
+void stream_register_benchmarks(TestManager& manager) {
+    manager.register_test(bench_streaming_peak_rss, "Benchmark peak memory of the streaming tokenizer on a large file");
+}
@@ -0,0 +1,109 @@
+#include <core/arena.h>
+#include <core/ast.h>
+#include <parser/parser.h>
+#include "arena_test.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Object that records the order destructors run in
+struct arena_tracked {
+    arena_tracked(std::vector<int>* log, int id) : log(log), id(id) {}
+    ~arena_tracked() { log->push_back(id); }
+
+    std::vector<int>* log;
+    int id;
+};
+
+// Objects are aligned, survive new blocks and are destroyed newest first on release
+uint8_t arena_test_make_and_release() {
+    std::vector<int> log;
+    viper::Arena arena;
+
+    bool result = true;
+    for (int i = 0; i < 10000; i++) {
+        arena_tracked* tracked = arena.make<arena_tracked>(&log, i);
+        char* byte = arena.make<char>('x');
+        double* wide = arena.make<double>(i * 0.5);
+        if (reinterpret_cast<uintptr_t>(tracked) % alignof(arena_tracked) != 0
+            || reinterpret_cast<uintptr_t>(wide) % alignof(double) != 0
+            || *byte != 'x' || tracked->id != i) {
+            std::printf("arena_test_make_and_release: object %d is misplaced\n", i);
+            result = false;
+            break;
+        }
+    }
+
+    // Larger than a block
+    std::vector<int>* big = arena.make<std::vector<int>>(1000, 7);
+    void* huge = arena.allocate(1024 * 1024, 64);
+    if (big->size() != 1000 || reinterpret_cast<uintptr_t>(huge) % 64 != 0 || arena.block_count() < 2) {
+        std::printf("arena_test_make_and_release: large allocations went wrong\n");
+        result = false;
+    }
+
+    arena.release();
+    if (log.size() != 10000 || log.front() != 9999 || log.back() != 0) {
+        std::printf("arena_test_make_and_release: %zu destructors ran\n", log.size());
+        result = false;
+    }
+
+    return result && arena.memory_used() == 0 && arena.block_count() == 0;
+}
+
+// Adopted objects live as long as the arena that took them, and are destroyed first
+uint8_t arena_test_adopt() {
+    std::vector<int> log;
+    viper::Arena arena;
+    viper::Arena other;
+    for (int i = 0; i < 100; i++) {
+        (void) arena.make<arena_tracked>(&log, i);
+        (void) other.make<arena_tracked>(&log, 100 + i);
+    }
+    u64 bytes = arena.memory_used() + other.memory_used();
+    u64 blocks = arena.block_count() + other.block_count();
+
+    arena.adopt(other);
+    bool result = other.memory_used() == 0 && other.block_count() == 0
+        && arena.memory_used() == bytes && arena.block_count() == blocks;
+
+    // Releasing the empty arena destroys nothing
+    other.release();
+    result = result && log.empty();
+
+    (void) arena.make<arena_tracked>(&log, 200);
+    arena.release();
+    if (log.size() != 201 || log[0] != 200 || log[1] != 199 || log[100] != 100 || log[101] != 99 || log.back() != 0) {
+        std::printf("arena_test_adopt: %zu destructors ran in the wrong order\n", log.size());
+        result = false;
+    }
+
+    return result;
+}
+
+// Every node of a parsed file lives in its tree's arena
+uint8_t arena_test_ast_nodes() {
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = "struct test_struct {\n"
+                    "   name :: i32;\n"
+                    "}\n"
+                    "define main(param1: i32): i32 {\n"
+                    "   let i: i32 = (1 + 2) * 3;\n"
+                    "   return i;\n"
+                    "}\n";
+
+    file->parse();
+    bool result = file->ast->get_nodes().size() == 2 && file->ast->memory_used() > 0;
+
+    delete file;
+    return result;
+}
+
+void arena_register_tests(TestManager& manager) {
+    manager.register_test(arena_test_make_and_release, "Test arena placement, large allocations and release order");
+    manager.register_test(arena_test_adopt, "Test an arena taking over the objects of another");
+    manager.register_test(arena_test_ast_nodes, "Test parsed nodes are allocated in the tree's arena");
+}
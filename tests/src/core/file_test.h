@@ -0,0 +1,5 @@
+#pragma once
+
+#include "test_manager.h"
+
+void file_register_tests(TestManager& manager);
@@ -0,0 +1,205 @@
+#include <core/core.h>
+#include <tokenizer/tokenizer.h>
+#include "file_test.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* k_file_source = 
+    "define main(): i32 {\n"
+    "   let x: u32 = 1;\n"
+    "   return x;\n"
+    "}\n";
+
+/// @brief Count the tokens the tokenizer produces for a file
+static std::size_t count_tokens(viper::VFile* file) {
+    viper::Tokenizer tokenizer = viper::Tokenizer::create_new(file);
+    return tokenizer.tokenize_file().size();
+}
+
+// Regular files should be mapped and scanned in place
+uint8_t file_test_mapped_source() {
+    char path[] = "/tmp/viper_file_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    std::ofstream(path) << k_file_source;
+
+    bool result = true;
+    {
+        viper::VFile file = viper::VFile::from(path, nullptr);
+        if (file.mapping.data == nullptr || !file.content.empty()) {
+            std::printf("file_test_mapped_source: file was not mapped\n");
+            result = false;
+        }
+        if (file.source() != k_file_source) {
+            std::printf("file_test_mapped_source: mapped source does not match the file\n");
+            result = false;
+        }
+
+        // Moving the file must hand over the mapping
+        viper::VFile moved = std::move(file);
+        if (file.mapping.data != nullptr || moved.source() != k_file_source) {
+            std::printf("file_test_mapped_source: mapping was not moved\n");
+            result = false;
+        }
+
+        viper::VFile buffered;
+        buffered.name = "buffered.viper";
+        buffered.content = k_file_source;
+        if (count_tokens(&moved) != count_tokens(&buffered)) {
+            std::printf("file_test_mapped_source: mapped and buffered token counts differ\n");
+            result = false;
+        }
+    }
+
+    std::remove(path);
+    return result;
+}
+
+// A mapped file with CRLF and CR line endings is lexed as it is, and its tokens
+// land on the same lines and columns as those of the file with '\n' endings.
+// Its multi-line strings have the same values too
+uint8_t file_test_crlf_line_endings() {
+    const std::string crlf_source =
+        "define main(): i32 {\r\n"
+        "   let x: u32 = 1; // one\r"
+        "   let s: str = \"a\r\nb\rc\r\n\";\r\n"
+        "   return x;\r\n"
+        "}\r\n";
+    const std::string lf_source =
+        "define main(): i32 {\n"
+        "   let x: u32 = 1; // one\n"
+        "   let s: str = \"a\nb\nc\n\";\n"
+        "   return x;\n"
+        "}\n";
+
+    char path[] = "/tmp/viper_file_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    std::ofstream(path, std::ios::binary) << crlf_source;
+
+    bool result = true;
+    {
+        viper::VFile file = viper::VFile::from(path, nullptr);
+        std::vector<viper::token> tokens = viper::Tokenizer::create_new(&file).tokenize_file();
+
+        if (file.mapping.data == nullptr || file.source() != crlf_source) {
+            std::printf("file_test_crlf_line_endings: the mapped source was changed\n");
+            result = false;
+        }
+
+        viper::VFile buffered;
+        buffered.name = "buffered.viper";
+        buffered.content = lf_source;
+        std::vector<viper::token> expected = viper::Tokenizer::create_new(&buffered).tokenize_file();
+        if (tokens.size() != expected.size()) {
+            std::printf("file_test_crlf_line_endings: token counts differ\n");
+            result = false;
+        }
+        for (std::size_t i = 0; result && i < tokens.size(); i++) {
+            viper::Location at = tokens[i].location(&file);
+            viper::Location expected_at = expected[i].location(&buffered);
+            if (tokens[i].kind != expected[i].kind || at.line != expected_at.line
+                || (tokens[i].kind != viper::TK_EOF && at.character != expected_at.character)
+                || (tokens[i].kind == viper::TK_STR && tokens[i].string_value(&file) != expected[i].string_value(&buffered))) {
+                std::printf("file_test_crlf_line_endings: token %zu differs\n", i);
+                result = false;
+            }
+        }
+    }
+
+    std::ifstream disk(path, std::ios::binary);
+    std::string on_disk((std::istreambuf_iterator<char>(disk)), std::istreambuf_iterator<char>());
+    if (on_disk != crlf_source) {
+        std::printf("file_test_crlf_line_endings: the file on disk was changed\n");
+        result = false;
+    }
+
+    std::remove(path);
+    return result;
+}
+
+// Lines and columns are found from byte offsets, counting both from 1
+uint8_t file_test_locations() {
+    viper::VFile file;
+    file.name = "locations.viper";
+    file.content = k_file_source;
+
+    struct location_case {
+        u64 offset;
+        i32 line;
+        i32 character;
+    };
+    const location_case cases[] = {
+        {0,  1, 1},  // 'd' of define
+        {20, 1, 21}, // The newline ending the first line belongs to it
+        {21, 2, 1},  // First byte of the second line
+        {28, 2, 8},  // 'x' of let x
+        {std::strlen(k_file_source) - 2, 4, 1}, // The closing brace
+        {std::strlen(k_file_source),     5, 1}, // End of file, after the last newline
+    };
+
+    bool result = true;
+    for (const location_case& c : cases) {
+        viper::Location loc = file.location_of(c.offset);
+        if (loc.line != c.line || loc.character != c.character) {
+            std::printf("file_test_locations: offset %lu is at %d:%d, expected %d:%d\n",
+                c.offset, loc.line, loc.character, c.line, c.character);
+            result = false;
+        }
+    }
+
+    // Token locations come from the same table
+    std::vector<viper::token> tokens = viper::Tokenizer::create_new(&file).tokenize_file();
+    viper::Location ret = tokens[tokens.size() - 5].location(&file);
+    if (tokens[tokens.size() - 5].kind != viper::TK_RETURN || ret.line != 3 || ret.character != 4) {
+        std::printf("file_test_locations: return is at %d:%d\n", ret.line, ret.character);
+        result = false;
+    }
+
+    return result;
+}
+
+// Pipes can not be mapped and have to be read through the buffered path
+uint8_t file_test_pipe_fallback() {
+    std::string path = "/tmp/viper_file_test_fifo_" + std::to_string(getpid());
+    if (mkfifo(path.c_str(), 0600) != 0) {
+        return false;
+    }
+
+    std::thread writer([&path]() {
+        std::ofstream(path) << k_file_source;
+    });
+
+    viper::VFile file = viper::VFile::from(path, nullptr);
+    writer.join();
+    std::remove(path.c_str());
+
+    if (file.mapping.data != nullptr) {
+        std::printf("file_test_pipe_fallback: a pipe should not be mapped\n");
+        return false;
+    }
+
+    return file.source() == k_file_source;
+}
+
+void file_register_tests(TestManager& manager) {
+    manager.register_test(file_test_mapped_source, "Test regular files are memory mapped and tokenized in place");
+    manager.register_test(file_test_crlf_line_endings, "Test CRLF and CR line endings are lexed in place onto the right lines");
+    manager.register_test(file_test_locations, "Test byte offsets are turned into lines and columns");
+    manager.register_test(file_test_pipe_fallback, "Test pipes fall back to buffered reads");
+}
@@ -0,0 +1,104 @@
+#include <core/core.h>
+#include <core/interner.h>
+#include <tokenizer/tokenizer.h>
+#include "interner_test.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The same spelling always gets the same symbol
+uint8_t interner_test_same_spelling() {
+    viper::Interner& interner = viper::Interner::global();
+
+    std::string first = "interner_test_name";
+    std::string second = "interner_test_" + std::string("name");
+    viper::symbol a = interner.intern(first);
+    viper::symbol b = interner.intern(second);
+    viper::symbol c = interner.intern("interner_test_other");
+
+    if (a != b || a == c) {
+        std::printf("interner_test_same_spelling: symbols %u %u %u\n", a, b, c);
+        return false;
+    }
+
+    return interner.get(a) == "interner_test_name"
+        && interner.get(c) == "interner_test_other"
+        && interner.intern("") == viper::SYMBOL_EMPTY;
+}
+
+// Spellings stay valid while the table grows
+uint8_t interner_test_growth() {
+    viper::Interner& interner = viper::Interner::global();
+
+    std::vector<viper::symbol> symbols;
+    for (int i = 0; i < 20000; i++) {
+        symbols.push_back(interner.intern("grow_" + std::to_string(i)));
+    }
+
+    for (int i = 0; i < 20000; i++) {
+        if (interner.get(symbols[i]) != "grow_" + std::to_string(i)) {
+            std::printf("interner_test_growth: symbol %d lost its spelling\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Identifiers from different files share symbols
+uint8_t interner_test_tokens_share_symbols() {
+    viper::VFile* file_a = viper::VFile::create_new_ptr();
+    file_a->name = "a.viper";
+    file_a->content = "let counter: i32 = 0;";
+
+    viper::VFile* file_b = viper::VFile::create_new_ptr();
+    file_b->name = "b.viper";
+    file_b->content = "define main(): i32 { counter = counter + 1; }";
+
+    auto tokens_a = viper::Tokenizer::create_new(file_a).tokenize_file();
+    auto tokens_b = viper::Tokenizer::create_new(file_b).tokenize_file();
+
+    viper::symbol counter = viper::Interner::global().intern("counter");
+    viper::symbol i32 = viper::Interner::global().intern("i32");
+
+    bool result = tokens_a[1].payload == counter
+        && tokens_a[3].payload == i32
+        && tokens_b[7].payload == counter
+        && tokens_b[9].payload == counter;
+
+    delete file_a;
+    delete file_b;
+    return result;
+}
+
+// A cache gives the symbols of its own interner, whichever names share its slots
+uint8_t interner_test_cache() {
+    viper::Interner first;
+    viper::Interner second;
+    second.intern("taken_first");
+    viper::InternCache cache(&first);
+    viper::InternCache other(&second);
+
+    // More names than entries, so slots are reused, and every name asked for twice
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 4 * (int)viper::InternCache::SIZE; i++) {
+            std::string name = "cached_" + std::to_string(i);
+            viper::symbol sym = cache.intern(name);
+            viper::symbol other_sym = other.intern(name);
+            if (sym != first.intern(name) || first.get(sym) != name || other_sym != second.intern(name) || sym == other_sym) {
+                std::printf("interner_test_cache: %s got %u and %u\n", name.c_str(), sym, other_sym);
+                return false;
+            }
+        }
+    }
+
+    return cache.intern("") == viper::SYMBOL_EMPTY && cache.interner() == &first;
+}
+
+void interner_register_tests(TestManager& manager) {
+    manager.register_test(interner_test_same_spelling, "Test interning the same spelling gives the same symbol");
+    manager.register_test(interner_test_growth, "Test interned spellings survive table growth");
+    manager.register_test(interner_test_tokens_share_symbols, "Test identifier tokens of different files share symbols");
+    manager.register_test(interner_test_cache, "Test an intern cache gives the symbols of its own interner");
+}
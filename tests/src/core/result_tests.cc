@@ -0,0 +1,86 @@
+#include <core/ast.h>
+#include <core/result.h>
+#include <core/verror.h>
+#include "result_test.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+using ResultNode = viper::result::Result<viper::ASTNode*, viper::VError>;
+using ResultString = viper::result::Result<std::string, viper::VError>;
+
+static_assert(sizeof(ResultNode) == sizeof(void*), "a node result is one word");
+static_assert(std::is_trivially_copyable_v<ResultNode>, "a node result is trivially copyable");
+static_assert(sizeof(viper::VError) == sizeof(void*), "an error is a handle");
+
+// A node result keeps the node or the error through copies and moves
+uint8_t result_test_pointer_results() {
+    viper::ASTNode node;
+    ResultNode ok = viper::result::Ok(&node);
+    ResultNode null = viper::result::Ok(static_cast<viper::ASTNode*>(nullptr));
+    viper::ErrorStore errors;
+    ResultNode err = viper::result::Err(errors.report(viper::error_type::PARSER_ERR, "expected an expression"));
+
+    // Copies keep whether they are Ok
+    ResultNode ok_copy = ok;
+    ResultNode err_copy = err;
+    ResultNode err_moved = std::move(err_copy);
+    ok_copy = err;
+    err_copy = ok;
+
+    int fallbacks = 0;
+    viper::ASTNode fallback;
+    bool result = ok.is_ok() && ok.unwrap() == &node
+        && null.is_ok() && null.unwrap() == nullptr
+        && err.is_err() && err.unwrap_or(&fallback) == &fallback
+        && err_moved.is_err() && err_moved.unwrap_err().message() == "expected an expression"
+        && err.unwrap_err().type() == viper::error_type::PARSER_ERR
+        && ok_copy.is_err() && err_copy.is_ok() && err_copy.unwrap() == &node
+        && ok.unwrap_or_else([&] { fallbacks++; return &fallback; }) == &node
+        && err.unwrap_or_else([&] { fallbacks++; return &fallback; }) == &fallback
+        && fallbacks == 1;
+
+    return result;
+}
+
+// Results of other types hold a value that is moved, not copied, out of them
+uint8_t result_test_value_results() {
+    std::string long_text(100, 'x');
+    ResultString ok = viper::result::Ok(long_text);
+    ResultString copy = ok;
+    viper::ErrorStore errors;
+    ResultString err = viper::result::Err(errors.report(viper::error_type::LEXER_ERR, "bad"));
+    ResultString err_copy = err;
+
+    bool result = copy.is_ok() && copy.unwrap() == long_text
+        && ok.is_ok() && ok.unwrap() == long_text
+        && err_copy.is_err() && err_copy.unwrap_err().message() == "bad"
+        && err.unwrap_or_default().empty();
+
+    return result;
+}
+
+// A store frees the errors released from it, and the others keep their records
+uint8_t result_test_error_store() {
+    viper::ErrorStore errors;
+    viper::VError first = errors.report(viper::error_type::PARSER_ERR, "first");
+    viper::VError second = errors.report(viper::error_type::LEXER_ERR, "second");
+    viper::VError third = errors.report(viper::error_type::PARSER_ERR, "third");
+    errors.release(first);
+
+    viper::ErrorStore other;
+    viper::VError moved = other.report(viper::error_type::PREPROCESSOR_ERR, "moved");
+    errors.adopt(other);
+
+    return errors.size() == 3 && other.size() == 0
+        && second.message() == "second" && second.type() == viper::error_type::LEXER_ERR
+        && third.message() == "third" && moved.message() == "moved";
+}
+
+void result_register_tests(TestManager& manager) {
+    manager.register_test(result_test_pointer_results, "Test node results through copies, moves and fallbacks");
+    manager.register_test(result_test_value_results, "Test results that hold values");
+    manager.register_test(result_test_error_store, "Test errors are freed when released from their store");
+}
@@ -1,14 +1,26 @@
 #include "test_manager.h"
 #include "tokenizer/tokenizer_test.h"
+#include "tokenizer/scan_test.h"
 #include "parser/parser_test.h"
 #include "preprocessor/preprocessor_test.h"
+#include "core/file_test.h"
+#include "core/interner_test.h"
+#include "core/arena_test.h"
+#include "core/result_test.h"
+#include "bench/bench.h"
 
 int main(void) {
     TestManager manager = TestManager();
 
+    file_register_tests(manager);
+    interner_register_tests(manager);
+    arena_register_tests(manager);
+    result_register_tests(manager);
     tokenizer_register_tests(manager);
+    scan_register_tests(manager);
     preprocessor_register_tests(manager);
     parser_register_tests(manager);
+    bench_register_tests(manager);
 
     manager.run_tests();
     return 0;
@@ -1,8 +1,18 @@
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <core/ast_image.h>
+#include <parser/incremental.h>
 #include <parser/parser.h>
 #include <tokenizer/tokenizer.h>
 #include "parser_test.h"
 #include "token.h"
+#include <unistd.h>
 
 //#define PRINT
 
@@ -405,6 +415,964 @@ uint8_t parser_test_identifier_dimension_expression() {
     return result;
 }
 
+/// @brief Whether two trees have the same top level nodes, starting at the same tokens
+static bool same_top_level(const viper::AST& a, const viper::AST& b) {
+    const std::vector<viper::ASTNode*>& a_nodes = a.get_nodes();
+    const std::vector<viper::ASTNode*>& b_nodes = b.get_nodes();
+    if (a_nodes.size() != b_nodes.size()) {
+        std::printf("same_top_level: %zu nodes against %zu\n", a_nodes.size(), b_nodes.size());
+        return false;
+    }
+    for (std::size_t i = 0; i < a_nodes.size(); i++) {
+        if (a_nodes[i]->kind != b_nodes[i]->kind || a_nodes[i]->tok.offset != b_nodes[i]->tok.offset) {
+            std::printf("same_top_level: node %zu differs\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Whether two trees are the same node for node: kinds, tokens, payloads and children
+static bool same_tree(viper::AST& a, viper::AST& b) {
+    viper::FlatView fa = a.flat();
+    viper::FlatView fb = b.flat();
+    if (fa.size() != fb.size() || !std::ranges::equal(fa.roots(), fb.roots())) {
+        std::printf("same_tree: %u nodes against %u\n", fa.size(), fb.size());
+        return false;
+    }
+    for (viper::node_id id = 0; id < fa.size(); id++) {
+        if (fa.kind(id) != fb.kind(id) || fa.tok(id).kind != fb.tok(id).kind || fa.tok(id).offset != fb.tok(id).offset
+            || fa.payload(id) != fb.payload(id) || !std::ranges::equal(fa.children(id), fb.children(id))) {
+            std::printf("same_tree: node %u differs\n", id);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Expression written back with every operator application in parentheses
+static std::string render_expr(const viper::ASTNode* node, const viper::VFile* file) {
+    if (const auto* binary = viper::dyn_cast<viper::ExpressionBinaryNode>(node)) {
+        return "(" + render_expr(binary->get_lhs(), file) + " " + std::string(binary->get_operator().text(file)) + " "
+            + render_expr(binary->get_rhs(), file) + ")";
+    }
+    if (const auto* prefix = viper::dyn_cast<viper::ExpressionPrefixNode>(node)) {
+        return "(" + std::string(prefix->get_operator().text(file)) + render_expr(prefix->get_rhs(), file) + ")";
+    }
+    if (const auto* member = viper::dyn_cast<viper::ExpressionMemberAccessNode>(node)) {
+        return std::string(member->get_identifier().text(file)) + "." + render_expr(member->get_access(), file);
+    }
+    if (const auto* ident = viper::dyn_cast<viper::ExpressionIdentifierNode>(node)) {
+        return std::string(ident->get_identifier().text(file));
+    }
+    if (const auto* integer = viper::dyn_cast<viper::IntegerLiteralNode>(node)) {
+        return std::to_string(integer->get_value());
+    }
+    return "?";
+}
+
+// Operators apply by precedence and associativity, prefix operators first
+uint8_t parser_test_operator_precedence() {
+    const char* cases[][2] = {
+        { "a < b * c + d", "(a < ((b * c) + d))" },
+        { "a - b - c", "((a - b) - c)" },
+        { "a = b = c", "(a = (b = c))" },
+        { "a += b || c", "(a += (b || c))" },
+        { "-a * !b.c.d", "((-a) * (!b.c.d))" },
+        { "(a + b) * c != 2", "(((a + b) * c) != 2)" },
+        { "1 + 2 * 3 - 4 / 5 % 6", "((1 + (2 * 3)) - ((4 / 5) % 6))" },
+        { "--a", "(-(-a))" },
+    };
+
+    bool result = true;
+    for (const auto& c : cases) {
+        viper::VFile* file = viper::VFile::create_new_ptr();
+        file->name = "test.viper";
+        file->content = std::string("let x: i32 = ") + c[0] + ";\n";
+        file->parse();
+
+        const viper::VariableDeclarationNode* let = viper::dyn_cast<viper::VariableDeclarationNode>(file->ast->get_nodes()[0]);
+        std::string got = let ? render_expr(let->get_value(), file) : "";
+        if (got != c[1]) {
+            std::printf("parser_test_operator_precedence: %s parsed as %s, expected %s\n", c[0], got.c_str(), c[1]);
+            result = false;
+        }
+        delete file;
+    }
+
+    return result;
+}
+
+// Nodes of each kind and the depth of the deepest node of a parsed file
+struct tree_shape {
+    std::vector<u32> counts = std::vector<u32>(viper::AST_KIND_COUNT, 0);
+    u32 depth = 0;
+};
+
+static tree_shape shape_of(viper::VFile* file) {
+    viper::FlatView flat = file->ast->flat();
+    tree_shape shape;
+    // Parents come after their children, so walking down the ids reaches a parent first
+    std::vector<u32> depth(flat.size(), 0);
+    for (viper::node_id id = flat.size(); id-- > 0;) {
+        shape.counts[flat.kind(id)]++;
+        shape.depth = std::max(shape.depth, depth[id]);
+        for (viper::node_id child : flat.children(id)) {
+            if (child != viper::NO_NODE) {
+                depth[child] = depth[id] + 1;
+            }
+        }
+    }
+    return shape;
+}
+
+static std::string repeat(const char* text, u32 times) {
+    std::string out;
+    for (u32 i = 0; i < times; i++) {
+        out += text;
+    }
+    return out;
+}
+
+// Nesting deep enough to overflow the call stack of a recursive parser
+uint8_t parser_test_deep_nesting() {
+    const u32 depth = 100000;
+    struct nesting_case {
+        const char* name;
+        std::string content;
+        viper::NodeKind kind; // Kind there should be one of per level
+        u32 count;
+        u32 min_depth;
+    };
+    const std::string proc = "define main(): i32 {\n";
+    const nesting_case cases[] = {
+        { "blocks", proc + repeat("while a {\n", depth) + repeat("}\n", depth) + "}\n", viper::AST_WHILE_LOOP, depth, 2 * depth },
+        { "do while", proc + repeat("do {\n", depth) + repeat("} while a;\n", depth) + "}\n", viper::AST_DO_WHILE_LOOP, depth, 2 * depth },
+        { "elif arms", proc + "if a {}" + repeat(" elif a {}", depth) + " else {}\n}\n", viper::AST_CONDITIONAL, depth + 2, depth },
+        { "groups", "let x: i32 = " + repeat("(", depth) + "1" + repeat(")", depth) + ";\n", viper::AST_INTEGER_LITERAL, 1, 1 },
+        { "calls", "let x: i32 = " + repeat("f(", depth) + "1" + repeat(")", depth) + ";\n", viper::AST_PROCEDURE_CALL, depth, depth },
+        { "indexes", "let x: i32 = " + repeat("a[", depth) + "1" + repeat("]", depth) + ";\n", viper::AST_IDENTIFIER, depth, depth },
+        { "prefixes", "let x: i32 = " + repeat("-", depth) + "1;\n", viper::AST_PREFIX_EXPR, depth, depth },
+    };
+
+    bool result = true;
+    for (const nesting_case& c : cases) {
+        viper::VFile* file = viper::VFile::create_new_ptr();
+        file->name = "test.viper";
+        file->content = c.content;
+        file->parse();
+
+        tree_shape shape = shape_of(file);
+        if (file->ast->get_nodes().size() != 1 || shape.counts[c.kind] != c.count || shape.depth < c.min_depth
+            || shape.counts[viper::AST_INVALID_NODE] != 0 || shape.counts[viper::AST_EXPRESSION] != 0) {
+            std::printf("parser_test_deep_nesting: %s: %u of the kind, depth %u\n", c.name, shape.counts[c.kind], shape.depth);
+            result = false;
+        }
+        delete file;
+    }
+
+    return result;
+}
+
+// Every node carries the kind of its type, and the casts and visit go by it
+uint8_t parser_test_node_kinds() {
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = "define main(a: i32): i32 {\n"
+                    "   let s: i32 = a.b + foo(1, true, 2.5, \"x\");\n"
+                    "   while a { a; }\n"
+                    "   return -s;\n"
+                    "}\n";
+    file->parse();
+
+    viper::ASTNode* root = file->ast->get_nodes()[0];
+    viper::ProcedureNode* proc = viper::dyn_cast<viper::ProcedureNode>(root);
+    bool result = proc != nullptr
+        && root->kind == viper::AST_PROCEDURE
+        && viper::isa<viper::ASTNode>(root)
+        && !viper::isa<viper::ExpressionNode>(root)
+        && viper::dyn_cast<viper::CodeBlockStatementNode>(root) == nullptr
+        && viper::dyn_cast<viper::ProcedureNode>(static_cast<viper::ASTNode*>(nullptr)) == nullptr
+        && viper::cast<viper::ProcedureNode>(root) == proc;
+
+    // Walk the tree and check each kind against the type visit hands out
+    std::vector<const viper::ASTNode*> stack { root };
+    u32 counts[viper::AST_KIND_COUNT] = {};
+    while (result && !stack.empty()) {
+        const viper::ASTNode* node = stack.back();
+        stack.pop_back();
+        if (node == nullptr) {
+            continue;
+        }
+        counts[node->kind]++;
+        result = viper::visit(node, [](const auto* typed) {
+            return std::remove_cvref_t<decltype(*typed)>::classof(typed);
+        });
+        result = result && viper::isa<viper::ExpressionNode>(node) == (node->kind >= viper::AST_FIRST_EXPRESSION && node->kind <= viper::AST_LAST_EXPRESSION);
+        node->children(&stack);
+    }
+
+    result = result
+        && counts[viper::AST_PROCEDURE] == 1
+        && counts[viper::AST_PROC_PARAMETER] == 1
+        && counts[viper::AST_CODE_BLOCK] == 2
+        && counts[viper::AST_VARIABLE_DECLARATION] == 1
+        && counts[viper::AST_WHILE_LOOP] == 1
+        && counts[viper::AST_RETURN] == 1
+        && counts[viper::AST_BINARY_EXPR] == 1
+        && counts[viper::AST_MEMBER_ACCESS] == 1
+        && counts[viper::AST_PROCEDURE_CALL] == 1
+        && counts[viper::AST_INTEGER_LITERAL] == 1
+        && counts[viper::AST_BOOLEAN_LITERAL] == 1
+        && counts[viper::AST_FLOAT_LITERAL] == 1
+        && counts[viper::AST_STRING_LITERAL] == 1
+        && counts[viper::AST_PREFIX_EXPR] == 1
+        && counts[viper::AST_EXPRESSION_STATEMENT] == 1
+        && counts[viper::AST_DATA_TYPE] == 2
+        && counts[viper::AST_INVALID_NODE] == 0
+        && counts[viper::AST_EXPRESSION] == 0;
+
+    delete file;
+    return result;
+}
+
+// Parsing with the lexer and preprocessor on their own threads builds the same tree,
+// including when the parser has to skip over a mistake near the start of the file
+uint8_t parser_test_pipelined() {
+    bool result = true;
+
+    // Enough tokens to wrap the queues between the stages many times
+    std::string input;
+    for (int i = 0; i < 2000; i++) {
+        std::string n = std::to_string(i);
+        input += "let big_" + n + ": u64 = 4294967296 + " + n + ";\n"
+                 "define proc_" + n + "(a: f32): f32 {\n"
+                 "   let x: f32 = 2.5 * a;\n"
+                 "   return x;\n"
+                 "}\n";
+    }
+
+    viper::VFile* serial = viper::VFile::create_new_ptr();
+    serial->name = "test.viper";
+    serial->content = input;
+    serial->parse();
+
+    viper::VFile* pipelined = viper::VFile::create_new_ptr();
+    pipelined->name = "test.viper";
+    pipelined->content = input;
+    pipelined->parse_pipelined();
+
+    result = same_top_level(*serial->ast, *pipelined->ast);
+
+    // A stray '+' is skipped, and the rest of the file is parsed
+    std::string early = "let x: i32 = 1;\n+\n" + input;
+    serial->content = early;
+    serial->parse();
+    pipelined->content = early;
+    pipelined->parse_pipelined();
+
+    if (result) {
+        result = same_top_level(*serial->ast, *pipelined->ast) && pipelined->ast->get_nodes().size() == 1 + 2 * 2000
+            && serial->parse_errors.size() == 1 && pipelined->parse_errors.size() == 1;
+    }
+
+    delete serial;
+    delete pipelined;
+    return result;
+}
+
+/// @brief Ask for the body of every procedure of a skimmed tree, methods included
+static void parse_bodies(viper::AST& tree) {
+    std::vector<const viper::ASTNode*> pending(tree.get_nodes().begin(), tree.get_nodes().end());
+    while (!pending.empty()) {
+        const viper::ASTNode* node = pending.back();
+        pending.pop_back();
+        if (node == nullptr) {
+            continue;
+        }
+        if (const viper::ProcedureNode* proc = viper::dyn_cast<viper::ProcedureNode>(node)) {
+            (void) proc->get_body();
+        }
+        node->children(&pending);
+    }
+}
+
+// A mistake is reported once, and parsing picks up again at the next statement or
+// declaration. A file of nothing but mistakes stops being reported at MAX_ERRORS
+uint8_t parser_test_error_recovery() {
+    struct recovery_case {
+        const char* name;
+        std::string content;
+        u64 nodes;  // Top level nodes parsed
+        u64 errors; // Errors reported
+    };
+    const std::string good = "define g(): i32 { return 2; }\n";
+    const recovery_case cases[] = {
+        { "missing expression", "define f(): i32 {\n let x: i32 = ;\n return 1;\n}\n" + good, 2, 1 },
+        { "missing ';'", "define f(): i32 {\n let x: i32 = 1\n return x;\n}\n" + good, 2, 1 },
+        { "garbage statement", "define f(): i32 {\n ) ] : 5 ;\n return 1;\n}\n" + good, 2, 1 },
+        { "braces in a bad statement", "define f(): i32 {\n let x: i32 = { a; } ;\n return 1;\n}\n" + good, 2, 1 },
+        { "garbage at top level", "+ + ) {\n let b: i32 = 1;\n}\nlet a: i32 = 1;\n" + good, 2, 1 },
+        { "missing '}' before define", "define f(): i32 {\n while a {\n return 1;\n}\n" + good, 2, 1 },
+        { "missing '}' at the end", "define f(): i32 {\n if a {\n do {\n", 1, 1 },
+        { "bad struct member", "struct S {\n a :: i32;\n 5;\n b :: i32;\n}\n" + good, 2, 1 },
+        { "bad parameter", "define f(a i32, b: i32): i32 { return a; }\n" + good, 2, 1 },
+        { "unclosed call", "let x: i32 = f(1, 2;\nlet y: i32 = 3;\n" + good, 3, 1 },
+        { "two mistakes", "let x: i32 = );\n" + good + "let y: i32 = 1 +;\n", 3, 2 },
+    };
+
+    bool result = true;
+    for (const recovery_case& c : cases) {
+        viper::VFile* file = viper::VFile::create_new_ptr();
+        file->name = "test.viper";
+        file->content = c.content;
+        file->parse();
+
+        if (file->ast->get_nodes().size() != c.nodes || file->parse_errors.size() != c.errors) {
+            std::printf("parser_test_error_recovery: %s: %zu nodes, %zu errors\n",
+                c.name, file->ast->get_nodes().size(), file->parse_errors.size());
+            result = false;
+        }
+        delete file;
+    }
+
+    // Every line has a mistake. Each declaration is still parsed
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = repeat("let x: i32 = * 2;\n", 50000);
+    file->parse();
+    if (file->ast->get_nodes().size() != 50000 || file->parse_errors.size() != viper::Parser::MAX_ERRORS) {
+        std::printf("parser_test_error_recovery: %zu nodes, %zu errors in a file of mistakes\n",
+            file->ast->get_nodes().size(), file->parse_errors.size());
+        result = false;
+    }
+
+    // The errors go with the file when it is moved
+    viper::VFile moved = std::move(*file);
+    result = result && moved.parse_errors.size() == viper::Parser::MAX_ERRORS && file->parse_errors.empty();
+    delete file;
+
+    // Every body parsed into a skimmed tree shares the tree's one node for a failed expression
+    file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = repeat("define f(): i32 {\n   let x: i32 = * 2;\n   return x;\n}\n", 20);
+    file->skim();
+    parse_bodies(*file->ast);
+    viper::FlatView flat = file->ast->flat();
+    std::vector<const viper::ASTNode*> failed;
+    for (viper::node_id id = 0; id < flat.size(); id++) {
+        if (flat.kind(id) == viper::AST_EXPRESSION) {
+            failed.push_back(flat.pointer_node(id));
+        }
+    }
+    if (failed.size() != 20 || std::ranges::count(failed, failed[0]) != 20) {
+        std::printf("parser_test_error_recovery: %zu failed expressions in 20 bodies are not one node\n", failed.size());
+        result = false;
+    }
+    delete file;
+
+    return result;
+}
+
+// Parsing the declarations of a file on several threads builds the same tree and
+// reports the same errors as parsing serially, mistakes in the file or not
+uint8_t parser_test_parallel() {
+    auto source = [](u32 procs, u32 mistake_at) {
+        std::string out;
+        for (u32 i = 0; i < procs; i++) {
+            std::string n = std::to_string(i);
+            out += "let big_" + n + ": u64 = 4294967296 + " + n + ";\n"
+                   "struct record_" + n + " {\n"
+                   "   name :: i32;\n"
+                   "   define get(): i32 { return 1; }\n"
+                   "}\n"
+                   "define proc_" + n + "(a: f32): f32 {\n"
+                   "   let x: f32 = 2.5 * a;\n"
+                   "   while x { x = x - 1.0; }\n";
+            // A missing '}', which recovery reaches past the declaration for
+            out += i == mistake_at ? "   return x;\n" : "   return x;\n}\n";
+        }
+        return out;
+    };
+
+    struct parallel_case {
+        const char* name;
+        std::string content;
+    };
+    const parallel_case cases[] = {
+        { "clean", source(3000, ~0u) },
+        { "mistake at the start", "+\n" + source(3000, ~0u) },
+        { "mistake in the middle", source(3000, 1500) },
+        { "mistake at the end", source(3000, 2999) },
+    };
+
+    bool result = true;
+    for (const parallel_case& c : cases) {
+        viper::VFile* serial = viper::VFile::create_new_ptr();
+        serial->name = "test.viper";
+        serial->content = c.content;
+        serial->parse();
+
+        viper::VFile* parallel = viper::VFile::create_new_ptr();
+        parallel->name = "test.viper";
+        parallel->content = c.content;
+        parallel->parse_parallel(4);
+
+        if (!same_tree(*serial->ast, *parallel->ast) || serial->parse_errors.size() != parallel->parse_errors.size()) {
+            std::printf("parser_test_parallel: %s: %zu errors against %zu\n",
+                c.name, serial->parse_errors.size(), parallel->parse_errors.size());
+            result = false;
+        }
+        delete serial;
+        delete parallel;
+    }
+
+    return result;
+}
+
+// A skimmed file parses no body until it is asked for, and then builds the tree parse does
+uint8_t parser_test_skim() {
+    std::string clean;
+    for (u32 i = 0; i < 200; i++) {
+        std::string n = std::to_string(i);
+        clean += "let big_" + n + ": u64 = 4294967296 + " + n + ";\n"
+                 "struct record_" + n + " {\n"
+                 "   name :: i32;\n"
+                 "   define get(): i32 { return 1; }\n"
+                 "}\n"
+                 "define proc_" + n + "(a: f32): f32 {\n"
+                 "   let x: f32 = 2.5 * a;\n"
+                 "   while x { if x { x = x - 1.0; } }\n"
+                 "   return x;\n"
+                 "}\n";
+    }
+
+    struct skim_case {
+        const char* name;
+        std::string content;
+        u64 body_errors;  // Reported when the bodies are parsed
+        u64 parsed_early; // Bodies parsed by skim, after a header with an error
+    };
+    const skim_case cases[] = {
+        { "clean", clean, 0, 0 },
+        { "mistake in a body", clean + "define broken(): i32 {\n   let x: i32 = * 2;\n   return x;\n}\n", 1, 0 },
+        { "missing '}'", clean + "define open(): i32 {\n   return 1;\n", 1, 0 },
+        { "mistake in a header", clean + "define header(a: ): i32 {\n   return 1;\n}\n", 0, 1 },
+    };
+
+    bool result = true;
+    for (const skim_case& c : cases) {
+        viper::VFile* serial = viper::VFile::create_new_ptr();
+        serial->name = "test.viper";
+        serial->content = c.content;
+        serial->parse();
+
+        viper::VFile* skimmed = viper::VFile::create_new_ptr();
+        skimmed->name = "test.viper";
+        skimmed->content = c.content;
+        skimmed->skim();
+
+        // No body is parsed yet, so none of their errors are reported
+        std::vector<viper::ProcedureNode*> procs;
+        for (viper::ASTNode* node : skimmed->ast->get_nodes()) {
+            if (viper::ProcedureNode* proc = viper::dyn_cast<viper::ProcedureNode>(node)) {
+                procs.push_back(proc);
+            }
+        }
+        u64 pending = std::ranges::count_if(procs, [](const viper::ProcedureNode* p) { return p->body_pending(); });
+        bool ok = !procs.empty() && pending + c.parsed_early == procs.size()
+            && skimmed->parse_errors.size() + c.body_errors == serial->parse_errors.size();
+
+        // Asking for one body parses that one only
+        const viper::CodeBlockStatementNode* body = procs[0]->get_body();
+        ok = ok && body != nullptr && body->kind == viper::AST_CODE_BLOCK
+            && !procs[0]->body_pending() && procs[1]->body_pending();
+
+        // Flattening leaves the rest unparsed, as empty body slots
+        viper::FlatView flat = skimmed->ast->flat();
+        u64 empty_bodies = 0;
+        for (viper::node_id root : flat.roots()) {
+            if (flat.kind(root) == viper::AST_PROCEDURE) {
+                empty_bodies += flat.children(root)[1] == viper::NO_NODE;
+            }
+        }
+        ok = ok && procs[1]->body_pending() && empty_bodies == pending - 1;
+
+        // Asking for every body builds the tree parse does
+        parse_bodies(*skimmed->ast);
+        ok = ok && same_tree(*serial->ast, *skimmed->ast)
+            && skimmed->parse_errors.size() == serial->parse_errors.size();
+        if (!ok) {
+            std::printf("parser_test_skim: %s: %zu errors against %zu\n",
+                c.name, skimmed->parse_errors.size(), serial->parse_errors.size());
+            result = false;
+        }
+        delete serial;
+        delete skimmed;
+    }
+
+    return result;
+}
+
+// A skimmed tree kept after the file is parsed again still parses its bodies into
+// itself, with their errors, and they stay valid when the file's tree changes again
+uint8_t parser_test_skim_kept_tree() {
+    std::string source;
+    for (u32 i = 0; i < 20; i++) {
+        source += "define proc_" + std::to_string(i) + "(a: i32): i32 {\n   let x: i32 = a * 2;\n   return x;\n}\n";
+    }
+    source += "define broken(): i32 {\n   let x: i32 = * 2;\n   return x;\n}\n";
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = source;
+    file->skim();
+    std::shared_ptr<viper::AST> kept = file->ast;
+
+    file->parse();
+    u64 errors = file->parse_errors.size();
+    std::shared_ptr<viper::AST> parsed = file->ast;
+    parse_bodies(*kept);
+    bool result = same_tree(*parsed, *kept) && kept->errors().size() == 1 && file->parse_errors.size() == errors;
+
+    // Bodies parsed into the kept tree outlive the trees the file moves on to
+    file->parse();
+    parsed = nullptr;
+    file->ast = nullptr;
+    viper::VFile* whole = viper::VFile::create_new_ptr();
+    whole->name = "test.viper";
+    whole->content = source;
+    whole->parse();
+    result = result && same_tree(*whole->ast, *kept);
+
+    // Once the source is edited the skimmed bytes are not the bodies any more. The
+    // body comes back empty, and an error says it was lost
+    file->skim();
+    kept = file->ast;
+    u64 skim_errors = file->parse_errors.size();
+    file->apply_edit({ 0, 0, "let y: i32 = 1;\n" });
+    viper::ProcedureNode* first = viper::dyn_cast<viper::ProcedureNode>(kept->get_nodes()[0]);
+    const viper::CodeBlockStatementNode* body = first != nullptr ? first->get_body() : nullptr;
+    result = result && body != nullptr && body->get_body().empty()
+        && file->parse_errors.size() == skim_errors + 1 && kept->errors().size() == skim_errors + 1;
+
+    // A moved file keeps counting edits from where it was
+    whole->apply_edit({ 0, 0, " " });
+    viper::VFile moved = std::move(*whole);
+    moved.apply_edit({ 0, 0, " " });
+    result = result && moved.revision == 2 && whole->revision == 0;
+
+    if (!result) {
+        std::printf("parser_test_skim_kept_tree: bodies of a kept skimmed tree are wrong\n");
+    }
+    delete whole;
+    delete file;
+    return result;
+}
+
+// After every edit, reparsing builds the tree and tokens a whole parse would, and
+// keeps the nodes of the statements the edit did not reach
+uint8_t parser_test_incremental() {
+    std::string source;
+    for (u32 i = 0; i < 50; i++) {
+        std::string n = std::to_string(i);
+        source += "let big_" + n + ": u64 = 4294967296 + " + n + ";\n"
+                  "struct record_" + n + " {\n"
+                  "   name :: i32;\n"
+                  "   define get(): i32 { return 1; }\n"
+                  "}\n"
+                  "define proc_" + n + "(a: f32): f32 {\n"
+                  "   let x: f32 = 2.5 * a; // comment\n"
+                  "   while x { x = x - 1.0; }\n"
+                  "   return x;\n"
+                  "}\n";
+    }
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = source;
+    viper::IncrementalParser incremental = viper::IncrementalParser::create_new(file);
+
+    // Edits in the order they are made, each to the source the last one left
+    auto at = [&](const std::string& text) { return static_cast<u32>(file->content.find(text)); };
+    struct edit_case {
+        const char* name;
+        std::function<viper::text_edit()> edit;
+    };
+    const edit_case cases[] = {
+        { "type into a name", [&] { return viper::text_edit{ at("proc_20(") + 6, 0, "9" }; } },
+        { "add a statement", [&] { return viper::text_edit{ at("return x;\n}\nlet big_21"), 0, "let y: f32 = x;\n   " }; } },
+        { "join two tokens", [&] { return viper::text_edit{ at("2.5 * a; // comment\n   while x { x = x - 1.0; }\n   return x;\n}\nlet big_31") + 3, 3, "" }; } },
+        { "remove a '}'", [&] { return viper::text_edit{ at("}\nlet big_11"), 1, "" }; } },
+        { "put it back", [&] { return viper::text_edit{ at("let big_11"), 0, "}\n" }; } },
+        { "open a comment", [&] { return viper::text_edit{ at("let big_40"), 0, "/* " }; } },
+        { "close it", [&] { return viper::text_edit{ at("let big_42"), 0, " */" }; } },
+        { "garbage at the start", [&] { return viper::text_edit{ 0, 0, "+ " }; } },
+        { "remove it", [&] { return viper::text_edit{ 0, 2, "" }; } },
+        { "type at the end", [&] { return viper::text_edit{ static_cast<u32>(file->content.size()), 0, "let end: i32 = 1" }; } },
+        { "number in a name", [&] { return viper::text_edit{ at("2.5"), 0, "1" }; } },
+        { "replace a declaration", [&] { return viper::text_edit{ at("struct record_5 "), 7, "define " }; } },
+        { "empty the file", [&] { return viper::text_edit{ 0, static_cast<u32>(file->content.size()), "" }; } },
+        { "write it again", [&] { return viper::text_edit{ 0, 0, source }; } },
+    };
+
+    bool result = true;
+    for (const edit_case& c : cases) {
+        viper::text_edit edit = c.edit();
+        std::vector<viper::ASTNode*> before = file->ast->get_nodes();
+        incremental.reparse(edit);
+
+        viper::VFile* whole = viper::VFile::create_new_ptr();
+        whole->name = "test.viper";
+        whole->content = file->content;
+        whole->parse();
+        viper::Tokenizer lexer = viper::Tokenizer::create_new(whole);
+        std::vector<viper::token> tokens = lexer.tokenize_file();
+
+        bool same_tokens = std::ranges::equal(tokens, incremental.tokens(), [](const viper::token& a, const viper::token& b) {
+            return a.kind == b.kind && a.offset == b.offset && a.length == b.length;
+        });
+        if (!same_tokens || !same_tree(*whole->ast, *incremental.tree()) || whole->parse_errors.size() != file->parse_errors.size()) {
+            std::printf("parser_test_incremental: %s: %zu errors against %zu\n",
+                c.name, file->parse_errors.size(), whole->parse_errors.size());
+            result = false;
+        }
+
+        // Errors of statements parsed again are freed, the tree keeps only the file's
+        if (file->ast->errors().size() != file->parse_errors.size()) {
+            std::printf("parser_test_incremental: %s: the tree keeps %zu errors for %zu\n",
+                c.name, file->ast->errors().size(), file->parse_errors.size());
+            result = false;
+        }
+
+        // Typing into a name changes the one procedure
+        if (c.name == cases[0].name) {
+            u64 kept = 0;
+            for (viper::ASTNode* node : file->ast->get_nodes()) {
+                kept += std::ranges::count(before, node);
+            }
+            if (kept != before.size() - 1) {
+                std::printf("parser_test_incremental: %llu of %zu nodes kept\n", (unsigned long long)kept, before.size());
+                result = false;
+            }
+        }
+        delete whole;
+    }
+
+    delete file;
+    return result;
+}
+
+// Reparsing leaves the nodes after an edit where they were, and tree() moves them
+// once however many edits were made
+uint8_t parser_test_incremental_lazy_shift() {
+    std::string source;
+    for (u32 i = 0; i < 20; i++) {
+        source += "define proc_" + std::to_string(i) + "(a: i32): i32 {\n   return a + 1;\n}\n";
+    }
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = source;
+    viper::IncrementalParser incremental = viper::IncrementalParser::create_new(file);
+    auto last_offset = [](viper::AST& tree) {
+        u32 last = 0;
+        viper::FlatView flat = tree.flat();
+        for (viper::node_id id = 0; id < flat.size(); id++) {
+            last = std::max(last, flat.tok(id).offset);
+        }
+        return last;
+    };
+    u32 before = last_offset(*incremental.tree());
+
+    const std::string typed = "let typed: i32 = 1;\n";
+    for (u32 i = 0; i < typed.size(); i++) {
+        incremental.reparse({ i, 0, std::string_view(typed).substr(i, 1) });
+    }
+    u32 unmoved = last_offset(*file->ast);
+    u32 moved = last_offset(*incremental.tree());
+    bool result = unmoved == before && moved == before + typed.size();
+    if (!result) {
+        std::printf("parser_test_incremental_lazy_shift: last token at %u before tree(), %u after, was %u\n", unmoved, moved, before);
+    }
+
+    delete file;
+    return result;
+}
+
+// Random edits of a file with strings, comments and numbers leave the tokens and
+// tree a whole parse of the edited source gives
+uint8_t parser_test_incremental_random_edits() {
+    std::string source;
+    for (u32 i = 0; i < 12; i++) {
+        std::string n = std::to_string(i);
+        source += "define f_" + n + "(): i32 {\n"
+                  "  foo(\"hi " + n + "\", x); // note\n"
+                  "  let y: f64 = 2.5 * 4294967296;\n"
+                  "  /* block */ return 0;\n"
+                  "}\n";
+    }
+
+    // Renaming an argument right after a string restarts lexing next to its quotes
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = source;
+    viper::IncrementalParser incremental = viper::IncrementalParser::create_new(file);
+    std::vector<viper::text_edit> edits = { { static_cast<u32>(source.find("x);")), 1, "y" } };
+
+    const char* pieces[] = { "x", "\"", "\"s\"", "//", "\n", "/*", "*/", "1.5", "{", "}", ";", " ", "define ", "(", "7" };
+    std::mt19937 random(1234);
+    bool result = true;
+    for (u32 step = 0; result && step < 300; step++) {
+        viper::text_edit edit;
+        if (step < edits.size()) {
+            edit = edits[step];
+        } else {
+            u32 size = static_cast<u32>(file->content.size());
+            u32 offset = random() % (size + 1);
+            u32 removed = std::min<u32>(random() % 4, size - offset);
+            edit = { offset, removed, pieces[random() % std::size(pieces)] };
+        }
+        incremental.reparse(edit);
+
+        viper::VFile* whole = viper::VFile::create_new_ptr();
+        whole->name = "test.viper";
+        whole->content = file->content;
+        whole->parse();
+        viper::Tokenizer lexer = viper::Tokenizer::create_new(whole);
+        std::vector<viper::token> tokens = lexer.tokenize_file();
+
+        bool same_tokens = std::ranges::equal(tokens, incremental.tokens(), [](const viper::token& a, const viper::token& b) {
+            return a.kind == b.kind && a.offset == b.offset && a.length == b.length;
+        });
+        if (!same_tokens || !same_tree(*whole->ast, *incremental.tree())) {
+            std::printf("parser_test_incremental_random_edits: edit %u at %u removing %u inserting '%.*s' went wrong\n",
+                step, edit.offset, edit.removed, static_cast<int>(edit.inserted.size()), edit.inserted.data());
+            result = false;
+        }
+        delete whole;
+    }
+
+    delete file;
+    return result;
+}
+
+// The flat tree holds the same nodes as the pointer tree, children before parents
+uint8_t parser_test_flat_ast() {
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = "let x: i32 = 1 + 2;\n"
+                    "define main(a: i32): i32 {\n"
+                    "   if a {\n"
+                    "       return -a;\n"
+                    "   } else {\n"
+                    "       return 2.5;\n"
+                    "   }\n"
+                    "}\n";
+    file->parse();
+
+    viper::FlatView flat = file->ast->flat();
+    bool result = flat.roots().size() == 2;
+
+    // let x: i32 = 1 + 2;
+    viper::node_id let = flat.roots()[0];
+    std::span<const viper::node_id> let_children = flat.children(let);
+    result = result
+        && flat.kind(let) == viper::AST_VARIABLE_DECLARATION
+        && flat.pointer_node(let) == file->ast->get_nodes()[0]
+        && let_children.size() == 2
+        && flat.kind(let_children[0]) == viper::AST_DATA_TYPE
+        && flat.kind(let_children[1]) == viper::AST_BINARY_EXPR;
+    if (result) {
+        std::span<const viper::node_id> operands = flat.children(let_children[1]);
+        result = flat.tok(let_children[1]).kind == viper::TK_PLUS
+            && flat.payload(operands[0]) == 1
+            && flat.payload(operands[1]) == 2;
+    }
+
+    // The procedure: return type, body, then its parameter
+    viper::node_id proc = flat.roots()[1];
+    std::span<const viper::node_id> proc_children = flat.children(proc);
+    result = result
+        && flat.kind(proc) == viper::AST_PROCEDURE
+        && proc_children.size() == 3
+        && flat.kind(proc_children[1]) == viper::AST_CODE_BLOCK
+        && flat.kind(proc_children[2]) == viper::AST_PROC_PARAMETER;
+
+    // if a {...} else {...}: the else has no condition and no else of its own
+    if (result) {
+        viper::node_id branch = flat.children(proc_children[1])[0];
+        std::span<const viper::node_id> if_children = flat.children(branch);
+        viper::node_id else_branch = if_children[2];
+        result = flat.kind(branch) == viper::AST_CONDITIONAL
+            && flat.kind(if_children[0]) == viper::AST_IDENTIFIER
+            && flat.kind(else_branch) == viper::AST_CONDITIONAL
+            && flat.children(else_branch)[0] == viper::NO_NODE
+            && flat.children(else_branch)[2] == viper::NO_NODE;
+    }
+
+    // Every child comes before its parent
+    for (viper::node_id id = 0; result && id < flat.size(); id++) {
+        for (viper::node_id child : flat.children(id)) {
+            if (child != viper::NO_NODE && child >= id) {
+                std::printf("parser_test_flat_ast: child %u of node %u comes after it\n", child, id);
+                result = false;
+            }
+        }
+    }
+
+    delete file;
+    return result;
+}
+
+uint8_t parser_test_ast_image() {
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = "struct point { x :: i32; y :: i32; }\n"
+                    "let origin: point = 0;\n"
+                    "define main(a: i32, b: f64): i32 {\n"
+                    "   let s: i32 = a.b + foo(1, true, 2.5, \"x\");\n"
+                    "   for (let i: i32 = 0; i < 4000000000; i += 1) { s = -s; }\n"
+                    "   if a { return s; } elif b { return 1; } else { return 0; }\n"
+                    "}\n";
+    file->parse();
+
+    viper::FlatView flat = file->ast->flat();
+    viper::Interner& interner = viper::Interner::global();
+    std::string bytes = viper::ASTImage::encode(flat, file->source());
+
+    viper::ASTImage image;
+    bool result = file->parse_errors.empty()
+        && viper::ASTImage::view(bytes, &image)
+        && image.tree().size() == flat.size()
+        && std::ranges::equal(image.tree().roots(), flat.roots())
+        && image.tree().pointer_node(0) == nullptr
+        && image.built_from(file->source())
+        && !image.built_from(file->content + " ");
+
+    // Same nodes and spans, and names spelled the same through the image's string table
+    const viper::FlatView& stored_tree = image.tree();
+    for (viper::node_id id = 0; result && id < flat.size(); id++) {
+        viper::NodeKind kind = flat.kind(id);
+        const viper::token& tok = flat.tok(id);
+        const viper::token& stored = stored_tree.tok(id);
+        bool named = kind == viper::AST_PROCEDURE || kind == viper::AST_PROC_PARAMETER || kind == viper::AST_VARIABLE_DECLARATION;
+        bool number = tok.kind == viper::TK_NUM_INT || tok.kind == viper::TK_NUM_FLOAT;
+        u64 payload = stored_tree.payload(id);
+        result = stored_tree.kind(id) == kind
+            && stored.kind == tok.kind && stored.offset == tok.offset && stored.length == tok.length
+            && (number || image.spelling(stored.payload) == interner.get(tok.payload))
+            && (named ? image.spelling(payload) == interner.get(flat.payload(id)) : payload == flat.payload(id))
+            && std::ranges::equal(stored_tree.children(id), flat.children(id));
+        if (!result) {
+            std::printf("parser_test_ast_image: node %u differs\n", id);
+        }
+    }
+
+    // Any changed byte, a cut short image or another version is turned away
+    for (std::size_t at : { std::size_t(4), std::size_t(20), bytes.size() / 2, bytes.size() - 1 }) {
+        std::string corrupt = bytes;
+        corrupt[at] ^= 0x10;
+        result = result && !viper::ASTImage::view(corrupt, &image);
+    }
+    result = result && !viper::ASTImage::view(std::string_view(bytes).substr(0, bytes.size() - 8), &image);
+
+    // So is an image whose checksum holds but whose ids point past its nodes
+    viper::NodeKind kinds[] = { viper::AST_IDENTIFIER, viper::AST_IDENTIFIER };
+    viper::token tokens[2] {};
+    u64 payloads[2] {};
+    u32 child_begin[] = { 0, 0, 1 };
+    viper::node_id empty_child[] = { viper::NO_NODE };
+    viper::node_id stray_child[] = { 2 };
+    viper::node_id root[] = { 1 };
+    viper::node_id stray_root[] = { 2 };
+    auto crafted = [&](std::span<const viper::node_id> children, std::span<const viper::node_id> roots) {
+        viper::FlatView tree(kinds, tokens, payloads, child_begin, children, roots);
+        std::string crafted_bytes = viper::ASTImage::encode(tree, "");
+        viper::ASTImage crafted_image;
+        return viper::ASTImage::view(crafted_bytes, &crafted_image);
+    };
+    result = result
+        && crafted(empty_child, root)
+        && !crafted(stray_child, root)
+        && !crafted(empty_child, stray_root);
+
+    // Through a file, and still readable after the image is moved
+    char path[] = "/tmp/viper_image_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        delete file;
+        return false;
+    }
+    close(fd);
+    viper::ASTImage mapped;
+    result = result
+        && viper::ASTImage::write(path, flat, file->source())
+        && viper::ASTImage::open(path, &mapped);
+    viper::ASTImage moved = std::move(mapped);
+    result = result
+        && moved.tree().size() == flat.size()
+        && mapped.tree().size() == 0
+        && moved.bytes() == bytes.size()
+        && moved.spelling(moved.tree().payload(flat.roots()[2])) == "main";
+    std::remove(path);
+
+    // Writing leaves nothing but the image next to it
+    std::string directory = "/tmp/viper_image_dir_XXXXXX";
+    result = result && mkdtemp(directory.data()) != nullptr;
+    if (result) {
+        std::string image_path = directory + "/test.ast";
+        result = viper::ASTImage::write(image_path.c_str(), flat, file->source())
+            && viper::ASTImage::write(image_path.c_str(), flat, file->source())
+            && std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator()) == 1
+            && !viper::ASTImage::write((directory + "/missing/test.ast").c_str(), flat, file->source());
+        std::filesystem::remove_all(directory);
+    }
+
+    delete file;
+    return result;
+}
+
+uint8_t parser_test_compile_image() {
+    std::string directory = "/tmp/viper_compile_image_XXXXXX";
+    if (mkdtemp(directory.data()) == nullptr) {
+        return false;
+    }
+    std::string path = directory + "/test.ast";
+    std::string source = "let x: i32 = 1;\n"
+                         "define main(a: i32): i32 { return a + x; }\n";
+
+    // The first compile parses and writes the image
+    viper::VFile first;
+    first.name = "test.viper";
+    first.content = source;
+    first.compile(path.c_str());
+    bool result = first.ast != nullptr && first.image == nullptr && first.parse_errors.empty();
+
+    // The next one of the same source loads it instead of parsing
+    viper::VFile second;
+    second.name = "test.viper";
+    second.content = source;
+    second.compile(path.c_str());
+    viper::FlatView parsed = first.tree();
+    viper::FlatView loaded = second.tree();
+    result = result
+        && second.ast == nullptr && second.image != nullptr
+        && loaded.size() == parsed.size() && loaded.size() != 0
+        && std::ranges::equal(loaded.roots(), parsed.roots())
+        && loaded.kind(loaded.roots()[1]) == viper::AST_PROCEDURE
+        && second.image->spelling(loaded.payload(loaded.roots()[1])) == "main";
+
+    // An edit makes the image stale, so the file is parsed again
+    second.apply_edit({ 4, 1, "y" });
+    result = result && second.image == nullptr && second.tree().size() == 0;
+    second.compile(path.c_str());
+    result = result && second.ast != nullptr && second.image == nullptr;
+
+    std::filesystem::remove_all(directory);
+    return result;
+}
+
 /// @brief Register 
 void parser_register_tests(TestManager &manager) {
     manager.register_test(parser_test_basic, "Test simple parser behavior");
@@ -424,4 +1392,18 @@ void parser_register_tests(TestManager &manager) {
     manager.register_test(parser_test_grouping_expression, "Test basic grouping expression parsing");
     manager.register_test(parser_test_identifier_dimension_expression, "Test basic identifier dimension access expression parsing");
     manager.register_test(parser_test_member_access_expression, "Test member access expression parsing");
+    manager.register_test(parser_test_flat_ast, "Test the flat tree matches the pointer tree");
+    manager.register_test(parser_test_ast_image, "Test a binary tree image reads back the same tree and rejects corruption");
+    manager.register_test(parser_test_compile_image, "Test compiling loads the tree image of an unchanged file instead of parsing");
+    manager.register_test(parser_test_operator_precedence, "Test operator precedence and associativity");
+    manager.register_test(parser_test_deep_nesting, "Test parsing code nested 100000 levels deep");
+    manager.register_test(parser_test_node_kinds, "Test node kinds, kind checks and casts");
+    manager.register_test(parser_test_error_recovery, "Test recovering from syntax errors");
+    manager.register_test(parser_test_parallel, "Test parsing declarations on several threads builds the same tree as serial parsing");
+    manager.register_test(parser_test_skim, "Test skimmed procedure bodies are parsed on first use into the same tree");
+    manager.register_test(parser_test_skim_kept_tree, "Test a skimmed tree kept across a reparse parses its bodies into itself");
+    manager.register_test(parser_test_incremental, "Test reparsing after edits builds the same tree as parsing again");
+    manager.register_test(parser_test_incremental_lazy_shift, "Test nodes after an edit are moved when the tree is read");
+    manager.register_test(parser_test_incremental_random_edits, "Test random edits reparse to the tokens and tree of a whole parse");
+    manager.register_test(parser_test_pipelined, "Test pipelined parsing builds the same tree as serial parsing");
 }
@@ -32,12 +32,12 @@ void TestManager::run_tests() {
         auto test_finish = std::chrono::high_resolution_clock::now();
         auto test_duration = std::chrono::duration<double, std::chrono::seconds::period>(test_finish - test_start).count();
         
-        if (result) {
-            std::printf("\x1b[32m[PASSED]: %s\n\x1b[0m", m_tests[i].description.c_str());
-            passed++;
-        } else if (result == BYPASS) {
+        if (result == BYPASS) {
             std::printf("\x1b[36m[SKIPPED]: %s\n\x1b[0m", m_tests[i].description.c_str());
             ++skipped;
+        } else if (result) {
+            std::printf("\x1b[32m[PASSED]: %s\n\x1b[0m", m_tests[i].description.c_str());
+            passed++;
         } else {
             std::printf("\x1b[31m[FAILED]: %s\n\x1b[0m", m_tests[i].description.c_str());
             ++failed;
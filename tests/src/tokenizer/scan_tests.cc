@@ -0,0 +1,189 @@
+#include <tokenizer/scan.h>
+#include <tokenizer/tokenizer.h>
+#include "scan_test.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+static const viper::scan::isa k_all_isas[] = {
+    viper::scan::isa::SCALAR,
+    viper::scan::isa::SSE2,
+    viper::scan::isa::AVX2,
+};
+
+/// @brief Random text drawn from a small alphabet so runs of every class are common
+static std::string random_text(std::mt19937& rng, std::size_t length) {
+    static const char alphabet[] = "  \t\n\n\r abcXYZ_09 7(;.\"#/";
+    std::uniform_int_distribution<std::size_t> pick(0, sizeof(alphabet) - 2);
+    std::uniform_int_distribution<std::size_t> run(1, 40);
+
+    std::string out;
+    while (out.size() < length) {
+        out.append(run(rng), alphabet[pick(rng)]);
+    }
+    out.resize(length);
+    return out;
+}
+
+// Every kernel must agree with the scalar kernel at every starting position
+uint8_t scan_test_kernels_match_scalar() {
+    viper::scan::isa original = viper::scan::active_isa();
+    std::mt19937 rng(1234);
+    bool result = true;
+
+    for (int round = 0; round < 20 && result; round++) {
+        std::string text = random_text(rng, 1 + rng() % 300);
+
+        for (viper::scan::isa set : k_all_isas) {
+            if (!viper::scan::is_supported(set)) {
+                continue;
+            }
+
+            for (std::size_t pos = 0; pos <= text.size(); pos++) {
+                viper::scan::set_isa(viper::scan::isa::SCALAR);
+                u64 expected_ws = viper::scan::skip_whitespace(text.data(), text.size(), pos);
+                u64 expected_ident = viper::scan::skip_identifier(text.data(), text.size(), pos);
+                u64 expected_digits = viper::scan::skip_digits(text.data(), text.size(), pos);
+                std::vector<u32> expected_lines;
+                viper::scan::find_newlines(text.data() + pos, text.size() - pos, pos, &expected_lines);
+
+                viper::scan::set_isa(set);
+                u64 ws = viper::scan::skip_whitespace(text.data(), text.size(), pos);
+                u64 ident = viper::scan::skip_identifier(text.data(), text.size(), pos);
+                u64 digits = viper::scan::skip_digits(text.data(), text.size(), pos);
+                std::vector<u32> lines;
+                viper::scan::find_newlines(text.data() + pos, text.size() - pos, pos, &lines);
+
+                if (ws != expected_ws
+                    || ident != expected_ident || digits != expected_digits
+                    || lines != expected_lines) {
+                    std::printf("scan_test_kernels_match_scalar: %s differs at position %zu\n",
+                        viper::scan::isa_name(set), pos);
+                    result = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    viper::scan::set_isa(original);
+    return result;
+}
+
+// "\r\n", '\r' and '\n' each end one line, including a "\r\n" split across blocks
+uint8_t scan_test_line_endings() {
+    viper::scan::isa original = viper::scan::active_isa();
+    std::string text;
+    std::vector<u32> expected;
+    for (int i = 0; i < 100; i++) {
+        std::string line(1 + i % 37, 'a');
+        const char* ending = i % 3 == 0 ? "\r\n" : i % 3 == 1 ? "\r" : "\n";
+        text += line + ending;
+        expected.push_back(static_cast<u32>(text.size()));
+    }
+    for (const char* ending : { "\r", "\r\n", "\n", "\r" }) {
+        text += ending;
+        expected.push_back(static_cast<u32>(text.size()));
+    }
+
+    bool result = true;
+    for (viper::scan::isa set : k_all_isas) {
+        if (!viper::scan::set_isa(set)) {
+            continue;
+        }
+
+        std::vector<u32> lines;
+        viper::scan::find_newlines(text.data(), text.size(), 0, &lines);
+        if (lines != expected) {
+            std::printf("scan_test_line_endings: %s found %zu line starts, expected %zu\n",
+                viper::scan::isa_name(set), lines.size(), expected.size());
+            result = false;
+        }
+    }
+
+    viper::scan::set_isa(original);
+    return result;
+}
+
+// Long whitespace runs are skipped whole, and every newline in them starts a line
+uint8_t scan_test_newline_count() {
+    viper::scan::isa original = viper::scan::active_isa();
+    std::string text(1000, ' ');
+    for (std::size_t i = 0; i < text.size(); i += 7) {
+        text[i] = '\n';
+    }
+    text += "x";
+
+    for (viper::scan::isa set : k_all_isas) {
+        if (!viper::scan::set_isa(set)) {
+            continue;
+        }
+
+        std::vector<u32> lines;
+        u64 end = viper::scan::skip_whitespace(text.data(), text.size(), 0);
+        viper::scan::find_newlines(text.data(), text.size(), 0, &lines);
+        if (end != 1000 || lines.size() != 143 || lines.front() != 1 || lines.back() != 995) {
+            std::printf("scan_test_newline_count: %s ended at %lu with %zu newlines\n",
+                viper::scan::isa_name(set), end, lines.size());
+            viper::scan::set_isa(original);
+            return false;
+        }
+    }
+
+    viper::scan::set_isa(original);
+    return true;
+}
+
+// The tokenizer must produce the same tokens whichever kernels it uses
+uint8_t scan_test_tokenizer_streams_match() {
+    viper::scan::isa original = viper::scan::active_isa();
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content =
+        "define   a_very_long_procedure_name_for_simd(parameter_number_one: i32):   i64 {\n"
+        "\t\tlet   x: u32 = 1234567890123456789 + 3.14159265358979;\n\n\n"
+        "        return x_1_2_3_4_5_6_7_8_9_0_a_b_c_d_e_f_g_h_i_j_k_l_m_n_o_p_q_r;\n"
+        "}\n";
+
+    std::vector<viper::token> expected;
+    bool result = true;
+    for (viper::scan::isa set : k_all_isas) {
+        if (!viper::scan::set_isa(set)) {
+            continue;
+        }
+
+        std::vector<viper::token> tokens = viper::Tokenizer::create_new(file).tokenize_file();
+        if (expected.empty()) {
+            expected = tokens;
+            continue;
+        }
+
+        if (tokens.size() != expected.size()) {
+            result = false;
+            break;
+        }
+        for (std::size_t i = 0; i < tokens.size(); i++) {
+            if (tokens[i].kind != expected[i].kind
+                || tokens[i].offset != expected[i].offset
+                || tokens[i].length != expected[i].length) {
+                std::printf("scan_test_tokenizer_streams_match: %s differs at token %zu\n",
+                    viper::scan::isa_name(set), i);
+                result = false;
+                break;
+            }
+        }
+    }
+
+    viper::scan::set_isa(original);
+    delete file;
+    return result;
+}
+
+void scan_register_tests(TestManager& manager) {
+    manager.register_test(scan_test_kernels_match_scalar, "test simd scanning kernels agree with the scalar kernels");
+    manager.register_test(scan_test_line_endings, "test CRLF, CR and LF each end one line for every kernel");
+    manager.register_test(scan_test_newline_count, "test simd whitespace skipping and newline finding");
+    manager.register_test(scan_test_tokenizer_streams_match, "test tokenizer output is the same for every kernel");
+}
@@ -1,6 +1,16 @@
 #include <tokenizer/tokenizer.h>
+#include <tokenizer/keywords.h>
+#include <tokenizer/lexer_table.h>
 #include "tokenizer_test.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <list>
+#include <string>
+#include <unistd.h>
 
 // Test the tokenizer
 uint8_t lexer_test_proc_with_comments() {
@@ -16,14 +26,12 @@ uint8_t lexer_test_proc_with_comments() {
         viper::token_kind::TK_LPAREN,
         viper::token_kind::TK_RPAREN,
         viper::token_kind::TK_COLON,
-        // viper::token_kind::TK_TYPESPEC_I32,
-        viper::token_kind::TK_IDENT,
+        viper::token_kind::TK_TYPESPEC_I32,
         viper::token_kind::TK_LSQUIRLY,
         viper::token_kind::TK_LET,
         viper::token_kind::TK_IDENT,
         viper::token_kind::TK_COLON,
-        // viper::token_kind::TK_TYPESPEC_U32,
-        viper::token_kind::TK_IDENT,
+        viper::token_kind::TK_TYPESPEC_U32,
         viper::token_kind::TK_ASSIGN,
         viper::token_kind::TK_NUM_INT,
         viper::token_kind::TK_SEMICOLON,
@@ -69,14 +77,12 @@ uint8_t lexer_test_main_proc() {
         viper::token_kind::TK_LPAREN,
         viper::token_kind::TK_RPAREN,
         viper::token_kind::TK_COLON,
-        // viper::token_kind::TK_TYPESPEC_I32,
-        viper::token_kind::TK_IDENT,
+        viper::token_kind::TK_TYPESPEC_I32,
         viper::token_kind::TK_LSQUIRLY,
         viper::token_kind::TK_LET,
         viper::token_kind::TK_IDENT,
         viper::token_kind::TK_COLON,
-        // viper::token_kind::TK_TYPESPEC_U32,
-        viper::token_kind::TK_IDENT,
+        viper::token_kind::TK_TYPESPEC_U32,
         viper::token_kind::TK_ASSIGN,
         viper::token_kind::TK_NUM_INT,
         viper::token_kind::TK_SEMICOLON,
@@ -122,15 +128,13 @@ uint8_t lexer_test_string_literals() {
         viper::token_kind::TK_LPAREN,
         viper::token_kind::TK_RPAREN,
         viper::token_kind::TK_COLON,
-        // viper::token_kind::TK_TYPESPEC_I32,
-        viper::token_kind::TK_IDENT,
+        viper::token_kind::TK_TYPESPEC_I32,
         viper::token_kind::TK_LSQUIRLY,
 
         viper::token_kind::TK_LET,
         viper::token_kind::TK_IDENT,
         viper::token_kind::TK_COLON,
-        // viper::token_kind::TK_TYPESPEC_U8,
-        viper::token_kind::TK_IDENT,
+        viper::token_kind::TK_TYPESPEC_U8,
         viper::token_kind::TK_ASSIGN,
         viper::token_kind::TK_STR,
         viper::token_kind::TK_SEMICOLON,
@@ -161,7 +165,7 @@ uint8_t lexer_test_string_literals() {
             return result;
         }
 
-        if (tok.kind == viper::TK_STR && tok.name != "test string content") {
+        if (tok.kind == viper::TK_STR && tok.text(file) != "test string content") {
             return false;
         }
     }
@@ -169,9 +173,592 @@ uint8_t lexer_test_string_literals() {
     return result;
 }
 
+// Every keyword is found and words close to a keyword are identifiers
+uint8_t lexer_test_keyword_lookup() {
+    for (const viper::keyword& kw : viper::KEYWORDS) {
+        if (viper::lookup_keyword(kw.spelling) != kw.kind) {
+            std::printf("lexer_test_keyword_lookup: keyword '%.*s' was not found\n",
+                    (int)kw.spelling.size(), kw.spelling.data());
+            return false;
+        }
+
+        // Same first, second and last character and length, but a different word
+        std::string near(kw.spelling);
+        if (near.size() > 2) {
+            near[near.size() / 2] = '_';
+            if (viper::lookup_keyword(near) != viper::TK_IDENT) {
+                std::printf("lexer_test_keyword_lookup: '%s' is not a keyword\n", near.c_str());
+                return false;
+            }
+        }
+    }
+
+    const char* identifiers[] = { "x", "lets", "i", "i128", "definer", "Let", "u8x", "#exports", "boolean" };
+    for (const char* ident : identifiers) {
+        if (viper::lookup_keyword(ident) != viper::TK_IDENT) {
+            std::printf("lexer_test_keyword_lookup: '%s' is not a keyword\n", ident);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Every operator is matched whole and both lexer modes agree on every token
+uint8_t lexer_test_table_operators() {
+    std::string input =
+        "a <<= b >>= c << d >> e <= f >= g < h > i\n"
+        "x && y || z & w | v ^ u ~ t ! s\n"
+        "p += 1; p -= 2; p *= 3; p /= 4; p %= 5; p &= 6; p |= 7; p ^= 8; p ~= 9;\n"
+        "m::n : o == q != r = s . t , u / v * w % x - y + z\n"
+        "// comment\n"
+        "call(arr[0], {1}) /* block */ \"str\" 1.5 @";
+
+    std::vector<viper::token_kind> expected = {
+        viper::TK_IDENT, viper::TK_LSHIFTEQ, viper::TK_IDENT, viper::TK_RSHIFTEQ, viper::TK_IDENT,
+        viper::TK_LSHIFT, viper::TK_IDENT, viper::TK_RSHIFT, viper::TK_IDENT, viper::TK_LTEQ,
+        viper::TK_IDENT, viper::TK_GTEQ, viper::TK_IDENT, viper::TK_LT, viper::TK_IDENT,
+        viper::TK_GT, viper::TK_IDENT,
+
+        viper::TK_IDENT, viper::TK_LOG_AND, viper::TK_IDENT, viper::TK_LOG_OR, viper::TK_IDENT,
+        viper::TK_AMPERSAND, viper::TK_IDENT, viper::TK_PIPE, viper::TK_IDENT, viper::TK_CARET,
+        viper::TK_IDENT, viper::TK_TILDE, viper::TK_IDENT, viper::TK_BANG, viper::TK_IDENT,
+
+        viper::TK_IDENT, viper::TK_PLUSEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_MINUSEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_TIMESEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_DIVEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_MODEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_ANDEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_OREQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_XOREQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+        viper::TK_IDENT, viper::TK_NEGATEEQ, viper::TK_NUM_INT, viper::TK_SEMICOLON,
+
+        viper::TK_IDENT, viper::TK_DOUBLECOLON, viper::TK_IDENT, viper::TK_COLON, viper::TK_IDENT,
+        viper::TK_EQUALTO, viper::TK_IDENT, viper::TK_NEQUALTO, viper::TK_IDENT, viper::TK_ASSIGN,
+        viper::TK_IDENT, viper::TK_DOT, viper::TK_IDENT, viper::TK_COMMA, viper::TK_IDENT,
+        viper::TK_SLASH, viper::TK_IDENT, viper::TK_ASTERISK, viper::TK_IDENT, viper::TK_MOD,
+        viper::TK_IDENT, viper::TK_MINUS, viper::TK_IDENT, viper::TK_PLUS, viper::TK_IDENT,
+
+        viper::TK_IDENT, viper::TK_LPAREN, viper::TK_IDENT, viper::TK_LBRACKET, viper::TK_NUM_INT,
+        viper::TK_RBRACKET, viper::TK_COMMA, viper::TK_LSQUIRLY, viper::TK_NUM_INT, viper::TK_RSQUIRLY,
+        viper::TK_RPAREN, viper::TK_STR, viper::TK_NUM_FLOAT, viper::TK_ILLEGAL,
+        viper::TK_EOF
+    };
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = input;
+
+    std::vector<viper::token> table = viper::Tokenizer::create_new(file, viper::lexer_mode::TABLE).tokenize_file();
+    std::vector<viper::token> switched = viper::Tokenizer::create_new(file, viper::lexer_mode::SWITCH).tokenize_file();
+
+    bool result = table.size() == expected.size() && switched.size() == expected.size();
+    for (std::size_t i = 0; result && i < expected.size(); i++) {
+        if (table[i].kind != expected[i]) {
+            std::printf("lexer_test_table_operators: expected '%s' and got '%s' at token %zu\n",
+                    viper::token::kind_to_str(expected[i]).c_str(),
+                    viper::token::kind_to_str(table[i].kind).c_str(), i);
+            result = false;
+        } else if (switched[i].kind != table[i].kind
+                || switched[i].offset != table[i].offset
+                || switched[i].length != table[i].length
+                || switched[i].payload != table[i].payload) {
+            std::printf("lexer_test_table_operators: lexer modes differ at token %zu\n", i);
+            result = false;
+        }
+    }
+
+    if (result && table[1].text(file) != "<<=") {
+        result = false;
+    }
+
+    delete file;
+    return result;
+}
+
+// A streaming tokenizer returns the same tokens while only holding a window of lookahead
+uint8_t lexer_test_streaming_window() {
+    std::string input = "define main(): i32 {\n"
+        "   let x: u32 = 1 << 2;\n"
+        "   // comment\n"
+        "   return x + \"str\" * 3.5;\n"
+        "}\n";
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = input;
+
+    std::vector<viper::token> expected = viper::Tokenizer::create_new(file).tokenize_file();
+    viper::Tokenizer streaming = viper::Tokenizer::create_streaming(file);
+
+    bool result = true;
+    for (std::size_t i = 0; result && i < expected.size(); i++) {
+        // Look ahead by a different distance every token, past the end of the file too
+        u32 ahead = i % viper::Tokenizer::TOKEN_WINDOW;
+        std::size_t ahead_index = i + ahead < expected.size() ? i + ahead : expected.size() - 1;
+        viper::token peeked = streaming.peek_token(ahead);
+        viper::token tok = streaming.next_token();
+
+        if (peeked.kind != expected[ahead_index].kind || peeked.offset != expected[ahead_index].offset) {
+            std::printf("lexer_test_streaming_window: peek %u ahead of token %zu is wrong\n", ahead, i);
+            result = false;
+        } else if (tok.kind != expected[i].kind
+                || tok.offset != expected[i].offset) {
+            std::printf("lexer_test_streaming_window: expected '%s' and got '%s' at token %zu\n",
+                    viper::token::kind_to_str(expected[i].kind).c_str(),
+                    viper::token::kind_to_str(tok.kind).c_str(), i);
+            result = false;
+        }
+    }
+
+    // tokenize_file still collects every token in streaming mode
+    if (result && viper::Tokenizer::create_streaming(file).tokenize_file().size() != expected.size()) {
+        std::printf("lexer_test_streaming_window: tokenize_file lost tokens in streaming mode\n");
+        result = false;
+    }
+
+    delete file;
+    return result;
+}
+
+/// @brief Resident memory of the process in bytes, from VmRSS. 0 if it cannot be read
+static u64 resident_bytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+// Streaming a mapped file keeps no more of it resident than two release chunks,
+// whatever the size of the file or its line endings. Small chunks make a small
+// file show it
+uint8_t lexer_test_streaming_memory() {
+    constexpr u64 CHUNK = 256 * 1024;
+    constexpr u64 FILE_SIZE = 8 * 1024 * 1024;
+    constexpr u64 SLACK = 1024 * 1024; // Code paged in on first use, allocator noise
+
+    bool result = true;
+    for (const char* ending : { "\n", "\r\n" }) {
+        char path[] = "/tmp/viper_stream_test_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            return false;
+        }
+        close(fd);
+        {
+            std::string line = "define f(a: i32): i32 { let long_identifier_name: i32 = a * 12345 + 0x7f; return a; } // note";
+            line += ending;
+            std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+            for (u64 written = 0; written < FILE_SIZE; written += line.size()) {
+                out << line;
+            }
+        }
+
+        {
+            viper::VFile file = viper::VFile::from(path, nullptr);
+            result = result && file.mapping.data != nullptr;
+
+            u64 before = resident_bytes();
+            u64 peak = before;
+            u64 next_sample = 0;
+            viper::Tokenizer lexer = viper::Tokenizer::create_streaming(&file, viper::lexer_mode::TABLE, CHUNK);
+            for (viper::token tok = lexer.next_token(); result && tok.kind != viper::TK_EOF; tok = lexer.next_token()) {
+                if (tok.offset >= next_sample) {
+                    u64 now = resident_bytes();
+                    peak = now > peak ? now : peak;
+                    next_sample += CHUNK / 4;
+                }
+            }
+
+            if (before == 0) {
+                std::printf("lexer_test_streaming_memory: no /proc/self/status, memory not checked\n");
+            } else if (peak - before > 2 * CHUNK + SLACK) {
+                std::printf("lexer_test_streaming_memory: resident memory grew by %llu KB streaming a %llu KB file\n",
+                    (unsigned long long)((peak - before) >> 10), (unsigned long long)(FILE_SIZE >> 10));
+                result = false;
+            }
+        }
+
+        std::remove(path);
+    }
+    return result;
+}
+
+// Batches of tokens line up with the tokens next_token hands out one at a time,
+// start with whatever the lookahead window holds and end at TK_EOF
+uint8_t lexer_test_token_batches() {
+    std::string input;
+    for (int i = 0; i < 200; i++) {
+        input += "let batch_" + std::to_string(i) + ": i32 = (1 + 2) * 0x" + std::to_string(i) + ";\n";
+    }
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = input;
+
+    std::vector<viper::token> expected = viper::Tokenizer::create_new(file).tokenize_file();
+    viper::Tokenizer streaming = viper::Tokenizer::create_streaming(file);
+    streaming.peek_token(3);
+
+    bool result = true;
+    std::vector<viper::token> batched;
+    std::array<viper::token, viper::Tokenizer::TOKEN_BATCH> batch;
+    for (u32 round = 0; batched.empty() || batched.back().kind != viper::TK_EOF; round++) {
+        // Odd sizes so batches end inside the window and at every distance from the end
+        u32 capacity = 1 + (round * 37) % viper::Tokenizer::TOKEN_BATCH;
+        u32 count = streaming.next_tokens(batch.data(), capacity);
+        if (count == 0 || count > capacity) {
+            std::printf("lexer_test_token_batches: got %u tokens asking for %u\n", count, capacity);
+            result = false;
+            break;
+        }
+        batched.insert(batched.end(), batch.begin(), batch.begin() + count);
+    }
+
+    if (result && batched.size() != expected.size()) {
+        std::printf("lexer_test_token_batches: expected %zu tokens and got %zu\n", expected.size(), batched.size());
+        result = false;
+    }
+    for (std::size_t i = 0; result && i < expected.size(); i++) {
+        if (batched[i].kind != expected[i].kind || batched[i].offset != expected[i].offset) {
+            std::printf("lexer_test_token_batches: expected '%s' and got '%s' at token %zu\n",
+                    viper::token::kind_to_str(expected[i].kind).c_str(),
+                    viper::token::kind_to_str(batched[i].kind).c_str(), i);
+            result = false;
+        }
+    }
+
+    delete file;
+    return result;
+}
+
+// Lexing on several threads gives the same tokens as lexing serially, even when
+// strings and comments hold newlines close to where the file is split
+uint8_t lexer_test_parallel_matches_serial() {
+    // Words unique to this test so their symbols are handed out here
+    std::string input;
+    for (int i = 0; i < 400; i++) {
+        std::string n = std::to_string(i);
+        input += "let parallel_test_" + n + ": i32 = " + n + " << 2;\n";
+        input += "let f: f64 = " + n + ".25 * 4_294_967_296;\n";
+        input += "let s: str = \"line one\n line two // not a comment\n\";\n";
+        input += "// a comment with a \" quote\n";
+        input += "/* a block comment\n /* nested \" quote\n */ still a comment\n */\n";
+        input += "define parallel_test_proc_" + n + "(): i32 { return parallel_test_" + n + "; }\n";
+    }
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = input;
+
+    // Parallel first, so the symbols of the new words are assigned by the parallel lexer
+    u64 first_symbol = viper::Interner::global().symbol_count();
+    viper::Tokenizer parallel_lexer = viper::Tokenizer::create_new(file);
+    std::vector<viper::token> parallel = parallel_lexer.tokenize_file_parallel(7, 64);
+    std::vector<viper::token> serial = viper::Tokenizer::create_new(file).tokenize_file();
+
+    // Both keep what they return
+    bool result = parallel.size() == serial.size()
+        && parallel_lexer.get_tokens().size() == parallel.size()
+        && std::memcmp(parallel_lexer.get_tokens().data(), parallel.data(), parallel.size() * sizeof(viper::token)) == 0;
+    for (std::size_t i = 0; result && i < serial.size(); i++) {
+        if (std::memcmp(&parallel[i], &serial[i], sizeof(viper::token)) != 0) {
+            std::printf("lexer_test_parallel_matches_serial: token %zu differs ('%s' and '%s')\n", i,
+                    viper::token::kind_to_str(parallel[i].kind).c_str(),
+                    viper::token::kind_to_str(serial[i].kind).c_str());
+            result = false;
+        }
+    }
+
+    // New words get symbols in the order they first appear in the file
+    u64 next_symbol = first_symbol;
+    for (std::size_t i = 0; result && i < parallel.size(); i++) {
+        bool is_number = parallel[i].kind == viper::TK_NUM_INT || parallel[i].kind == viper::TK_NUM_FLOAT;
+        if (!is_number && parallel[i].payload >= next_symbol) {
+            if (parallel[i].payload != next_symbol) {
+                std::printf("lexer_test_parallel_matches_serial: symbols are out of order at token %zu\n", i);
+                result = false;
+            }
+            next_symbol++;
+        }
+    }
+
+    delete file;
+    return result;
+}
+
+// Comments and strings are skipped in one pass, nest, and keep lines counted
+uint8_t lexer_test_comments_and_strings() {
+    std::string input =
+        "let a: i32 = 1; /* one\n"
+        "   /* nested\n */ // still inside\n"
+        "   */ let b: str = \"two\n"
+        "lines\";\n"
+        "/*/ opener then slash */ let c: i32 = 3; //*\n"
+        "let d: i32 = 4; // no newline at the end";
+
+    struct expected_token {
+        viper::token_kind kind;
+        u32 line;
+        std::string_view text;
+    };
+    std::vector<expected_token> expected = {
+        {viper::TK_LET, 1, "let"}, {viper::TK_IDENT, 1, "a"}, {viper::TK_COLON, 1, ":"},
+        {viper::TK_TYPESPEC_I32, 1, "i32"}, {viper::TK_ASSIGN, 1, "="}, {viper::TK_NUM_INT, 1, "1"},
+        {viper::TK_SEMICOLON, 1, ";"},
+        {viper::TK_LET, 4, "let"}, {viper::TK_IDENT, 4, "b"}, {viper::TK_COLON, 4, ":"},
+        {viper::TK_IDENT, 4, "str"}, {viper::TK_ASSIGN, 4, "="}, {viper::TK_STR, 4, "two\nlines"},
+        {viper::TK_SEMICOLON, 5, ";"},
+        {viper::TK_LET, 6, "let"}, {viper::TK_IDENT, 6, "c"}, {viper::TK_COLON, 6, ":"},
+        {viper::TK_TYPESPEC_I32, 6, "i32"}, {viper::TK_ASSIGN, 6, "="}, {viper::TK_NUM_INT, 6, "3"},
+        {viper::TK_SEMICOLON, 6, ";"},
+        {viper::TK_LET, 7, "let"}, {viper::TK_IDENT, 7, "d"}, {viper::TK_COLON, 7, ":"},
+        {viper::TK_TYPESPEC_I32, 7, "i32"}, {viper::TK_ASSIGN, 7, "="}, {viper::TK_NUM_INT, 7, "4"},
+        {viper::TK_SEMICOLON, 7, ";"},
+        {viper::TK_EOF, 7, ""},
+    };
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = input;
+
+    bool result = true;
+    for (viper::lexer_mode mode : { viper::lexer_mode::TABLE, viper::lexer_mode::SWITCH }) {
+        std::vector<viper::token> tokens = viper::Tokenizer::create_new(file, mode).tokenize_file();
+        if (tokens.size() != expected.size()) {
+            std::printf("lexer_test_comments_and_strings: expected %zu tokens and got %zu\n",
+                    expected.size(), tokens.size());
+            result = false;
+            break;
+        }
+
+        for (std::size_t i = 0; i < expected.size(); i++) {
+            if (tokens[i].kind != expected[i].kind
+                || tokens[i].location(file).line != static_cast<i32>(expected[i].line)
+                || tokens[i].text(file) != expected[i].text) {
+                std::printf("lexer_test_comments_and_strings: token %zu is '%s' on line %d\n", i,
+                        viper::token::kind_to_str(tokens[i].kind).c_str(), tokens[i].location(file).line);
+                result = false;
+                break;
+            }
+        }
+    }
+
+    // Unterminated literals and comments end at the end of the input
+    struct unterminated_case {
+        const char* source;
+        std::vector<viper::token_kind> kinds;
+    };
+    std::vector<unterminated_case> unterminated = {
+        {"s = \"never closed", {viper::TK_IDENT, viper::TK_ASSIGN, viper::TK_ILLEGAL, viper::TK_EOF}},
+        {"x /* never /* closed */", {viper::TK_IDENT, viper::TK_EOF}},
+        {"\"", {viper::TK_ILLEGAL, viper::TK_EOF}},
+    };
+    for (const unterminated_case& test : unterminated) {
+        file->content = test.source;
+        std::vector<viper::token> tokens = viper::Tokenizer::create_new(file).tokenize_file();
+
+        bool same = tokens.size() == test.kinds.size();
+        for (std::size_t i = 0; same && i < tokens.size(); i++) {
+            same = tokens[i].kind == test.kinds[i];
+        }
+        if (!same) {
+            std::printf("lexer_test_comments_and_strings: '%s' did not end the input cleanly\n", test.source);
+            result = false;
+        }
+    }
+
+    delete file;
+    return result;
+}
+
 /// @brief Register 
+// Number literals are decoded by the tokenizer, whatever their base and separators
+uint8_t lexer_test_number_literals() {
+    struct number_case {
+        const char* text;
+        viper::token_kind kind;
+        u64 value;    // Expected value of an integer literal
+        f64 fvalue;   // Expected value of a float literal
+    };
+    const number_case cases[] = {
+        {"0",                      viper::TK_NUM_INT,   0, 0},
+        {"1234567890",             viper::TK_NUM_INT,   1234567890, 0},
+        {"1_000_000",              viper::TK_NUM_INT,   1000000, 0},
+        {"0xFF_ff",                viper::TK_NUM_INT,   0xFFFF, 0},
+        {"0b1010_0101",            viper::TK_NUM_INT,   0xA5, 0},
+        {"0o777",                  viper::TK_NUM_INT,   0777, 0},
+        {"2147483648",             viper::TK_NUM_INT,   2147483648u, 0},
+        {"18446744073709551615",   viper::TK_NUM_INT,   18446744073709551615u, 0},
+        {"0xFFFFFFFFFFFFFFFF",     viper::TK_NUM_INT,   0xFFFFFFFFFFFFFFFFu, 0},
+        {"3.25",                   viper::TK_NUM_FLOAT, 0, 3.25},
+        {"1_000.5",                viper::TK_NUM_FLOAT, 0, 1000.5},
+        {"7.",                     viper::TK_NUM_FLOAT, 0, 7.0},
+        {"18446744073709551616",   viper::TK_ILLEGAL,   0, 0},
+        {"0x1_0000_0000_0000_0000", viper::TK_ILLEGAL,  0, 0},
+        {"0b102",                  viper::TK_ILLEGAL,   0, 0},
+        {"0o8",                    viper::TK_ILLEGAL,   0, 0},
+        {"0x",                     viper::TK_ILLEGAL,   0, 0},
+        {"1__0",                   viper::TK_ILLEGAL,   0, 0},
+        {"10_",                    viper::TK_ILLEGAL,   0, 0},
+        {"12ab",                   viper::TK_ILLEGAL,   0, 0},
+        {"1.2.3",                  viper::TK_ILLEGAL,   0, 0},
+        {"0x1.5",                  viper::TK_ILLEGAL,   0, 0},
+    };
+
+    bool result = true;
+    for (viper::lexer_mode mode : {viper::lexer_mode::TABLE, viper::lexer_mode::SWITCH}) {
+        for (const number_case& c : cases) {
+            viper::VFile* file = viper::VFile::create_new_ptr();
+            file->name = "test.viper";
+            file->content = std::string(c.text) + ";";
+
+            viper::Tokenizer tokenizer = viper::Tokenizer::create_new(file, mode);
+            viper::token tok = tokenizer.next_token();
+            viper::token next = tokenizer.next_token();
+
+            bool ok = tok.kind == c.kind && tok.length == std::strlen(c.text) && next.kind == viper::TK_SEMICOLON;
+            if (ok && c.kind == viper::TK_NUM_INT) {
+                ok = tokenizer.integer_value(tok) == c.value;
+            } else if (ok && c.kind == viper::TK_NUM_FLOAT) {
+                ok = tokenizer.float_value(tok) == c.fvalue;
+            }
+            if (!ok) {
+                std::printf("lexer_test_number_literals: '%s' lexed as '%s'\n",
+                        c.text, viper::token::kind_to_str(tok.kind).c_str());
+                result = false;
+            }
+            delete file;
+        }
+    }
+
+    return result;
+}
+
+// The literal pool of a streaming tokenizer is a ring that stays the same size
+// however many numbers are lexed, and values are right while a parser could
+// still hold their tokens. Relexing edits does not grow the pool of a tokenizer
+// that keeps its tokens either
+uint8_t lexer_test_literal_pool() {
+    constexpr u32 NUMBERS = 20000;
+    std::string input;
+    for (u32 i = 0; i < NUMBERS; i++) {
+        input += std::to_string(i) + ".25 ";
+    }
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "test.viper";
+    file->content = input;
+
+    bool result = true;
+    viper::Tokenizer streaming = viper::Tokenizer::create_streaming(file);
+    std::array<viper::token, viper::Tokenizer::TOKEN_BATCH> batch;
+    u32 seen = 0;
+    for (bool done = false; result && !done;) {
+        u32 count = streaming.next_tokens(batch.data(), batch.size());
+        done = count == 0 || batch[count - 1].kind == viper::TK_EOF;
+        // Values are read once the whole batch and the window after it are lexed
+        streaming.peek_token(viper::Tokenizer::TOKEN_WINDOW - 1);
+        for (u32 i = 0; result && i < count && batch[i].kind == viper::TK_NUM_FLOAT; i++, seen++) {
+            if (streaming.float_value(batch[i]) != seen + 0.25) {
+                std::printf("lexer_test_literal_pool: number %u read as %f\n", seen, streaming.float_value(batch[i]));
+                result = false;
+            }
+        }
+    }
+    if (result && seen != NUMBERS) {
+        std::printf("lexer_test_literal_pool: streamed %u of %u numbers\n", seen, NUMBERS);
+        result = false;
+    }
+    if (streaming.memory_used() > viper::Tokenizer::LITERAL_RING * sizeof(u64)) {
+        std::printf("lexer_test_literal_pool: streaming pool holds %llu bytes\n", (unsigned long long)streaming.memory_used());
+        result = false;
+    }
+
+    // Replace one number over and over
+    file->content = "let x: f64 = 1.5;\nlet y: u64 = 4294967296;\n";
+    viper::Tokenizer lexer = viper::Tokenizer::create_new(file);
+    lexer.tokenize_file();
+    u64 start = lexer.memory_used();
+    u32 at = static_cast<u32>(file->content.find("1.5"));
+    std::string previous = "1.5";
+    for (u32 i = 0; result && i < 5000; i++) {
+        std::string next = std::to_string(i) + ".5";
+        viper::text_edit edit { at, static_cast<u32>(previous.size()), next };
+        file->apply_edit(edit);
+        lexer.relex(edit);
+        previous = next;
+
+        const std::vector<viper::token>& tokens = lexer.get_tokens();
+        auto number = std::find_if(tokens.begin(), tokens.end(), [](const viper::token& tok) { return tok.kind == viper::TK_NUM_FLOAT; });
+        auto big = std::find_if(tokens.begin(), tokens.end(), [](const viper::token& tok) { return tok.kind == viper::TK_NUM_INT; });
+        if (number == tokens.end() || lexer.float_value(*number) != i + 0.5
+            || big == tokens.end() || lexer.integer_value(*big) != 4294967296u) {
+            std::printf("lexer_test_literal_pool: wrong numbers after edit %u\n", i);
+            result = false;
+        }
+    }
+    if (lexer.memory_used() > 2 * start + 64) {
+        std::printf("lexer_test_literal_pool: pool grew from %llu to %llu bytes over edits\n",
+            (unsigned long long)start, (unsigned long long)lexer.memory_used());
+        result = false;
+    }
+
+    delete file;
+    return result;
+}
+
+// Errors are printed with their arguments formatted into them
+uint8_t lexer_test_error_text() {
+    char path[] = "/tmp/viper_stderr_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return false;
+    }
+
+    viper::VFile* file = viper::VFile::create_new_ptr();
+    file->name = "errors.viper";
+    file->content = "let a: i32 = 0x;\n";
+
+    std::fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO);
+    viper::Tokenizer::create_new(file).tokenize_file();
+    std::fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    close(fd);
+
+    std::ifstream in(path);
+    std::string printed((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::remove(path);
+    delete file;
+
+    if (printed.find("Invalid number literal '0x' at 1:14 in file errors.viper") == std::string::npos
+        || printed.find('%') != std::string::npos) {
+        std::printf("lexer_test_error_text: printed '%s'\n", printed.c_str());
+        return false;
+    }
+    return true;
+}
+
 void tokenizer_register_tests(TestManager &manager) {
     manager.register_test(lexer_test_string_literals, "test tokenizing basic string literal");
     manager.register_test(lexer_test_proc_with_comments, "test input with comment inside to see if it is properly skipped");
     manager.register_test(lexer_test_main_proc, "tokenize basic main procedure");
+    manager.register_test(lexer_test_keyword_lookup, "test compile time keyword table lookups");
+    manager.register_test(lexer_test_streaming_window, "test streaming tokenizer with a ring buffer of lookahead");
+    manager.register_test(lexer_test_streaming_memory, "test streaming a mapped file keeps a bounded amount of it resident");
+    manager.register_test(lexer_test_token_batches, "test batches of tokens match tokens handed out one at a time");
+    manager.register_test(lexer_test_parallel_matches_serial, "test parallel tokenizing matches serial tokenizing");
+    manager.register_test(lexer_test_comments_and_strings, "test nested block comments, multi line strings and line counts");
+    manager.register_test(lexer_test_number_literals, "test number literals are decoded with prefixes, separators and overflow checks");
+    manager.register_test(lexer_test_literal_pool, "test the literal pool stays bounded when streaming and relexing");
+    manager.register_test(lexer_test_error_text, "test lexer errors are printed with their arguments formatted");
+    manager.register_test(lexer_test_table_operators, "test table driven lexer matches operators like the switch lexer");
 }
@@ -0,0 +1,81 @@
+#include "arena.h"
+
+namespace viper {
+
+Arena::~Arena() {
+    release();
+}
+
+
+/// @brief Get size bytes aligned to align, starting a new block when the current one is full.
+///        Anything larger than a block gets a block of its own
+void* Arena::allocate(u64 size, u64 align) {
+    u64 padding = (align - reinterpret_cast<uintptr_t>(m_cursor) % align) % align;
+    if (size + padding > m_remaining) {
+        u64 block_size = size + align > BLOCK_SIZE ? size + align : BLOCK_SIZE;
+        // Not value initialized. Every object placed here is constructed
+        m_blocks.push_back(std::unique_ptr<char[]>(new char[block_size]));
+        m_cursor = m_blocks.back().get();
+        m_remaining = block_size;
+        m_arena_bytes += block_size;
+        padding = (align - reinterpret_cast<uintptr_t>(m_cursor) % align) % align;
+    }
+
+    char* out = m_cursor + padding;
+    m_cursor += padding + size;
+    m_remaining -= padding + size;
+    return out;
+}
+
+
+/// @brief Run the destructors of the objects that have one, newest first, then free every block
+void Arena::release() {
+    for (destructor* record = m_destructors; record != nullptr; record = record->next) {
+        record->destroy(record->object);
+    }
+    m_destructors = nullptr;
+
+    m_blocks.clear();
+    m_cursor = nullptr;
+    m_remaining = 0;
+    m_arena_bytes = 0;
+}
+
+
+/// @brief Take over the blocks and objects of another arena, so they live as long as this
+///        one. Nothing moves. New objects still go in this arena's own current block
+void Arena::adopt(Arena& other) {
+    // Its objects count as newer than these, so they are destroyed first
+    if (other.m_destructors != nullptr) {
+        destructor* oldest = other.m_destructors;
+        while (oldest->next != nullptr) {
+            oldest = oldest->next;
+        }
+        oldest->next = m_destructors;
+        m_destructors = other.m_destructors;
+    }
+
+    for (std::unique_ptr<char[]>& block : other.m_blocks) {
+        m_blocks.push_back(std::move(block));
+    }
+    m_arena_bytes += other.m_arena_bytes;
+
+    other.m_destructors = nullptr;
+    other.m_blocks.clear();
+    other.m_cursor = nullptr;
+    other.m_remaining = 0;
+    other.m_arena_bytes = 0;
+}
+
+
+/// @brief Bytes held in blocks, used or not
+u64 Arena::memory_used() const {
+    return m_arena_bytes;
+}
+
+
+u64 Arena::block_count() const {
+    return m_blocks.size();
+}
+
+} // viper namespace
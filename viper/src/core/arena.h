@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ *  arena.h
+ *
+ *  Bump pointer allocator for objects that all die together, like the nodes
+ *  of one file's tree. Objects are carved out of large blocks and nothing is
+ *  freed one at a time. Releasing the arena runs the destructors that need
+ *  running, newest first, and frees every block in one go
+ */
+
+#include "defines.h"
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace viper {
+
+class Arena {
+    public:
+        Arena() {}
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /// @brief Construct an object in the arena. It lives until the arena is released
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                // The record lives in the arena too, so tracking it costs no malloc
+                destructor* record = new (allocate(sizeof(destructor), alignof(destructor))) destructor;
+                record->object = object;
+                record->destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+                record->next = m_destructors;
+                m_destructors = record;
+            }
+            return object;
+        }
+
+        void* allocate(u64 size, u64 align); // Raw memory that is freed with the arena
+        void release();                      // Destroy every object and free every block
+        void adopt(Arena& other);            // Take over the objects of other, which is left empty
+
+        u64 memory_used() const; // Bytes held in blocks
+        u64 block_count() const;
+
+    private:
+        // Destructor to run for an object when the arena is released
+        struct destructor {
+            void* object;
+            void (*destroy)(void*);
+            destructor* next;
+        };
+
+        static constexpr u64 BLOCK_SIZE = 64 * 1024;
+
+        std::vector<std::unique_ptr<char[]>> m_blocks; // Blocks never move, so objects never move
+        char* m_cursor = nullptr;                      // Next free byte of the current block
+        u64 m_remaining = 0;                           // Bytes left in the current block
+        u64 m_arena_bytes = 0;                         // Total bytes allocated for blocks
+        destructor* m_destructors = nullptr;           // Newest first
+};
+
+} // viper namespace
@@ -1,5 +1,6 @@
 #include "ast.h"
 #include <memory>
+#include <mutex>
 
 namespace viper {
 
@@ -11,13 +12,13 @@ namespace viper {
     }
 
     std::shared_ptr<AST> AST::create_new() {
-        auto ast = std::make_shared<AST>(AST());
-        return ast;
+        // The arena pins the tree in place, so it is built where it will live
+        return std::shared_ptr<AST>(new AST());
     }
 
 
 /// PROCEDURE NODE ///
-ProcedureNode::ProcedureNode() {
+ProcedureNode::ProcedureNode() : ASTNode(AST_PROCEDURE) {
     //scope = new Scope(nullptr);
 }
 
@@ -33,14 +34,14 @@ void ProcedureNode::add_statement(ASTNode* stmt) {
     // code_body.push_back(stmt);
 }
 
-/// @return Get the name of the procedure
-std::string& ProcedureNode::get_name() {
+/// @return Get the interned name of the procedure
+symbol ProcedureNode::get_name() const {
     return name;
 }
 
 
 /// @brief Set the name of the procedure
-void ProcedureNode::set_name(const std::string& name) {
+void ProcedureNode::set_name(symbol name) {
     this->name = name;
 }
 
@@ -52,6 +53,26 @@ void ProcedureNode::add_parameter(ASTNode* node) {
 }
 
 
+/// @return The code body of the procedure. A skimmed body is parsed the first time
+///         it is asked for, into the tree the procedure is in, whether or not that
+///         is still the tree of the file. Safe to call from several threads
+CodeBlockStatementNode* ProcedureNode::get_body() const {
+    CodeBlockStatementNode* parsed = body.load(std::memory_order_acquire);
+    if (parsed != nullptr || skimmed_end == 0) {
+        return parsed;
+    }
+
+    std::lock_guard<std::mutex> lock(skim_owner->skim_lock());
+    parsed = body.load(std::memory_order_relaxed);
+    if (parsed == nullptr) {
+        parsed = context.file->parse_skimmed_body(skim_owner, skimmed_begin, skimmed_end);
+        body.store(parsed, std::memory_order_release);
+        skim_owner->nodes_changed(); // Its flat tree has an empty slot for the body
+    }
+    return parsed;
+}
+
+
 /// @brief Set the return declarator of the function to this procedure
 void ProcedureNode::set_return_type(ASTNode* node) {
     this->return_declarator = node;
@@ -98,6 +119,78 @@ const std::vector<ASTNode*>& AST::get_nodes() const {
 /// @brief Add a node to the tree
 void AST::add_node(ASTNode* node) {
     nodes.push_back(node);
+    m_flat_current = false;
+}
+
+
+/// @brief Put the top level nodes from tail on, the ones added last, in place of
+///        the count nodes from first. The nodes replaced stay in the arena
+void AST::replace_nodes(u64 first, u64 count, u64 tail) {
+    std::vector<ASTNode*> moved(nodes.begin() + tail, nodes.end());
+    nodes.resize(tail);
+    nodes.erase(nodes.begin() + first, nodes.begin() + first + count);
+    nodes.insert(nodes.begin() + first, moved.begin(), moved.end());
+    m_flat_current = false;
+}
+
+
+void AST::add_skimmed(ProcedureNode* proc, u64 revision) {
+    m_skimmed.push_back(proc);
+    m_skimmed_revision = revision;
+}
+
+
+/// @brief Move the top level nodes of another tree after these, and its arena and
+///        errors with them. other is left empty. Nodes and errors keep their addresses
+void AST::append(AST& other) {
+    nodes.insert(nodes.end(), other.nodes.begin(), other.nodes.end());
+    m_arena.adopt(other.m_arena);
+    m_errors.adopt(other.m_errors);
+    // Keep the error nodes of one of the trees. Those of the other stay in the arena
+    m_error_node = m_error_node != nullptr ? m_error_node : other.m_error_node;
+    m_error_expr = m_error_expr != nullptr ? m_error_expr : other.m_error_expr;
+    other.m_error_node = nullptr;
+    other.m_error_expr = nullptr;
+    for (ProcedureNode* proc : other.m_skimmed) {
+        proc->set_skim_owner(this);
+        add_skimmed(proc, other.m_skimmed_revision);
+    }
+    other.m_skimmed.clear();
+    m_flat_current = false;
+
+    other.nodes.clear();
+    other.m_flat.clear();
+    other.m_flat_current = false;
+}
+
+
+ASTNode* AST::error_node(const Context& context) {
+    if (m_error_node == nullptr) {
+        m_error_node = make<ASTNode>(AST_INVALID_NODE);
+        m_error_node->set_context(context);
+    }
+    return m_error_node;
+}
+
+
+ExpressionNode* AST::error_expr(const Context& context) {
+    if (m_error_expr == nullptr) {
+        m_error_expr = make<ExpressionNode>();
+        m_error_expr->set_context(context);
+    }
+    return m_error_expr;
+}
+
+
+/// @brief The tree as parallel arrays. Built from the nodes the first time it is asked for
+///        and again after nodes are added, so parsing pays nothing for it
+FlatView AST::flat() {
+    if (!m_flat_current) {
+        m_flat.clear();
+        m_flat.append_roots(nodes);
+        m_flat_current = true;
+    }
+    return m_flat.view();
 }
 
 }
@@ -9,13 +9,24 @@
 
 #include "core/result.h"
 #include "core/type.h"
+#include "core/verror.h"
 //#include "core/scope.h"
 #include "defines.h"
 #include "token.h"
 #include "core/context.h"
+#include "core/interner.h"
 #include "core/result.h"
-
+#include "core/arena.h"
+#include "core/flat_ast.h"
+#include "core/node_kind.h"
+
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <type_traits>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace viper {
 
@@ -33,11 +44,6 @@ using prec_e = enum precedence {
     CALL,
 };
 
-enum NodeKind {
-    AST_NOOP,
-    AST_INVALID_NODE
-};
-
 
 /* Node in the AST */
 struct ASTNode {
@@ -45,20 +51,54 @@ struct ASTNode {
     ASTNode(NodeKind kind) : kind(kind) {}
     ASTNode() {}
    
-    NodeKind kind;
+    NodeKind kind = AST_NOOP;
     token tok;
 
     void set_parent(ASTNode* node) {
         parent_node = node;
     }
 
+    void set_context(const Context& ctx) {
+        context = ctx;
+    }
+
     static std::shared_ptr<ASTNode> create_new(token tok, NodeKind kind);
     virtual void print(const std::string& prepend) {}
 
+    static bool classof(const ASTNode* node) { return true; }
+
+    /// @brief Kind, token and payload of this node in a FlatAST. Dispatches on kind
+    flat_info flat() const;
+
+    /// @brief Append the children in the order the flat tree stores them.
+    ///        An optional child that is absent is appended as nullptr. Dispatches on kind
+    void children(std::vector<const ASTNode*>* out) const;
+
+    // What flat and children do for a plain node. Each node type hides these with its own
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {}
+
+    /// @brief Move the tokens of this node, not of its children, by delta bytes, for
+    ///        an edit of the source before it. Node types with tokens of their own hide this
+    void shift_tokens(i64 delta) {
+        tok.shift(delta);
+    }
+
 protected:
+    /// @brief Text of a token of this node, recovered from the file the node was parsed from
+    std::string text_of(const token& t) const {
+        return std::string(t.text(context.file));
+    }
+
+    /// @brief Spelling of an interned name
+    std::string text_of(symbol sym) const {
+        return std::string(Interner::global().get(sym));
+    }
 
-    Context context;
-    ASTNode* parent_node;
+    Context context {};
+    ASTNode* parent_node = nullptr;
     std::string module;
     //Scope* scope;
 };
@@ -72,6 +112,8 @@ protected:
  * }
  */
 struct CodeBlockStatementNode : public ASTNode {
+    CodeBlockStatementNode() : ASTNode(AST_CODE_BLOCK) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_CODE_BLOCK; }
     // Add line of code to the body
     void add_stmt(ASTNode* stmt) {
         body.push_back(stmt);
@@ -95,6 +137,13 @@ struct CodeBlockStatementNode : public ASTNode {
 //        }
 //    }
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->insert(out->end(), body.begin(), body.end());
+    }
+
     private:
     std::vector<ASTNode*> body;
 };
@@ -105,8 +154,16 @@ struct CodeBlockStatementNode : public ASTNode {
 
 /* Represents an expression. Evaluates to a value */
 struct ExpressionNode : public ASTNode {
-    Type* type;
+    ExpressionNode() : ASTNode(AST_EXPRESSION) {}
+    static bool classof(const ASTNode* node) {
+        return node->kind >= AST_FIRST_EXPRESSION && node->kind <= AST_LAST_EXPRESSION;
+    }
+
+    Type* type = nullptr;
     virtual Type* get_type() {return nullptr;}
+
+protected:
+    ExpressionNode(NodeKind kind) : ASTNode(kind) {}
 };
 
 /* Represents an expression statement. 
@@ -114,6 +171,8 @@ struct ExpressionNode : public ASTNode {
  * x + 2;
  */
 struct ExpressionStatementNode : public ASTNode {
+    ExpressionStatementNode() : ASTNode(AST_EXPRESSION_STATEMENT) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_EXPRESSION_STATEMENT; }
     void set_expr(ExpressionNode* node) {
         expr = node;
     }
@@ -126,8 +185,15 @@ struct ExpressionStatementNode : public ASTNode {
         expr->print("    ");
     }
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(expr);
+    }
+
     private:
-    ExpressionNode* expr;
+    ExpressionNode* expr = nullptr;
 };
 
 /* Represents an expression with a prefix operator
@@ -135,15 +201,12 @@ struct ExpressionStatementNode : public ASTNode {
  * ~x
  */
 struct ExpressionPrefixNode : public ExpressionNode {
+    ExpressionPrefixNode() : ExpressionNode(AST_PREFIX_EXPR) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_PREFIX_EXPR; }
     void set_rhs(ExpressionNode* node) {
         rhs = node;
     }
     
-    void set_rhs(ResultNode& expr_node) {
-        rhs = 
-            static_cast<ExpressionNode*>(expr_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_rhs() const {
         return rhs;
     }
@@ -157,7 +220,7 @@ struct ExpressionPrefixNode : public ExpressionNode {
     }
 
     void print(const std::string& prepend) override {
-        std::printf("%s", op.name.c_str());
+        std::printf("%s", text_of(op).c_str());
         rhs->print("    ");
     }
 
@@ -166,9 +229,21 @@ struct ExpressionPrefixNode : public ExpressionNode {
         return nullptr;
     }
 
+    flat_info describe() const {
+        return { kind, op, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(rhs);
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        op.shift(delta);
+    }
+
     private:
     token op;
-    ExpressionNode* rhs;
+    ExpressionNode* rhs = nullptr;
 };
 
 /* Represents an expression with an infix operator
@@ -176,10 +251,12 @@ struct ExpressionPrefixNode : public ExpressionNode {
  * y % 6
  */
 struct ExpressionBinaryNode : public ExpressionNode {
+    ExpressionBinaryNode() : ExpressionNode(AST_BINARY_EXPR) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_BINARY_EXPR; }
     void print(const std::string& prepend) override {
         std::printf("[");
         lhs->print("    ");
-        std::printf(" %s ", op.name.c_str());
+        std::printf(" %s ", text_of(op).c_str());
         rhs->print("    ");
         std::printf("]");
     }
@@ -188,10 +265,6 @@ struct ExpressionBinaryNode : public ExpressionNode {
     void set_rhs(ExpressionNode* node) {
         rhs = node;
     }
-    void set_rhs(ResultNode& expr_node) {
-        rhs = 
-            static_cast<ExpressionNode*>(expr_node.unwrap_or(new ExpressionNode()));
-    }
     const ExpressionNode* get_rhs() const {
         return rhs;
     }
@@ -208,27 +281,38 @@ struct ExpressionBinaryNode : public ExpressionNode {
     void set_lhs(ExpressionNode* node) {
         lhs = node;
     }
-    void set_lhs(ResultNode& expr_node) {
-        lhs = 
-            static_cast<ExpressionNode*>(expr_node.unwrap_or(new ExpressionNode()));
-    }
     const ExpressionNode* get_lhs() const {
         return lhs;
     }
 
 
+    flat_info describe() const {
+        return { kind, op, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(lhs);
+        out->push_back(rhs);
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        op.shift(delta);
+    }
+
     private:
-    ExpressionNode* lhs;
+    ExpressionNode* lhs = nullptr;
     token op;
-    ExpressionNode* rhs;
+    ExpressionNode* rhs = nullptr;
 };
 
 /* Represents a string literal expression
  * "example"
  */
 struct ExpressionStringLiteralNode : public ExpressionNode {
+    ExpressionStringLiteralNode() : ExpressionNode(AST_STRING_LITERAL) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_STRING_LITERAL; }
     void print(const std::string& prepend) override {
-        std::printf("\"%s\"", tok.name.c_str());
+        std::printf("\"%s\"", value().c_str());
     }
 
     void set_token(const token& t) {
@@ -238,6 +322,20 @@ struct ExpressionStringLiteralNode : public ExpressionNode {
         return tok;
     }
 
+    /// @brief The string the literal stands for, with '\n' line endings
+    std::string value() const {
+        return tok.string_value(context.file);
+    }
+
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        tok.shift(delta);
+    }
+
     private:
     token tok;
 };
@@ -247,8 +345,10 @@ struct ExpressionStringLiteralNode : public ExpressionNode {
  * bar(x + 1, num_seconds)
  */
 struct ExpressionProcedureCallNode : public ExpressionNode {
+    ExpressionProcedureCallNode() : ExpressionNode(AST_PROCEDURE_CALL) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_PROCEDURE_CALL; }
     void print(const std::string& prepend) override {
-        std::printf("%s(", identifier.name.c_str());
+        std::printf("%s(", text_of(identifier).c_str());
         for (const auto& arg : arguments) {
             arg->print("    ");
             std::printf(", ");
@@ -267,16 +367,22 @@ struct ExpressionProcedureCallNode : public ExpressionNode {
         arguments.push_back(arg);
     }
 
-    void add_argument(ResultNode r_arg) {
-        arguments.push_back(
-            static_cast<ExpressionNode*>(r_arg.unwrap_or(new ExpressionNode()))
-        );
-    }
-
     const std::vector<ExpressionNode*>& get_arguments() const {
         return arguments;
     }
 
+    flat_info describe() const {
+        return { kind, identifier, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->insert(out->end(), arguments.begin(), arguments.end());
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        identifier.shift(delta);
+    }
+
     private:
     token identifier;
     std::vector<ExpressionNode*> arguments;
@@ -287,8 +393,10 @@ struct ExpressionProcedureCallNode : public ExpressionNode {
  * example_array[...]
  */
 struct ExpressionIdentifierNode : public ExpressionNode {
+    ExpressionIdentifierNode() : ExpressionNode(AST_IDENTIFIER) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_IDENTIFIER; }
     void print(const std::string& prepend) override {
-        std::printf("%s", identifier.name.c_str());
+        std::printf("%s", text_of(identifier).c_str());
         if (expr != nullptr) {
             std::printf("[");
             expr->print("    ");
@@ -307,18 +415,25 @@ struct ExpressionIdentifierNode : public ExpressionNode {
         expr = node;
     }
     
-    void set_expr(ResultNode& expr_node) {
-        expr = 
-            static_cast<ExpressionNode*>(expr_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_expr() const {
         return expr;
     }
 
+    flat_info describe() const {
+        return { kind, identifier, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(expr);
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        identifier.shift(delta);
+    }
+
     private:
     token identifier;
-    ExpressionNode* expr; // for dimensional access
+    ExpressionNode* expr = nullptr; // for dimensional access
 };
 
 
@@ -328,8 +443,10 @@ struct ExpressionIdentifierNode : public ExpressionNode {
  * test_struct.method();
  */
 struct ExpressionMemberAccessNode : public ExpressionNode {
+    ExpressionMemberAccessNode() : ExpressionNode(AST_MEMBER_ACCESS) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_MEMBER_ACCESS; }
     void print(const std::string& prepend) override {
-        std::printf("%s.", identifier.name.c_str());
+        std::printf("%s.", text_of(identifier).c_str());
         access->print("    ");
     }
 
@@ -344,24 +461,32 @@ struct ExpressionMemberAccessNode : public ExpressionNode {
         access = node;
     }
     
-    void set_access(ResultNode& access_node) {
-        access = 
-            static_cast<ExpressionNode*>(access_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_access() const {
         return access;
     }
 
+    flat_info describe() const {
+        return { kind, identifier, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(access);
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        identifier.shift(delta);
+    }
+
     private:
     token identifier;
-    ExpressionNode* access;
+    ExpressionNode* access = nullptr;
 };
 
 
 /* Represents an integer literal */
 struct IntegerLiteralNode : public ExpressionNode {
-    IntegerLiteralNode(u64 value) : value(value) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_INTEGER_LITERAL; }
+    IntegerLiteralNode(u64 value) : ExpressionNode(AST_INTEGER_LITERAL), value(value) {}
 
     void print(const std::string& prepend) override {
         std::printf("%lu", this->value);
@@ -375,13 +500,18 @@ struct IntegerLiteralNode : public ExpressionNode {
         return value;
     }
 
+    flat_info describe() const {
+        return { kind, tok, value };
+    }
+
     private:
     u64 value;
 };
 
 /* Represents a boolean "true" or "false" literal expression */
 struct BooleanLiteralNode : public ExpressionNode {
-    BooleanLiteralNode(bool is_true) : is_true(is_true) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_BOOLEAN_LITERAL; }
+    BooleanLiteralNode(bool is_true) : ExpressionNode(AST_BOOLEAN_LITERAL), is_true(is_true) {}
 
     void print(const std::string& prepend) override {
         if (is_true) {
@@ -399,13 +529,18 @@ struct BooleanLiteralNode : public ExpressionNode {
         return is_true;
     }
 
+    flat_info describe() const {
+        return { kind, tok, is_true ? 1u : 0u };
+    }
+
     private:
     bool is_true; // whether or not this evalueates to true or false
 };
 
 /* Represents a floating point number literal */
 struct FloatLiteralNode : public ExpressionNode {
-    FloatLiteralNode(f64 value) : value(value) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_FLOAT_LITERAL; }
+    FloatLiteralNode(f64 value) : ExpressionNode(AST_FLOAT_LITERAL), value(value) {}
 
     void print(const std::string& prepend) override {
         std::printf("%lf", value);
@@ -419,6 +554,10 @@ struct FloatLiteralNode : public ExpressionNode {
         return value;
     }
 
+    flat_info describe() const {
+        return { kind, tok, std::bit_cast<u64>(value) };
+    }
+
     private:
     f64 value;
 };
@@ -429,11 +568,12 @@ struct FloatLiteralNode : public ExpressionNode {
 
 // For procedure nodes
 struct ProcedureNode : public ASTNode {
+    static bool classof(const ASTNode* node) { return node->kind == AST_PROCEDURE; }
     ProcedureNode();
     ~ProcedureNode();
     
-    std::string& get_name();
-    void set_name(const std::string& name);
+    symbol get_name() const;
+    void set_name(symbol name);
 
     void set_return_type(ASTNode* node);
     const ASTNode* get_return_type() const;
@@ -442,38 +582,78 @@ struct ProcedureNode : public ASTNode {
 
     void add_statement(ASTNode* stmt);
     void set_body(CodeBlockStatementNode* b) {
-        body = b;
+        body.store(b, std::memory_order_release);
+    }
+    CodeBlockStatementNode* get_body() const;
+
+    /// @brief Leave the body to be parsed when it is first asked for
+    /// @param owner The tree the procedure is in. The body is parsed into it
+    /// @param begin Offset of its '{' in the source
+    /// @param end Offset just past its '}'
+    void skim_body(AST* owner, u32 begin, u32 end) {
+        skim_owner = owner;
+        skimmed_begin = begin;
+        skimmed_end = end;
+    }
+    void set_skim_owner(AST* owner) { skim_owner = owner; } // The procedure's nodes moved to another tree
+
+    /// @brief Whether the body was skimmed and nobody has asked for it yet
+    bool body_pending() const {
+        return skimmed_end != 0 && body.load(std::memory_order_acquire) == nullptr;
     }
 
     void print(const std::string& prepend) override {
         // Print function prototype
-        std::printf("%sproc <%s>: <%s> (", prepend.c_str(), name.c_str(), return_declarator->tok.name.c_str());
+        std::printf("%sproc <%s>: <%s> (", prepend.c_str(), text_of(name).c_str(), text_of(return_declarator->tok).c_str());
         for (const auto& param : this->parameters) {
             param->print("");
             std::printf(", ");
         }
         std::printf(")\n");
 
-        body->print(prepend);
+        get_body()->print(prepend);
+    }
+
+    flat_info describe() const {
+        return { kind, tok, name };
+    }
+    // A skimmed body nobody asked for is an empty slot. Flattening does not parse it
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(return_declarator);
+        out->push_back(body_pending() ? nullptr : get_body());
+        out->insert(out->end(), parameters.begin(), parameters.end());
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        if (skimmed_end != 0) {
+            skimmed_begin = static_cast<u32>(skimmed_begin + delta);
+            skimmed_end = static_cast<u32>(skimmed_end + delta);
+        }
     }
 
     private:
-    std::string name;                 // unmangled name of the procedure
+    symbol name;                      // unmangled name of the procedure
     std::string lookup_name;        
     std::string mangled_name;         // the mangled name of the procedure
     std::vector<ASTNode*> parameters; // the parameter definitions for the function
-    ASTNode* return_declarator;       
-    ASTNode* procedure_declarator;    
+    ASTNode* return_declarator = nullptr;       
+    ASTNode* procedure_declarator = nullptr;    
     //Scope* scope;
-    CodeBlockStatementNode* body;
+    mutable std::atomic<CodeBlockStatementNode*> body { nullptr }; // Set by get_body when the body was skimmed
+    AST* skim_owner = nullptr; // [NOT OWNED] Tree of a skimmed procedure. Its arena holds this node, so it outlives it
+    u32 skimmed_begin = 0; // Source of a skimmed body. skimmed_end is 0 if it was not skimmed
+    u32 skimmed_end = 0;
     // std::vector<ASTNode*> code_body;  // code block body of the procedure
 };
 
 struct ProcParameter : public ASTNode {
-    void set_name(const std::string& str) {
-        name = str;
+    ProcParameter() : ASTNode(AST_PROC_PARAMETER) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_PROC_PARAMETER; }
+    void set_name(symbol sym) {
+        name = sym;
     }
-    std::string get_name() const { 
+    symbol get_name() const { 
         return name;
     }
 
@@ -485,11 +665,20 @@ struct ProcParameter : public ASTNode {
     }
 
     void print(const std::string& prepend) override {
-        std::printf("%s<%s>: <%s>", prepend.c_str(), this->name.c_str(), data_type.name.c_str());
+        std::printf("%s<%s>: <%s>", prepend.c_str(), text_of(name).c_str(), text_of(data_type).c_str());
+    }
+
+    flat_info describe() const {
+        return { kind, data_type, name };
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        data_type.shift(delta);
     }
 
     private:
-    std::string name;
+    symbol name;
     token data_type;
 };
 
@@ -497,29 +686,30 @@ struct ProcParameter : public ASTNode {
    let x: i32 = 0;
  * */
 struct VariableDeclarationNode : public ASTNode {
+    static bool classof(const ASTNode* node) { return node->kind == AST_VARIABLE_DECLARATION; }
     VariableDeclarationNode(
-        const std::string& name,
+        symbol name,
         ASTNode* type_spec,
         ASTNode* expr
-    ) : name(name), name_mangled(name), type_spec(type_spec), value(expr) {}
+    ) : ASTNode(AST_VARIABLE_DECLARATION), name(name), name_mangled(name), type_spec(type_spec), value(expr) {}
     ~VariableDeclarationNode() {}
 
     void print(const std::string& prepend) override {
-        std::printf("%slet <%s>: <%s> = ", prepend.c_str(), name.c_str(), type_spec->tok.name.c_str());
+        std::printf("%slet <%s>: <%s> = ", prepend.c_str(), text_of(name).c_str(), text_of(type_spec->tok).c_str());
         this->value->print("    ");
     }
 
-    void set_name(const std::string& str) {
-        name = str;
+    void set_name(symbol sym) {
+        name = sym;
     }
-    const std::string& get_name() const {
+    symbol get_name() const {
         return name;
     }
 
-    void set_name_mangled(const std::string& str) {
-        name_mangled = str;
+    void set_name_mangled(symbol sym) {
+        name_mangled = sym;
     }
-    const std::string& get_name_mangled() const {
+    symbol get_name_mangled() const {
         return name_mangled;
     }
 
@@ -537,17 +727,27 @@ struct VariableDeclarationNode : public ASTNode {
         return value;
     }
 
+    flat_info describe() const {
+        return { kind, tok, name };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(type_spec);
+        out->push_back(value);
+    }
+
     private:
-    std::string name;
-    std::string name_mangled;
-    ASTNode* type_spec;
-    ASTNode* value;
+    symbol name;
+    symbol name_mangled;
+    ASTNode* type_spec = nullptr;
+    ASTNode* value = nullptr;
 };
 
 /* Represents a return statement from a function
  * return x;
  */
 struct ReturnStatementNode : public ASTNode {
+    ReturnStatementNode() : ASTNode(AST_RETURN) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_RETURN; }
     void print(const std::string& prepend) override {
         std::printf("%sreturn ", prepend.c_str());
         expr->print("");
@@ -558,17 +758,19 @@ struct ReturnStatementNode : public ASTNode {
         expr = node;
     }
     
-    void set_expr(ResultNode& expr_node) {
-        expr = 
-            static_cast<ExpressionNode*>(expr_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_expr() const {
         return expr;
     }
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(expr);
+    }
+
     private:
-    ExpressionNode* expr;
+    ExpressionNode* expr = nullptr;
 };
 
 /* Represents a conditional statement
@@ -581,8 +783,10 @@ struct ReturnStatementNode : public ASTNode {
  * }
  */
 struct ConditionalStatementNode : public ASTNode {
+    ConditionalStatementNode() : ASTNode(AST_CONDITIONAL) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_CONDITIONAL; }
     void print(const std::string& prepend) override {
-        std::printf("%s%s ", prepend.c_str(), tok.name.c_str());
+        std::printf("%s%s ", prepend.c_str(), text_of(tok).c_str());
         if (condition != nullptr) {
             condition->print("");
         }
@@ -607,11 +811,6 @@ struct ConditionalStatementNode : public ASTNode {
         condition = node;
     }
     
-    void set_condition(ResultNode& condition_node) {
-        condition = 
-            static_cast<ExpressionNode*>(condition_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_condition() const {
         return condition;
     }
@@ -638,12 +837,26 @@ struct ConditionalStatementNode : public ASTNode {
     }
 
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(condition);
+        out->push_back(body);
+        out->push_back(else_clause);
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        tok.shift(delta);
+    }
+
     private:
     token tok;
-    ExpressionNode* condition;  // condition to evaluate 
+    ExpressionNode* condition = nullptr;  // condition to evaluate 
     // std::vector<ASTNode*> body; // code body
-    CodeBlockStatementNode* body;
-    ASTNode* else_clause;        // else of elif statement
+    CodeBlockStatementNode* body = nullptr;
+    ASTNode* else_clause = nullptr;        // else of elif statement
 };
 
 /* Represents a while loop 
@@ -652,6 +865,8 @@ struct ConditionalStatementNode : public ASTNode {
  *  }
  */
 struct WhileLoopStatementNode : public ASTNode {
+    WhileLoopStatementNode() : ASTNode(AST_WHILE_LOOP) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_WHILE_LOOP; }
     void print(const std::string& prepend) override {
         std::printf("%swhile ", prepend.c_str());
         if (condition != nullptr) {
@@ -664,11 +879,6 @@ struct WhileLoopStatementNode : public ASTNode {
         condition = node;
     }
     
-    void set_condition(ResultNode& condition_node) {
-        condition = 
-            static_cast<ExpressionNode*>(condition_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_condition() const {
         return condition;
     }
@@ -680,9 +890,17 @@ struct WhileLoopStatementNode : public ASTNode {
         return body;
     }
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(condition);
+        out->push_back(body);
+    }
+
     private:
-    ExpressionNode* condition;
-    CodeBlockStatementNode* body;
+    ExpressionNode* condition = nullptr;
+    CodeBlockStatementNode* body = nullptr;
     // std::vector<ASTNode*> body;
 };
 
@@ -692,15 +910,12 @@ struct WhileLoopStatementNode : public ASTNode {
  *  }
  */
 struct DoWhileLoopStatementNode : public ASTNode {
+    DoWhileLoopStatementNode() : ASTNode(AST_DO_WHILE_LOOP) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_DO_WHILE_LOOP; }
     void set_condition(ExpressionNode* node) {
         condition = node;
     }
     
-    void set_condition(ResultNode& condition_node) {
-        condition = 
-            static_cast<ExpressionNode*>(condition_node.unwrap_or(new ExpressionNode()));
-    }
-
     const ExpressionNode* get_condition() const {
         return condition;
     }
@@ -722,15 +937,25 @@ struct DoWhileLoopStatementNode : public ASTNode {
         std::printf("\n");
     }
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(condition);
+        out->push_back(body);
+    }
+
     private:
-    ExpressionNode* condition;
-    CodeBlockStatementNode* body;
+    ExpressionNode* condition = nullptr;
+    CodeBlockStatementNode* body = nullptr;
 };
 
 /* Represents a for loop
  * for (init; condition; action) {...}
  */
 struct ForLoopStatementNode : public ASTNode {
+    ForLoopStatementNode() : ASTNode(AST_FOR_LOOP) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_FOR_LOOP; }
     // Set the init action
     void set_initialization(ASTNode* init) {
         initialization = init;
@@ -743,10 +968,6 @@ struct ForLoopStatementNode : public ASTNode {
     void set_condition(ExpressionNode* node) {
         condition = node;
     }
-    void set_condition(ResultNode& condition_node) {
-        condition = 
-            static_cast<ExpressionNode*>(condition_node.unwrap_or(new ExpressionNode()));
-    }
     const ExpressionNode* get_condition() const {
         return condition;
     }
@@ -772,13 +993,23 @@ struct ForLoopStatementNode : public ASTNode {
         return action;
     }
 
+    flat_info describe() const {
+        return { kind, tok, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(initialization);
+        out->push_back(condition);
+        out->push_back(action);
+        out->push_back(body);
+    }
+
     private:
-    ASTNode* initialization;    // happens once when loop begins
-    ExpressionNode* condition;  // determines when loop breaks when this is false
-    ASTNode* action;            // happens at the end of every loop 
+    ASTNode* initialization = nullptr;    // happens once when loop begins
+    ExpressionNode* condition = nullptr;  // determines when loop breaks when this is false
+    ASTNode* action = nullptr;            // happens at the end of every loop 
 
 
-    CodeBlockStatementNode* body; // the block of code that executes in the loop
+    CodeBlockStatementNode* body = nullptr; // the block of code that executes in the loop
     // std::vector<ASTNode*> body; // the body of code that executes in the loop
 
     void print(const std::string& prepend) override {
@@ -800,8 +1031,10 @@ struct ForLoopStatementNode : public ASTNode {
  * }
  */
 struct StructDefinitionNode : public ASTNode {
+    StructDefinitionNode() : ASTNode(AST_STRUCT_DEFINITION) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_STRUCT_DEFINITION; }
     void print(const std::string& prepend) override {
-        std::printf("%sstruct %s {\n", prepend.c_str(), identifier.name.c_str());
+        std::printf("%sstruct %s {\n", prepend.c_str(), text_of(identifier).c_str());
         for (const auto& field : fields) {
             field->print(prepend + "    ");
             std::printf("\n");
@@ -815,6 +1048,9 @@ struct StructDefinitionNode : public ASTNode {
     const token& get_identifier() const {
         return identifier;
     }
+    symbol get_name() const {
+        return identifier.payload;
+    }
 
     void add_field(ASTNode* field) {
         fields.push_back(field);
@@ -823,6 +1059,18 @@ struct StructDefinitionNode : public ASTNode {
         return fields;
     }
 
+    flat_info describe() const {
+        return { kind, identifier, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->insert(out->end(), fields.begin(), fields.end());
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        identifier.shift(delta);
+    }
+
     private:
     token identifier;
     std::vector<ASTNode*> fields;
@@ -834,12 +1082,17 @@ struct StructDefinitionNode : public ASTNode {
  * }
  */
 struct StructMemberFieldNode : public ASTNode {
+    StructMemberFieldNode() : ASTNode(AST_STRUCT_FIELD) {}
+    static bool classof(const ASTNode* node) { return node->kind == AST_STRUCT_FIELD; }
     void set_identifier(const token& t) {
         identifier = t;
     }
     const token& get_identifier() const {
         return identifier;
     }
+    symbol get_name() const {
+        return identifier.payload;
+    }
 
     void set_type_spec(ASTNode* ts) {
         type_spec = ts;
@@ -849,23 +1102,139 @@ struct StructMemberFieldNode : public ASTNode {
     }
 
     void print(const std::string& prepend) override {
-        std::printf("%s%s :: %s", prepend.c_str(), identifier.name.c_str(), type_spec->tok.name.c_str());
+        std::printf("%s%s :: %s", prepend.c_str(), text_of(identifier).c_str(), text_of(type_spec->tok).c_str());
+    }
+
+    flat_info describe() const {
+        return { kind, identifier, 0 };
+    }
+    void append_children(std::vector<const ASTNode*>* out) const {
+        out->push_back(type_spec);
+    }
+
+    void shift_tokens(i64 delta) {
+        ASTNode::shift_tokens(delta);
+        identifier.shift(delta);
     }
 
     private:
     token identifier;
-    ASTNode* type_spec;
+    ASTNode* type_spec = nullptr;
 };
 
+/////////////////////////////////////
+///      KIND CHECKS AND CASTS      ///
+/////////////////////////////////////
+
+/// @brief Whether node is a T. Checks the kind tag, no RTTI
+template <typename T>
+bool isa(const ASTNode* node) {
+    return T::classof(node);
+}
+
+/// @brief node as a T, or nullptr when it is null or something else
+template <typename T>
+T* dyn_cast(ASTNode* node) {
+    return node != nullptr && isa<T>(node) ? static_cast<T*>(node) : nullptr;
+}
+template <typename T>
+const T* dyn_cast(const ASTNode* node) {
+    return node != nullptr && isa<T>(node) ? static_cast<const T*>(node) : nullptr;
+}
+
+/// @brief node as a T when the caller knows it is one
+template <typename T>
+T* cast(ASTNode* node) {
+    assert(isa<T>(node) && "cast to the wrong node type");
+    return static_cast<T*>(node);
+}
+template <typename T>
+const T* cast(const ASTNode* node) {
+    assert(isa<T>(node) && "cast to the wrong node type");
+    return static_cast<const T*>(node);
+}
+
+/// @brief Call func with node cast to its concrete type, picked by a switch on the kind.
+///        Every call is to a known type, so func's member calls are direct and can be inlined.
+///        Kinds without a node type of their own are passed as ASTNode
+template <typename Node, typename F>
+    requires std::is_same_v<std::remove_const_t<Node>, ASTNode>
+decltype(auto) visit(Node* node, F&& func) {
+    // Same constness as the node passed in
+    #define VIPER_VISIT(KIND, TYPE) \
+        case KIND: return func(static_cast<std::conditional_t<std::is_const_v<Node>, const TYPE, TYPE>*>(node));
+
+    switch (node->kind) {
+        VIPER_VISIT(AST_CODE_BLOCK, CodeBlockStatementNode)
+        VIPER_VISIT(AST_EXPRESSION_STATEMENT, ExpressionStatementNode)
+        VIPER_VISIT(AST_PROCEDURE, ProcedureNode)
+        VIPER_VISIT(AST_PROC_PARAMETER, ProcParameter)
+        VIPER_VISIT(AST_VARIABLE_DECLARATION, VariableDeclarationNode)
+        VIPER_VISIT(AST_RETURN, ReturnStatementNode)
+        VIPER_VISIT(AST_CONDITIONAL, ConditionalStatementNode)
+        VIPER_VISIT(AST_WHILE_LOOP, WhileLoopStatementNode)
+        VIPER_VISIT(AST_DO_WHILE_LOOP, DoWhileLoopStatementNode)
+        VIPER_VISIT(AST_FOR_LOOP, ForLoopStatementNode)
+        VIPER_VISIT(AST_STRUCT_DEFINITION, StructDefinitionNode)
+        VIPER_VISIT(AST_STRUCT_FIELD, StructMemberFieldNode)
+        VIPER_VISIT(AST_EXPRESSION, ExpressionNode)
+        VIPER_VISIT(AST_PREFIX_EXPR, ExpressionPrefixNode)
+        VIPER_VISIT(AST_BINARY_EXPR, ExpressionBinaryNode)
+        VIPER_VISIT(AST_STRING_LITERAL, ExpressionStringLiteralNode)
+        VIPER_VISIT(AST_PROCEDURE_CALL, ExpressionProcedureCallNode)
+        VIPER_VISIT(AST_IDENTIFIER, ExpressionIdentifierNode)
+        VIPER_VISIT(AST_MEMBER_ACCESS, ExpressionMemberAccessNode)
+        VIPER_VISIT(AST_INTEGER_LITERAL, IntegerLiteralNode)
+        VIPER_VISIT(AST_BOOLEAN_LITERAL, BooleanLiteralNode)
+        VIPER_VISIT(AST_FLOAT_LITERAL, FloatLiteralNode)
+        default:
+            return func(node);
+    }
+    #undef VIPER_VISIT
+}
+
+inline flat_info ASTNode::flat() const {
+    return visit(this, [](const auto* node) { return node->describe(); });
+}
+
+inline void ASTNode::children(std::vector<const ASTNode*>* out) const {
+    visit(this, [out](const auto* node) { node->append_children(out); });
+}
+
 /* The structure for the 
  * abstract syntax tree */
-struct AST {
-    ASTNode* head;
+struct AST : public std::enable_shared_from_this<AST> {
+    ASTNode* head = nullptr;
 
     static std::shared_ptr<AST> create_new();
     const std::vector<ASTNode*>& get_nodes() const;
     
     void add_node(ASTNode* node);
+    void append(AST& other); // Move the nodes of other to the end of this tree
+    void replace_nodes(u64 first, u64 count, u64 tail);
+
+    /// @brief The tree as parallel arrays. Built from the nodes on first use after they change.
+    ///        A skimmed body is an empty slot until it is asked for
+    FlatView flat();
+    void nodes_changed() { m_flat_current = false; } // Nodes were changed in place, the flat tree is built again
+
+    /// @brief Allocate a node in the tree's arena. It is freed with the tree
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return m_arena.make<T>(std::forward<Args>(args)...);
+    }
+    u64 memory_used() const { return m_arena.memory_used(); } // Bytes held for the nodes
+    ErrorStore& errors() { return m_errors; } // Errors reported while building the tree. Freed with it
+
+    /// @brief Nodes shared by every statement and every expression of the tree that failed
+    ///        to parse. Made by the first parser that asks, every later one reuses them
+    ASTNode* error_node(const Context& context);
+    ExpressionNode* error_expr(const Context& context);
+
+    /// @brief Keep track of a procedure whose body was skimmed from the source at revision
+    void add_skimmed(ProcedureNode* proc, u64 revision);
+    u64 skimmed_revision() const { return m_skimmed_revision; }
+    std::mutex& skim_lock() { return m_skim_lock; } // Held while a skimmed body is parsed into the tree
 
     void print_tree() {
         for (const auto& node : nodes) {
@@ -877,6 +1246,15 @@ struct AST {
     private:
         AST() {}
         std::vector<ASTNode*> nodes;
+        Arena m_arena; // Every node of the tree
+        ErrorStore m_errors;
+        ASTNode* m_error_node = nullptr;
+        ExpressionNode* m_error_expr = nullptr;
+        std::vector<ProcedureNode*> m_skimmed; // Procedures whose bodies were skimmed. They point back at the tree
+        u64 m_skimmed_revision = 0;            // Revision of the file's source they were skimmed from
+        std::mutex m_skim_lock;
+        FlatAST m_flat;
+        bool m_flat_current = false; // Whether m_flat holds every node in nodes
 };
 
 }
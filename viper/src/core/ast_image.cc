@@ -0,0 +1,310 @@
+#include "ast_image.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace viper {
+
+static_assert(std::is_trivially_copyable_v<token>, "tokens are stored in the image as they are in memory");
+
+// Symbol not given a number in the image yet
+static constexpr symbol UNNAMED = ~0u;
+
+/// @brief Round a size up to keep the array after it 8 byte aligned
+static u64 padded(u64 size) {
+    return (size + 7) & ~u64(7);
+}
+
+
+/// @brief Whether the payload of a token is a symbol. It is for every token the
+///        lexer reads but a number, whose payload is its value or a literal pool index
+static bool token_names(token_kind kind) {
+    return kind != TK_NUM_INT && kind != TK_NUM_FLOAT && kind != TK_PP_NUM;
+}
+
+
+/// @brief Whether the payload of a node is a name symbol
+static bool node_names(NodeKind kind) {
+    return kind == AST_PROCEDURE || kind == AST_PROC_PARAMETER || kind == AST_VARIABLE_DECLARATION;
+}
+
+
+ASTImage::~ASTImage() {
+    platform::unmap_file(&m_mapping);
+}
+
+
+ASTImage::ASTImage(ASTImage&& other) {
+    *this = std::move(other);
+}
+
+
+// The spans point into the mapping, which stays where it is
+ASTImage& ASTImage::operator=(ASTImage&& other) {
+    if (this != &other) {
+        platform::unmap_file(&m_mapping);
+        m_mapping = other.m_mapping;
+        m_bytes = other.m_bytes;
+        m_source_size = other.m_source_size;
+        m_source_hash = other.m_source_hash;
+        m_tree = other.m_tree;
+        m_string_begin = other.m_string_begin;
+        m_strings = other.m_strings;
+
+        other.m_mapping = {};
+        other.m_bytes = {};
+        other.m_tree = {};
+        other.m_string_begin = {};
+        other.m_strings = {};
+    }
+    return *this;
+}
+
+
+/// @brief Mix a word into a hash. Multiplying by an odd number and folding the high
+///        half down both lose nothing, so a change to the word always changes the hash
+static u64 mix(u64 hash, u64 word) {
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 32);
+}
+
+
+/// @brief Hash 8 bytes at a time into four independent lanes, so the multiplies of
+///        one lane overlap those of the others, and mix the lanes together at the end
+u64 ASTImage::hash_bytes(const char* data, u64 size, u64 seed) {
+    u64 lanes[4] = { seed, seed + 1, seed + 2, seed + 3 };
+    u64 i = 0;
+    for (; i + 32 <= size; i += 32) {
+        u64 words[4];
+        std::memcpy(words, data + i, 32);
+        for (u32 lane = 0; lane < 4; lane++) {
+            lanes[lane] = mix(lanes[lane], words[lane]);
+        }
+    }
+
+    u64 hash = mix(size, lanes[0]);
+    for (u32 lane = 1; lane < 4; lane++) {
+        hash = mix(hash, lanes[lane]);
+    }
+    for (; i < size; i += 8) {
+        u64 word = 0;
+        std::memcpy(&word, data + i, size - i < 8 ? size - i : 8);
+        hash = mix(hash, word);
+    }
+    return hash;
+}
+
+
+/// @brief Bytes of an image with the counts of a header
+u64 ASTImage::image_size(const header& head) {
+    u64 nodes = head.node_count;
+    return padded(sizeof(header))
+        + padded(nodes * sizeof(token))
+        + padded(nodes * sizeof(u64))
+        + padded((nodes + 1) * sizeof(u32))
+        + padded(u64(head.child_count) * sizeof(node_id))
+        + padded(u64(head.root_count) * sizeof(node_id))
+        + padded((u64(head.symbol_count) + 1) * sizeof(u32))
+        + padded(nodes * sizeof(NodeKind))
+        + padded(head.string_bytes);
+}
+
+
+std::string ASTImage::encode(const FlatView& flat, std::string_view source, const Interner& interner) {
+    // Image symbols are numbered in the order the names are first seen. 0 stays the empty string
+    std::vector<symbol> renumbered(interner.symbol_count(), UNNAMED);
+    std::vector<symbol> named { SYMBOL_EMPTY }; // Interner symbol of each image symbol
+    renumbered[SYMBOL_EMPTY] = 0;
+    auto rename = [&](u64 sym) -> symbol {
+        if (sym >= renumbered.size()) {
+            return 0;
+        }
+        if (renumbered[sym] == UNNAMED) {
+            renumbered[sym] = static_cast<symbol>(named.size());
+            named.push_back(static_cast<symbol>(sym));
+        }
+        return renumbered[sym];
+    };
+
+    u32 nodes = flat.size();
+    std::vector<token> tokens(nodes);
+    std::vector<u64> payloads(nodes);
+    std::vector<u32> child_begin { 0 };
+    std::vector<node_id> children;
+    std::vector<NodeKind> kinds(nodes);
+    child_begin.reserve(u64(nodes) + 1);
+    for (node_id id = 0; id < nodes; id++) {
+        token tok = flat.tok(id);
+        tok.payload = token_names(tok.kind) ? rename(tok.payload) : 0;
+        tokens[id] = tok;
+        kinds[id] = flat.kind(id);
+        payloads[id] = node_names(kinds[id]) ? rename(flat.payload(id)) : flat.payload(id);
+
+        std::span<const node_id> kids = flat.children(id);
+        children.insert(children.end(), kids.begin(), kids.end());
+        child_begin.push_back(static_cast<u32>(children.size()));
+    }
+
+    std::vector<u32> string_begin { 0 };
+    std::string strings;
+    for (symbol sym : named) {
+        strings += interner.get(sym);
+        string_begin.push_back(static_cast<u32>(strings.size()));
+    }
+
+    header head {};
+    std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+    head.version = VERSION;
+    head.node_count = nodes;
+    head.child_count = static_cast<u32>(children.size());
+    head.root_count = static_cast<u32>(flat.roots().size());
+    head.symbol_count = static_cast<u32>(named.size());
+    head.string_bytes = strings.size();
+    head.source_size = source.size();
+    head.source_hash = hash_bytes(source.data(), source.size(), 0);
+
+    std::string out(image_size(head), '\0');
+    u64 at = padded(sizeof(header));
+    auto put = [&out, &at](const void* data, u64 size) {
+        if (size != 0) {
+            std::memcpy(out.data() + at, data, size);
+        }
+        at += padded(size);
+    };
+    put(tokens.data(), tokens.size() * sizeof(token));
+    put(payloads.data(), payloads.size() * sizeof(u64));
+    put(child_begin.data(), child_begin.size() * sizeof(u32));
+    put(children.data(), children.size() * sizeof(node_id));
+    put(flat.roots().data(), flat.roots().size() * sizeof(node_id));
+    put(string_begin.data(), string_begin.size() * sizeof(u32));
+    put(kinds.data(), kinds.size() * sizeof(NodeKind));
+    put(strings.data(), strings.size());
+
+    u64 body = padded(sizeof(header));
+    u64 seed = hash_bytes(reinterpret_cast<const char*>(&head), offsetof(header, checksum), 0);
+    head.checksum = hash_bytes(out.data() + body, out.size() - body, seed);
+    std::memcpy(out.data(), &head, sizeof(header));
+    return out;
+}
+
+
+/// @brief Encode a flat tree into a file. It is renamed over the path once written,
+///        so a reader never maps an image that is half written
+bool ASTImage::write(const char* path, const FlatView& flat, std::string_view source, const Interner& interner) {
+    std::string image = encode(flat, source, interner);
+    return platform::replace_file(path, image.data(), image.size());
+}
+
+
+/// @brief Map an image file and check it
+/// @returns false if the file cannot be mapped or is not a valid image of this version
+bool ASTImage::open(const char* path, ASTImage* out) {
+    ASTImage image;
+    if (!platform::map_file(path, &image.m_mapping)) {
+        return false;
+    }
+    if (!image.load(std::string_view(image.m_mapping.data, image.m_mapping.size))) {
+        return false;
+    }
+
+    *out = std::move(image);
+    return true;
+}
+
+
+/// @brief Check an image in memory. The image reads the bytes in place, so they
+///        must outlive it and be 8 byte aligned
+bool ASTImage::view(std::string_view bytes, ASTImage* out) {
+    ASTImage image;
+    if (!image.load(bytes)) {
+        return false;
+    }
+
+    *out = std::move(image);
+    return true;
+}
+
+
+/// @brief Check the header and checksum, point the arrays into the bytes and check
+///        that every id and offset in them is inside what it indexes
+bool ASTImage::load(std::string_view bytes) {
+    if (bytes.size() < sizeof(header) || reinterpret_cast<std::uintptr_t>(bytes.data()) % 8 != 0) {
+        return false;
+    }
+
+    header head;
+    std::memcpy(&head, bytes.data(), sizeof(header));
+    if (std::memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0 || head.version != VERSION
+        || head.string_bytes > bytes.size() || image_size(head) != bytes.size()) {
+        return false;
+    }
+
+    u64 body = padded(sizeof(header));
+    u64 seed = hash_bytes(bytes.data(), offsetof(header, checksum), 0);
+    if (hash_bytes(bytes.data() + body, bytes.size() - body, seed) != head.checksum) {
+        return false;
+    }
+
+    u64 at = body;
+    auto take = [&bytes, &at]<typename T>(std::span<const T>* array, u64 count) {
+        *array = std::span<const T>(reinterpret_cast<const T*>(bytes.data() + at), count);
+        at += padded(count * sizeof(T));
+    };
+    std::span<const token> tokens;
+    std::span<const u64> payloads;
+    std::span<const u32> child_begin;
+    std::span<const node_id> children;
+    std::span<const node_id> roots;
+    std::span<const u32> string_begin;
+    std::span<const NodeKind> kinds;
+    take(&tokens, head.node_count);
+    take(&payloads, head.node_count);
+    take(&child_begin, u64(head.node_count) + 1);
+    take(&children, head.child_count);
+    take(&roots, head.root_count);
+    take(&string_begin, u64(head.symbol_count) + 1);
+    take(&kinds, head.node_count);
+    std::string_view strings = bytes.substr(at, head.string_bytes);
+
+    // Offset tables start at 0, never go back and end at the size of what they index
+    auto offsets = [](std::span<const u32> begin, u64 end) {
+        return begin.front() == 0 && begin.back() == end && std::ranges::is_sorted(begin);
+    };
+    if (!offsets(child_begin, head.child_count) || !offsets(string_begin, head.string_bytes)) {
+        return false;
+    }
+
+    // Every child is a node or an empty slot, every root a node
+    u32 nodes = head.node_count;
+    auto node = [nodes](node_id id) { return id < nodes; };
+    auto child = [nodes](node_id id) { return id < nodes || id == NO_NODE; };
+    if (!std::ranges::all_of(children, child) || !std::ranges::all_of(roots, node)) {
+        return false;
+    }
+
+    m_tree = FlatView(kinds, tokens, payloads, child_begin, children, roots);
+    m_string_begin = string_begin;
+    m_strings = strings;
+    m_bytes = bytes;
+    m_source_size = head.source_size;
+    m_source_hash = head.source_hash;
+    return true;
+}
+
+
+bool ASTImage::built_from(std::string_view source) const {
+    return source.size() == m_source_size && hash_bytes(source.data(), source.size(), 0) == m_source_hash;
+}
+
+
+std::string_view ASTImage::spelling(symbol sym) const {
+    if (sym >= symbol_count()) {
+        return std::string_view();
+    }
+    return m_strings.substr(m_string_begin[sym], m_string_begin[sym + 1] - m_string_begin[sym]);
+}
+
+} // viper namespace
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ *  ast_image.h
+ *
+ *  The flat tree of a file written out as one binary blob that is read back by
+ *  mapping it, so a file whose source has not changed since the image was
+ *  written needs no lexing or parsing (see VFile::compile). The arrays of the
+ *  flat tree are stored as they are in memory, one after the other and each 8
+ *  byte aligned, so a loaded image is a FlatView into the mapping and nothing
+ *  is allocated per node.
+ *
+ *  Symbols are only meaningful to the interner that made them, so the image
+ *  has a string table of its own and every name in it is renumbered into that
+ *  table: the payload of every token but a number, and the payload of the
+ *  node kinds whose payload is a name symbol. Number tokens are stored with no
+ *  payload, the literal nodes hold the decoded value. Offsets and lengths of
+ *  tokens are kept, they are the source spans of the nodes.
+ *
+ *  The header holds the size and a hash of the source the tree was parsed
+ *  from, and a checksum of the rest of the image that is checked on load. The
+ *  layout is that of the machine that wrote the image, version and magic guard
+ *  against reading another one. The checksum is not a defense against a file
+ *  crafted to pass it, images are a cache the compiler writes for itself
+ */
+
+#include "defines.h"
+#include "flat_ast.h"
+#include "interner.h"
+#include "platform/platform.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace viper {
+
+class ASTImage {
+    public:
+        static constexpr u32 VERSION = 1;
+
+        ASTImage() {}
+        ~ASTImage();
+        ASTImage(const ASTImage&) = delete;
+        ASTImage& operator=(const ASTImage&) = delete;
+        ASTImage(ASTImage&& other);
+        ASTImage& operator=(ASTImage&& other);
+
+        /// @brief Encode a flat tree parsed from source, resolving its symbols with interner
+        static std::string encode(const FlatView& flat, std::string_view source, const Interner& interner = Interner::global());
+        static bool write(const char* path, const FlatView& flat, std::string_view source, const Interner& interner = Interner::global());
+
+        static bool open(const char* path, ASTImage* out); // Map an image file and check it
+        static bool view(std::string_view bytes, ASTImage* out); // Check an image in memory. The bytes are not copied
+
+        /// @brief Whether the tree was parsed from this source. A mismatch means the image is stale
+        bool built_from(std::string_view source) const;
+
+        /// @brief The stored tree. Its symbols are those of the image, see spelling
+        const FlatView& tree() const { return m_tree; }
+
+        u32 symbol_count() const { return m_string_begin.empty() ? 0 : static_cast<u32>(m_string_begin.size() - 1); }
+        std::string_view spelling(symbol sym) const; // Spelling of a symbol of the image
+
+        u64 bytes() const { return m_bytes.size(); } // Size of the image
+
+    private:
+        // Start of every image. Counts give the size of every array after it
+        struct header {
+            char magic[4];
+            u32 version;
+            u32 node_count;
+            u32 child_count;
+            u32 root_count;
+            u32 symbol_count;
+            u64 string_bytes;
+            u64 source_size;
+            u64 source_hash;
+            u64 checksum; // Of the header up to here and of everything after it
+        };
+
+        static constexpr char MAGIC[4] = { 'V', 'A', 'S', 'T' };
+
+        static u64 hash_bytes(const char* data, u64 size, u64 seed);
+        static u64 image_size(const header& head);
+        bool load(std::string_view bytes);
+
+        platform::file_mapping m_mapping {}; // Mapping of the image file when it was opened from one
+        std::string_view m_bytes;
+        u64 m_source_size = 0;
+        u64 m_source_hash = 0;
+
+        FlatView m_tree;
+        std::span<const u32> m_string_begin; // One more entry than symbols
+        std::string_view m_strings;
+};
+
+} // viper namespace
@@ -7,11 +7,6 @@
 
 namespace viper {
 
-struct Location {
-    i32 line;
-    i32 character;
-};
-
 struct Context {
     VFile* file;
     VModule* module;
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "defines.h"
-#include "vresult.h"
+#include "platform/platform.h"
+#include "result.h"
 #include "verror.h"
 
 #include <string>
@@ -9,12 +10,17 @@
 #include <unordered_map>
 #include <optional>
 #include <memory>
+#include <mutex>
 #include <format>
+#include <string_view>
 
 
 namespace viper {
 struct VFile;
 struct AST;
+struct CodeBlockStatementNode;
+class ASTImage;
+class FlatView;
 //class Scope;
 class Parser;
 
@@ -45,15 +51,41 @@ class VModule {
 };
 
 
+// Position in a source file. Both counted from 1
+struct Location {
+    i32 line;
+    i32 character;
+};
+
+// A change to the source of a file: removed bytes from offset replaced by inserted.
+// The inserted text has '\n' line endings
+struct text_edit {
+    u32 offset;
+    u32 removed;
+    std::string_view inserted;
+};
+
 // Source codes files
 struct VFile {
-    VFile() {}
-    ~VFile() {}
+    VFile();
+    ~VFile();
+    VFile(const VFile&) = delete;
+    VFile& operator=(const VFile&) = delete;
+    VFile(VFile&& other);
+    VFile& operator=(VFile&& other);
+
+    static constexpr u64 PIPELINE_MIN_SOURCE = 64 * 1024; // Smaller files are not worth starting threads for
+    static constexpr u64 PARALLEL_PARSE_MIN_SOURCE = 64 * 1024; // Nor parsing on several threads
+
     std::string name;
     i32 file_number;
-    std::string content;
+    std::string content;               // Buffered source. Used for pipes, stdin and in-memory sources
+    platform::file_mapping mapping {}; // Read-only mapping of the source file when it could be mapped
     //Scope* scope;
-    VModule* module;
+    VModule* module = nullptr;
+    std::vector<u32> line_starts;      // Offset of the first byte of every line. Built by the first location lookup
+    std::mutex line_starts_lock;       // Locations may be looked up from several lexing threads
+    u64 revision = 0;                  // Edits applied to the source. A tree skimmed before one can not parse its bodies
 
     // From chibic project. Maybe use?
     std::string display_name;
@@ -64,13 +96,33 @@ struct VFile {
     static VFile from(const std::string& file_path, VModule* module);
     static VFile* create_new_ptr();
 
-    VResult<std::string, VError> add_dependency_module(const std::string& name, VModule* mod);
+    /// @brief The source code of the file. Points into the mapping when
+    ///        the file is mapped, otherwise into content
+    std::string_view source() const {
+        if (mapping.data != nullptr) {
+            return std::string_view(mapping.data, mapping.size);
+        }
+        return content;
+    }
+
+    Location location_of(u64 offset); // Line and column of a byte of the source
+    void apply_edit(const text_edit& edit); // Change the source. Nothing is parsed again
+
+    result::Result<std::string, VError> add_dependency_module(const std::string& name, VModule* mod);
 
     std::shared_ptr<AST> ast; // Root node of the file
+    std::vector<VError> parse_errors; // Syntax errors the last parse reported
+    std::unique_ptr<ASTImage> image;  // Tree compile loaded from an image in place of ast. Its names are spelled by the image
     void parse();
+    void parse_pipelined(); // Same as parse with lexing, preprocessing and parsing on separate threads
+    void parse_parallel(u32 threads = 0); // Same as parse with the top-level declarations split between threads
+    void skim(); // Same as parse with each procedure body parsed the first time it is asked for
+    CodeBlockStatementNode* parse_skimmed_body(AST* tree, u32 begin, u32 end);
     void print_ast();
+    bool load_image(const char* path); // Use the tree of an image written from this source instead of parsing
+    FlatView tree();                   // The flat tree of ast, or of image when the file was loaded from one
 
-    void compile();
+    void compile(const char* image_path = nullptr);
     void analyze();
 };
 
@@ -1,51 +1,233 @@
 #include "core.h"
+#include "core/ast_image.h"
 #include "semantic/semantic.h"
 #include "tokenizer/tokenizer.h"
+#include "tokenizer/scan.h"
 #include "parser/parser.h"
+#include "preprocessor/preprocessor.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iostream>
+#include <memory>
 #include <optional>
+#include <thread>
 
 namespace viper {
 
+/// @brief Read the whole of a stream into a string without seeking.
+///        Works for pipes and stdin where the size is not known ahead of time
+static void read_buffered(std::istream& handle, std::string& out) {
+    char buffer[64 * 1024];
+    while (handle.read(buffer, sizeof(buffer)) || handle.gcount() > 0) {
+        out.append(buffer, handle.gcount());
+    }
+}
+
+
 /// @brief Create a file with content read from specified file path
+///        Regular files are mapped read-only and scanned in place.
+///        Pipes, stdin ("-") and anything that cannot be mapped fall back to a buffered read
 /// @param file_path The path to the file we want to read source code from
 VFile VFile::from(const std::string& file_path, VModule* module) {
     VFile file;
-    std::size_t file_length;
-    std::fstream handle;
     file.name = file_path;
     file.module = module;
 
     //file.scope = new Scope(module->get_scope());
+
+    if (file_path == "-") {
+        read_buffered(std::cin, file.content);
+        return file;
+    }
+
+    if (platform::map_file(file_path.c_str(), &file.mapping)) {
+        return file;
+    }
    
     // Open file
-    handle.open(file_path.c_str(), std::ios::in);
+    std::ifstream handle(file_path.c_str(), std::ios::in | std::ios::binary);
     if (!handle) {
         std::fprintf(stderr, "Error: cannot open file %s\n", file_path.c_str());
         return {};
     }
 
-    // Find size of file
-    handle.seekg(0, handle.end);
-    file_length = handle.tellg();
-    handle.seekg(0, handle.beg);
+    read_buffered(handle, file.content);
+    return file;
+}
 
-    // Read into the content of file
-    file.content.resize(file_length);
-    handle.read(file.content.data(), file_length);
 
-    return file;
+VFile::VFile() {}
+
+
+VFile::~VFile() {
+    platform::unmap_file(&mapping);
+}
+
+
+VFile::VFile(VFile&& other) {
+    *this = std::move(other);
+}
+
+
+/// @brief Take over the other file. The mapping is transferred, not duplicated
+VFile& VFile::operator=(VFile&& other) {
+    if (this == &other) {
+        return *this;
+    }
+
+    platform::unmap_file(&mapping);
+    mapping = other.mapping;
+    other.mapping = {};
+
+    name = std::move(other.name);
+    file_number = other.file_number;
+    content = std::move(other.content);
+    line_starts = std::move(other.line_starts);
+    revision = other.revision;
+    other.revision = 0;
+    module = other.module;
+    display_name = std::move(other.display_name);
+    line_delta = other.line_delta;
+    dependency_modules = std::move(other.dependency_modules);
+    ast = std::move(other.ast);
+    parse_errors = std::move(other.parse_errors);
+    image = std::move(other.image);
+    return *this;
+}
+
+
+/// @brief Line and column of a byte of the source. The offsets at which lines
+///        start are found in one pass over the source the first time this is
+///        called, so lexing never keeps count of lines. "\r\n", '\r' and '\n'
+///        each end a line
+Location VFile::location_of(u64 offset) {
+    {
+        std::lock_guard<std::mutex> lock(line_starts_lock);
+        if (line_starts.empty()) {
+            std::string_view src = source();
+            line_starts.push_back(0);
+            scan::find_newlines(src.data(), src.size(), 0, &line_starts);
+        }
+    }
+
+    // The line is the last one that starts at or before the offset
+    auto next_line = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+    u64 line = next_line - line_starts.begin();
+    return Location{
+        static_cast<i32>(line),
+        static_cast<i32>(offset - line_starts[line - 1] + 1),
+    };
+}
+
+
+/// @brief Change the source. A mapped file is copied into content first, the file
+///        on disk is never changed
+void VFile::apply_edit(const text_edit& edit) {
+    if (mapping.data != nullptr) {
+        content.assign(source());
+        platform::unmap_file(&mapping);
+    }
+
+    content.replace(edit.offset, edit.removed, edit.inserted);
+    line_starts.clear();
+    revision++;
+    image.reset();
 }
 
 
 /// @brief Parse the content of the file
 void VFile::parse() {
-    Tokenizer lexer = Tokenizer::create_new(this);
+    Tokenizer lexer = Tokenizer::create_streaming(this);
     Parser parser = Parser::create_new(&lexer);
 
     ast = parser.parse();
+    parse_errors = parser.errors();
+}
+
+/// @brief Parse the file with the lexer, preprocessor and parser each on their own
+///        thread, handing tokens along through lock-free queues so the stages overlap.
+///        Builds the same tree as parse, which small files fall back to
+void VFile::parse_pipelined() {
+    if (source().size() < PIPELINE_MIN_SOURCE) {
+        parse();
+        return;
+    }
+
+    Tokenizer lexer = Tokenizer::create_pipelined(this);
+    Preprocessor preprocessor = Preprocessor::create_new(this, {});
+    auto lexed = std::make_unique<TokenQueue>();
+    auto processed = std::make_unique<TokenQueue>();
+
+    std::thread lex_stage([&]() { lexer.lex_into(lexed.get()); });
+    std::thread preprocess_stage([&]() { preprocessor.process_stream(lexed.get(), processed.get()); });
+
+    Parser parser = Parser::create_new(&lexer, processed.get());
+    ast = parser.parse();
+    parse_errors = parser.errors();
+
+    preprocess_stage.join();
+    lex_stage.join();
+}
+
+/// @brief Parse the file with its top-level declarations parsed on a pool of threads.
+///        Builds the same tree and reports the same errors as parse, which small
+///        files fall back to
+/// @param threads Most threads to use. 0 uses one per hardware thread
+void VFile::parse_parallel(u32 threads) {
+    if (source().size() < PARALLEL_PARSE_MIN_SOURCE) {
+        parse();
+        return;
+    }
+
+    Tokenizer lexer = Tokenizer::create_new(this);
+    (void) lexer.tokenize_file_parallel(threads);
+    ast = Parser::parse_parallel(&lexer, lexer.get_tokens(), threads, &parse_errors);
+}
+
+/// @brief Parse the file without its procedure bodies. Each body is only matched
+///        brace to brace, and is parsed when it is first asked for (see
+///        ProcedureNode::get_body), so a consumer that only looks at declarations,
+///        like import resolution, never pays for the bodies. A body's syntax errors
+///        are added to parse_errors when it is parsed
+void VFile::skim() {
+    Tokenizer lexer = Tokenizer::create_streaming(this);
+    Parser parser = Parser::create_new(&lexer);
+
+    ast = parser.skim();
+    parse_errors = parser.errors();
+}
+
+/// @brief Parse a procedure body that skim left in tree: the bytes [begin, end) of
+///        the source. Its nodes and errors go in tree, and its errors are added to
+///        parse_errors while tree is still ast. Once the source was edited the bytes
+///        are not the body any more. It comes back empty, with an error saying the
+///        body was lost. Callers hold the tree's skim_lock
+CodeBlockStatementNode* VFile::parse_skimmed_body(AST* tree, u32 begin, u32 end) {
+    if (tree->skimmed_revision() != revision) {
+        VError lost = tree->errors().report(error_type::PARSER_ERR,
+            "VFile::parse_skimmed_body: the body skimmed from bytes {} to {} of revision {} of {} was edited away by revision {}",
+            begin, end, tree->skimmed_revision(), name, revision);
+        if (tree == ast.get()) {
+            parse_errors.push_back(lost);
+        }
+
+        CodeBlockStatementNode* empty = tree->make<CodeBlockStatementNode>();
+        empty->set_context({ this, module });
+        return empty;
+    }
+
+    Tokenizer lexer = Tokenizer::create_range(this, begin, end);
+    std::vector<token> tokens = lexer.tokenize_file();
+    Parser parser = Parser::create_new(&lexer, tokens, tree->shared_from_this());
+
+    CodeBlockStatementNode* body = parser.parse_skimmed_body();
+    if (tree == ast.get()) {
+        parse_errors.insert(parse_errors.end(), parser.errors().begin(), parser.errors().end());
+    }
+    return body;
 }
 
 /// @brief Parse a single top-level statemetn
@@ -57,10 +239,38 @@ void VFile::print_ast() {
 }
 
 
+/// @brief Load the tree of the file from an image instead of lexing and parsing it.
+///        Only an image written from the current source is used. The pointer tree is
+///        dropped and passes read the file through tree()
+/// @returns false if the image is missing, invalid or stale
+bool VFile::load_image(const char* path) {
+    auto loaded = std::make_unique<ASTImage>();
+    if (!ASTImage::open(path, loaded.get()) || !loaded->built_from(source())) {
+        return false;
+    }
+
+    image = std::move(loaded);
+    ast = nullptr;
+    parse_errors.clear();
+    return true;
+}
+
+
+FlatView VFile::tree() {
+    if (ast != nullptr) {
+        return ast->flat();
+    }
+    if (image != nullptr) {
+        return image->tree();
+    }
+    return FlatView();
+}
+
+
 /// @brief Add a module as a dependancy for a file
-VResult<std::string, VError> VFile::add_dependency_module(const std::string& name, VModule* mod) {
+result::Result<std::string, VError> VFile::add_dependency_module(const std::string& name, VModule* mod) {
     dependency_modules[name] = mod;
-    return VResult<std::string, VError>::Ok("");;
+    return result::Ok(std::string(""));
 }
 
 
@@ -76,8 +286,17 @@ void VFile::analyze() {
     analyzer->analyze_ast();
 }
 
-void VFile::compile() {
-    parse();
+/// @brief Parse and check the file. Given an image path, the image an earlier compile
+///        of the same source wrote there is loaded instead of parsing. When there is
+///        none or it is stale the file is parsed and, if it had no errors, the image
+///        is written for the next compile
+void VFile::compile(const char* image_path) {
+    if (image_path == nullptr || !load_image(image_path)) {
+        parse();
+        if (image_path != nullptr && parse_errors.empty()) {
+            ASTImage::write(image_path, ast->flat(), source());
+        }
+    }
     analyze();
 }
 
@@ -0,0 +1,83 @@
+#include "flat_ast.h"
+#include "ast.h"
+
+namespace viper {
+
+/// @brief Store a node whose children are already stored
+/// @returns The id of the new node
+node_id FlatAST::add(const flat_info& info, const node_id* children, u32 count, const ASTNode* source) {
+    node_id id = size();
+    m_kinds.push_back(info.kind);
+    m_tokens.push_back(info.tok);
+    m_payloads.push_back(info.payload);
+    m_sources.push_back(source);
+
+    m_children.insert(m_children.end(), children, children + count);
+    m_child_begin.push_back(static_cast<u32>(m_children.size()));
+    return id;
+}
+
+
+/// @brief Flatten a pointer tree, children before their parent. Walks with a
+///        heap stack so deep nesting cannot overflow the call stack
+/// @returns The id of the root, or NO_NODE for a null root
+node_id FlatAST::append_tree(const ASTNode* root) {
+    if (root == nullptr) {
+        return NO_NODE;
+    }
+
+    std::vector<walk_frame>& stack = m_walk_stack;
+    std::vector<const ASTNode*>& pending = m_walk_pending;
+    std::vector<node_id>& finished = m_walk_finished;
+
+    stack.push_back({ root, 0, 0 });
+    root->children(&pending);
+
+    while (true) {
+        walk_frame& top = stack.back();
+        if (top.first_child + top.next < pending.size()) {
+            const ASTNode* child = pending[top.first_child + top.next];
+            top.next++;
+            if (child == nullptr) {
+                finished.push_back(NO_NODE);
+            } else {
+                stack.push_back({ child, pending.size(), 0 });
+                child->children(&pending);
+            }
+            continue;
+        }
+
+        u64 count = top.next;
+        node_id id = add(top.node->flat(), finished.data() + finished.size() - count, static_cast<u32>(count), top.node);
+        finished.resize(finished.size() - count);
+        pending.resize(top.first_child);
+        stack.pop_back();
+
+        if (stack.empty()) {
+            return id;
+        }
+        finished.push_back(id);
+    }
+}
+
+
+/// @brief Flatten top level items in order and add each as a root
+void FlatAST::append_roots(const std::vector<ASTNode*>& roots) {
+    m_roots.reserve(m_roots.size() + roots.size());
+    for (const ASTNode* root : roots) {
+        m_roots.push_back(append_tree(root));
+    }
+}
+
+
+void FlatAST::clear() {
+    m_kinds.clear();
+    m_tokens.clear();
+    m_payloads.clear();
+    m_child_begin.assign(1, 0);
+    m_children.clear();
+    m_roots.clear();
+    m_sources.clear();
+}
+
+} // viper namespace
@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ *  flat_ast.h
+ *
+ *  The syntax tree stored as parallel arrays instead of linked objects. Node
+ *  i has its kind in kinds[i], its token in tokens[i] and its payload in
+ *  payloads[i]. Its children are the ids children[child_begin[i] ..
+ *  child_begin[i + 1]). Nodes are stored children first, so a pass that does
+ *  not care about structure is a plain loop over the arrays, and a walk from
+ *  the roots only ever follows 32 bit indices into memory that is contiguous
+ */
+
+#include "defines.h"
+#include "token.h"
+#include "core/node_kind.h"
+
+#include <span>
+#include <vector>
+
+namespace viper {
+
+struct ASTNode;
+
+// Index of a node in a FlatAST
+using node_id = u32;
+
+// Child slot of a node with nothing in it, like the condition of an else
+constexpr node_id NO_NODE = ~0u;
+
+// What the flat tree keeps of one node besides its children
+struct flat_info {
+    NodeKind kind = AST_INVALID_NODE;
+    token tok {};
+    u64 payload = 0;
+};
+
+// Read-only view of a flat tree, over a FlatAST or over the arrays of a mapped
+// image (see ast_image.h). Cheap to copy, and only valid while what it views is
+class FlatView {
+    public:
+        FlatView() {}
+        FlatView(std::span<const NodeKind> kinds, std::span<const token> tokens, std::span<const u64> payloads,
+                 std::span<const u32> child_begin, std::span<const node_id> children, std::span<const node_id> roots,
+                 std::span<const ASTNode* const> sources = {})
+            : m_kinds(kinds), m_tokens(tokens), m_payloads(payloads), m_child_begin(child_begin),
+              m_children(children), m_roots(roots), m_sources(sources) {}
+
+        u32 size() const { return static_cast<u32>(m_kinds.size()); }
+        NodeKind kind(node_id id) const { return m_kinds[id]; }
+        const token& tok(node_id id) const { return m_tokens[id]; }
+        u64 payload(node_id id) const { return m_payloads[id]; }
+        std::span<const node_id> children(node_id id) const {
+            return m_children.subspan(m_child_begin[id], m_child_begin[id + 1] - m_child_begin[id]);
+        }
+        std::span<const node_id> roots() const { return m_roots; } // Top level items in source order
+
+        /// @brief The pointer node a flat node was built from, so code written against
+        ///        the pointer tree can be reached from an id. nullptr if it was added
+        ///        directly or the tree was loaded from an image
+        const ASTNode* pointer_node(node_id id) const { return m_sources.empty() ? nullptr : m_sources[id]; }
+
+        /// @brief Bytes of the viewed arrays, the pointer node table included
+        u64 memory_used() const {
+            return m_kinds.size_bytes() + m_tokens.size_bytes() + m_payloads.size_bytes() + m_child_begin.size_bytes()
+                + m_children.size_bytes() + m_roots.size_bytes() + m_sources.size_bytes();
+        }
+
+    private:
+        std::span<const NodeKind> m_kinds;
+        std::span<const token> m_tokens;
+        std::span<const u64> m_payloads;
+        std::span<const u32> m_child_begin; // One more entry than nodes
+        std::span<const node_id> m_children;
+        std::span<const node_id> m_roots;
+        std::span<const ASTNode* const> m_sources;
+};
+
+class FlatAST {
+    public:
+        FlatAST() {}
+
+        node_id add(const flat_info& info, const node_id* children, u32 count, const ASTNode* source = nullptr);
+        node_id append_tree(const ASTNode* root); // Flatten a pointer tree below the nodes already stored
+        void append_roots(const std::vector<ASTNode*>& roots); // Flatten top level items and add them as roots
+        void add_root(node_id id) { m_roots.push_back(id); }
+        void clear();
+
+        u32 size() const { return static_cast<u32>(m_kinds.size()); }
+        FlatView view() const { return FlatView(m_kinds, m_tokens, m_payloads, m_child_begin, m_children, m_roots, m_sources); }
+
+    private:
+        // A node whose children are being flattened
+        struct walk_frame {
+            const ASTNode* node;
+            u64 first_child; // Where its children start in m_walk_pending
+            u64 next;        // Next of them to flatten
+        };
+
+        std::vector<NodeKind> m_kinds;
+        std::vector<token> m_tokens;
+        std::vector<u64> m_payloads;
+        std::vector<u32> m_child_begin { 0 }; // One more entry than nodes. The last is where the next node's children go
+        std::vector<node_id> m_children;
+        std::vector<node_id> m_roots;
+        std::vector<const ASTNode*> m_sources;
+
+        // Scratch space of append_tree, kept so flattening many trees allocates once
+        std::vector<walk_frame> m_walk_stack;
+        std::vector<const ASTNode*> m_walk_pending; // Child lists of every node on the stack
+        std::vector<node_id> m_walk_finished;       // Ids of flattened children not yet given to a parent
+};
+
+} // viper namespace
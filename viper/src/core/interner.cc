@@ -0,0 +1,143 @@
+#include "interner.h"
+
+#include <cstring>
+#include <mutex>
+
+namespace viper {
+
+/// @brief Create an interner holding only the empty string
+Interner::Interner() {
+    m_table.resize(1024, slot{0, SYMBOL_EMPTY});
+    m_strings.push_back(std::string_view());
+}
+
+
+/// @brief The interner shared by every file being compiled
+Interner& Interner::global() {
+    static Interner interner;
+    return interner;
+}
+
+
+/// @brief FNV-1a hash of a string
+u32 Interner::hash_of(std::string_view str) {
+    u32 hash = 2166136261u;
+    for (char c : str) {
+        hash ^= static_cast<u8>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/// @brief Look a string up in the table
+/// @returns The symbol of the string or SYMBOL_EMPTY if it is not interned
+symbol Interner::find(std::string_view str, u32 hash) const {
+    u64 mask = m_table.size() - 1;
+    for (u64 i = hash & mask;; i = (i + 1) & mask) {
+        const slot& s = m_table[i];
+        if (s.sym == SYMBOL_EMPTY) {
+            return SYMBOL_EMPTY;
+        }
+        if (s.hash == hash && m_strings[s.sym] == str) {
+            return s.sym;
+        }
+    }
+}
+
+
+/// @brief Place a symbol in the first free slot for its hash
+void Interner::insert_slot(u32 hash, symbol sym) {
+    u64 mask = m_table.size() - 1;
+    u64 i = hash & mask;
+    while (m_table[i].sym != SYMBOL_EMPTY) {
+        i = (i + 1) & mask;
+    }
+    m_table[i] = slot{hash, sym};
+}
+
+
+/// @brief Double the size of the table and rehash every symbol
+void Interner::grow_table() {
+    std::vector<slot> old = std::move(m_table);
+    m_table.assign(old.size() * 2, slot{0, SYMBOL_EMPTY});
+    for (const slot& s : old) {
+        if (s.sym != SYMBOL_EMPTY) {
+            insert_slot(s.hash, s.sym);
+        }
+    }
+}
+
+
+/// @brief Copy a string into the arena. The copy never moves
+const char* Interner::copy_to_arena(std::string_view str) {
+    char* dest = static_cast<char*>(m_arena.allocate(str.size(), 1));
+    std::memcpy(dest, str.data(), str.size());
+    return dest;
+}
+
+
+/// @brief Get the symbol of a string, adding it to the table if it is new
+symbol Interner::intern(std::string_view str) {
+    return intern(str, hash_of(str));
+}
+
+
+symbol Interner::intern(std::string_view str, u32 hash) {
+    if (str.empty()) {
+        return SYMBOL_EMPTY;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_lock);
+        symbol sym = find(str, hash);
+        if (sym != SYMBOL_EMPTY) {
+            return sym;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_lock);
+    // Another thread may have added it between the two locks
+    symbol sym = find(str, hash);
+    if (sym != SYMBOL_EMPTY) {
+        return sym;
+    }
+
+    // Keep the load factor under 1/2
+    if ((m_strings.size() + 1) * 2 > m_table.size()) {
+        grow_table();
+    }
+
+    sym = static_cast<symbol>(m_strings.size());
+    m_strings.push_back(std::string_view(copy_to_arena(str), str.size()));
+    insert_slot(hash, sym);
+    return sym;
+}
+
+
+/// @brief Get the spelling of a symbol
+std::string_view Interner::get(symbol sym) const {
+    std::shared_lock<std::shared_mutex> lock(m_lock);
+    if (sym >= m_strings.size()) {
+        return std::string_view();
+    }
+    return m_strings[sym];
+}
+
+
+/// @brief Number of distinct strings interned, including the empty string
+u64 Interner::symbol_count() const {
+    std::shared_lock<std::shared_mutex> lock(m_lock);
+    return m_strings.size();
+}
+
+
+/// @brief Bytes held by the arena and the lookup tables
+u64 Interner::memory_used() const {
+    std::shared_lock<std::shared_mutex> lock(m_lock);
+    return m_arena.memory_used()
+        + m_strings.capacity() * sizeof(std::string_view)
+        + m_table.capacity() * sizeof(slot);
+}
+
+} // viper namespace
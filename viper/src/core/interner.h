@@ -0,0 +1,97 @@
+#pragma once
+
+/*
+ *  interner.h
+ *
+ *  Global table of interned strings. Every distinct spelling of an
+ *  identifier, keyword or type name is stored once and referred to by
+ *  a 32 bit symbol, so later phases compare names with an integer compare
+ */
+
+#include "defines.h"
+#include "arena.h"
+
+#include <array>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+namespace viper {
+
+// Id of an interned string
+using symbol = u32;
+
+// Symbol of the empty string. Default value of a token payload
+constexpr symbol SYMBOL_EMPTY = 0;
+
+class Interner {
+    public:
+        Interner(); // A private table. Most callers want the global interner
+        ~Interner() {}
+        Interner(const Interner&) = delete;
+        Interner& operator=(const Interner&) = delete;
+
+        /// @brief The interner shared by every file being compiled
+        static Interner& global();
+
+        symbol intern(std::string_view str);  // Get the symbol of a string, adding it if it is new
+        symbol intern(std::string_view str, u32 hash); // Same, with the hash_of the string already known
+        std::string_view get(symbol sym) const; // Get the spelling of a symbol
+        static u32 hash_of(std::string_view str);
+
+        u64 symbol_count() const;
+        u64 memory_used() const; // Bytes held by the arena and lookup tables
+
+    private:
+        // Slot in the open addressing table
+        struct slot {
+            u32 hash;
+            symbol sym; // SYMBOL_EMPTY marks an unused slot
+        };
+
+        symbol find(std::string_view str, u32 hash) const;
+        void insert_slot(u32 hash, symbol sym);
+        void grow_table();
+        const char* copy_to_arena(std::string_view str);
+
+        Arena m_arena;                                 // Where the spellings are stored. They never move
+        std::vector<std::string_view> m_strings;       // Spelling of each symbol, indexed by symbol
+        std::vector<slot> m_table;                     // Hash table from spelling to symbol. Size is a power of 2
+        mutable std::shared_mutex m_lock;              // Files may be lexed on several threads
+};
+
+/* Recently interned strings of one lexer, in front of an interner. A name found
+ * here is not looked up under the interner's lock, and most identifiers of a file
+ * are names it used a few lines before. Not locked, each lexer has its own */
+class InternCache {
+    public:
+        static constexpr u32 SIZE = 256; // Entries. A power of 2
+
+        InternCache() {}
+        explicit InternCache(Interner* interner) : m_interner(interner) {}
+
+        Interner* interner() const { return m_interner; }
+
+        /// @brief Get the symbol of a string from the interner, adding it if it is new
+        symbol intern(std::string_view str) {
+            u32 hash = Interner::hash_of(str);
+            entry& cached = m_entries[hash & (SIZE - 1)];
+            if (cached.spelling == str) {
+                return cached.sym;
+            }
+            symbol sym = m_interner->intern(str, hash);
+            cached = entry { m_interner->get(sym), sym };
+            return sym;
+        }
+
+    private:
+        struct entry {
+            std::string_view spelling; // Points into the interner's arena
+            symbol sym = SYMBOL_EMPTY;
+        };
+
+        Interner* m_interner = nullptr; // [NOT OWNED]
+        std::array<entry, SIZE> m_entries {};
+};
+
+} // viper namespace
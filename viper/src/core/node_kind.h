@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ *  node_kind.h
+ *
+ *  Kind tag of every node of the syntax tree. Each node type sets its kind
+ *  when it is constructed, so passes can switch on it instead of calling
+ *  virtual functions, and the flat tree stores it as one byte per node.
+ *  The comment is what the flat tree keeps for the kind: its children, and
+ *  what its token and payload hold. [x] marks a child slot that may be NO_NODE
+ */
+
+#include "defines.h"
+
+namespace viper {
+
+enum NodeKind : u8 {
+    AST_NOOP,                 // Empty placeholder
+    AST_INVALID_NODE,         // Something that failed to parse
+    AST_DATA_TYPE,            // token: the type name
+    AST_CODE_BLOCK,           // children: statements
+    AST_EXPRESSION_STATEMENT, // children: expression
+    AST_PROCEDURE,            // children: return type, body, parameters. payload: name symbol. The body is NO_NODE while it is skimmed
+    AST_PROC_PARAMETER,       // token: data type. payload: name symbol
+    AST_VARIABLE_DECLARATION, // children: type, value. payload: name symbol
+    AST_RETURN,               // children: [value]
+    AST_CONDITIONAL,          // children: [condition], body, [else clause]. token: if, elif or else
+    AST_WHILE_LOOP,           // children: [condition], body
+    AST_DO_WHILE_LOOP,        // children: [condition], body
+    AST_FOR_LOOP,             // children: [init], [condition], [action], body
+    AST_STRUCT_DEFINITION,    // children: fields. token: name
+    AST_STRUCT_FIELD,         // children: type. token: name
+
+    // Expressions. Keep these together, ExpressionNode matches the range
+    AST_EXPRESSION,           // Expression that failed to parse
+    AST_PREFIX_EXPR,          // children: operand. token: operator
+    AST_BINARY_EXPR,          // children: lhs, rhs. token: operator
+    AST_STRING_LITERAL,       // token: content of the literal
+    AST_PROCEDURE_CALL,       // children: arguments. token: procedure name
+    AST_IDENTIFIER,           // children: [index]. token: name
+    AST_MEMBER_ACCESS,        // children: member. token: name of the object
+    AST_INTEGER_LITERAL,      // payload: value
+    AST_BOOLEAN_LITERAL,      // payload: 1 for true
+    AST_FLOAT_LITERAL,        // payload: bits of the f64 value
+
+    AST_KIND_COUNT,
+};
+
+constexpr NodeKind AST_FIRST_EXPRESSION = AST_EXPRESSION;
+constexpr NodeKind AST_LAST_EXPRESSION = AST_FLOAT_LITERAL;
+
+} // viper namespace
@@ -1,12 +1,24 @@
 #pragma once
 
-#include <iostream>
+/*
+ *  result.h
+ *
+ *  Result<T, E> holds either the value of something that worked or the error of
+ *  something that did not. It is [[nodiscard]], so a result that is never looked
+ *  at is a warning.
+ *
+ *  When T is a pointer and E is an error handle (see error_handle below), the
+ *  result is a single word: the pointer as it is, or the handle with the low bit
+ *  set. Such a result is trivially copyable and is returned in a register, which
+ *  is what every parse function returns. Any other T and E are held in a
+ *  std::variant
+ */
+
+#include <concepts>
+#include <cstdint>
 #include <exception>
-#include <functional>
-#include <optional>
-#include <ostream>
-#include <stdexcept>
-#include <string>
+#include <iostream>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -15,9 +27,6 @@ namespace viper {
 
 namespace result {
 
-template <typename T, typename E>
-class Result;
-
 // For the Ok type of a result
 template <typename T>
 struct Ok {
@@ -27,16 +36,6 @@ struct Ok {
     constexpr const T& value() const& { return m_value; }
     constexpr T&& value() && { return std::move(m_value); }
 
-    template <typename E>
-    constexpr operator Result<T, E>() const& {
-        return Restult<T, E>(Ok(m_value));
-    }
-    
-    template <typename E>
-    constexpr operator Result<T, E>() && {
-        return Restult<T, E>(Ok(std::move(m_value)));
-    }
-
 private:
     T m_value;
 };
@@ -54,110 +53,151 @@ private:
     E m_value;
 };
 
+/// @brief An error that is a one word handle to an error kept out of line.
+///        to_bits() never has the low bit set, and from_bits() gives the handle back
+template <typename E>
+concept error_handle = std::is_trivially_copyable_v<E>
+    && sizeof(E) == sizeof(std::uintptr_t)
+    && requires(const E e, std::uintptr_t bits) {
+        { e.to_bits() } -> std::same_as<std::uintptr_t>;
+        { E::from_bits(bits) } -> std::same_as<E>;
+    };
+
+namespace detail {
+
+template <typename T>
+concept aligned_pointer = std::is_pointer_v<T>
+    && std::is_object_v<std::remove_pointer_t<T>>
+    && alignof(std::remove_pointer_t<T>) >= 2;
+
+/// @brief Value or error in a std::variant. Which one it is is the variant's index
 template <typename T, typename E>
-class Result {
+class variant_storage {
 public:
-    Result() 
-        : m_ok(false) {
-    }
-    
-    Result(Ok<T> value) : m_data(value.value()), m_ok(true) {}
-    Result(Err<E> value) : m_data(value.value()), m_ok(false) {}
+    constexpr variant_storage(std::in_place_index_t<0> tag, T&& value) : m_data(tag, std::move(value)) {}
+    constexpr variant_storage(std::in_place_index_t<1> tag, E&& error) : m_data(tag, std::move(error)) {}
 
-    // For types that are coercible like pointers to inherited classes
-    template<typename U>
-    Result(Ok<U> value) : m_data(static_cast<U>(value.value())), m_ok(true) {}
+    constexpr bool is_ok() const { return m_data.index() == 0; }
+    constexpr T take_value() { return std::get<0>(std::move(m_data)); }
+    constexpr E take_error() { return std::get<1>(std::move(m_data)); }
+
+private:
+    std::variant<T, E> m_data;
+};
 
-    ~Result() {
+/// @brief Value or error in one word. A pointer has its low bit clear because
+///        of its alignment, so the bit tells an error handle from a value
+template <typename T, typename E>
+class packed_storage {
+public:
+    packed_storage(std::in_place_index_t<0>, T value)
+        : m_bits(reinterpret_cast<std::uintptr_t>(value)) {}
+    packed_storage(std::in_place_index_t<1>, E error)
+        : m_bits(error.to_bits() | 1) {}
 
-    }
-    Result(const Result& other) {
-        m_data = other.m_data;
-    }
-    Result(Result&& other) {
-        std::swap(other.m_ok, this->m_ok);
-        std::swap(other.m_data, this->m_data);
-    }
+    bool is_ok() const { return (m_bits & 1) == 0; }
+    T take_value() const { return reinterpret_cast<T>(m_bits); }
+    E take_error() const { return E::from_bits(m_bits & ~std::uintptr_t(1)); }
 
-    Result& operator=(Result other) {
-        m_data = other.m_data;
-        m_ok = other.m_ok;
-        return *this;
-    }
+private:
+    std::uintptr_t m_bits;
+};
 
-    // [[ Conversion operators ]] //
+template <typename T, typename E>
+using storage = std::conditional_t<
+    aligned_pointer<T> && error_handle<E>,
+    packed_storage<T, E>,
+    variant_storage<T, E>
+>;
 
-    /// @brief If Result is Ok(), return the value. 
+} // namespace detail
+
+template <typename T, typename E>
+class [[nodiscard]] Result {
+public:
+    constexpr Result(Ok<T> value) : m_storage(std::in_place_index<0>, std::move(value).value()) {}
+    constexpr Result(Err<E> error) : m_storage(std::in_place_index<1>, std::move(error).value()) {}
+
+    // For types that are coercible like pointers to inherited classes
+    template <typename U>
+        requires (!std::is_same_v<U, T> && std::is_convertible_v<U, T>)
+    constexpr Result(Ok<U> value) : m_storage(std::in_place_index<0>, T(std::move(value).value())) {}
+
+    template <typename F>
+        requires (!std::is_same_v<F, E> && std::is_convertible_v<F, E>)
+    constexpr Result(Err<F> error) : m_storage(std::in_place_index<1>, E(std::move(error).value())) {}
+
+    // Copies and moves are the storage's own: trivial when it is one word
+    Result(const Result&) = default;
+    Result(Result&&) = default;
+    Result& operator=(const Result&) = default;
+    Result& operator=(Result&&) = default;
+
+    constexpr bool is_ok() const { return m_storage.is_ok(); }
+    constexpr bool is_err() const { return !m_storage.is_ok(); }
+
+    /// @brief If Result is Ok(), return the value.
     /// Otherwise, panic
-    constexpr T&& unwrap() {
-        if (m_ok) {
-            return std::get<T>(std::move(m_data));
+    constexpr T unwrap() {
+        if (!is_ok()) {
+            terminate("Panic: unwrap failed on Result");
         }
+        return m_storage.take_value();
+    }
 
-        terminate("Panic: unwrap failed on Result");
-        std::exit(1);
+    /// @brief Return the value, or panic with msg if the result is an error
+    constexpr T expect(std::string_view msg) {
+        if (!is_ok()) {
+            terminate(msg);
+        }
+        return m_storage.take_value();
     }
 
-    constexpr E&& unwrap_err() {
-        if(!m_ok) {
-            this->terminate("Called `unwrap_err` on Err value");
+    /// @brief If Result is Err(), return the error.
+    /// Otherwise, panic
+    constexpr E unwrap_err() {
+        if (is_ok()) {
+            terminate("Called `unwrap_err` on Ok value");
         }
-        return std::get<E>(std::move(m_data));
+        return m_storage.take_error();
     }
 
-    constexpr T&& unwrap_or(T&& val) {
-        if (m_ok) {
-            return std::get<T>(std::move(m_data));
+    /// @brief Return the value of the result or val if the result is an error
+    constexpr T unwrap_or(T val) {
+        if (is_ok()) {
+            return m_storage.take_value();
         }
         return val;
     }
 
-    constexpr T&& unwrap_or_default() {
-        static_assert(
-            std::is_default_constructible<T>::value,
-            "`unwrap_or_default` requires <T> to be default construbtible"
-        );
-
-        if(m_ok) {
-            return std::get<T>(std::move(m_data));
+    /// @brief Return the value of the result, or what make returns if the result
+    ///        is an error. make is only called for an error, so a fallback that
+    ///        costs something to build costs nothing on success
+    template <typename F>
+    constexpr T unwrap_or_else(F&& make) {
+        if (is_ok()) {
+            return m_storage.take_value();
         }
-        return T();
+        return std::forward<F>(make)();
     }
 
-    constexpr E&& unwrap_err_or(E && error) {
+    constexpr T unwrap_or_default() {
         static_assert(
-            std::is_default_constructible<E>::value,
-            "`unwrap_or_default` requires <E> to be default construbtible"
+            std::is_default_constructible<T>::value,
+            "`unwrap_or_default` requires <T> to be default construbtible"
         );
 
-        if (!m_ok) {
-            return E();
+        if (is_ok()) {
+            return m_storage.take_value();
         }
-        return std::get<E>(std::move(m_data));
-    }
-
-    constexpr E&& expect_err(const std::string_view& msg) {
-        if(m_ok) {
-            this->terminate(msg);
-        }
-
-        return std::get<E>(std::move(m_data));
+        return T();
     }
 
-
-
-
-
-
-    bool is_ok() const { return this->m_ok == true; }
-    bool is_err() const { return this->m_ok == false; }
-
 private:
-    std::variant<T, E> m_data;
-    bool m_ok;
+    detail::storage<T, E> m_storage;
 
     /// @brief Panic and termiante program if Result is invalid
-    void terminate(const std::string& msg) {
+    [[noreturn]] static void terminate(std::string_view msg) {
         std::cerr << msg << std::endl;
         std::terminate();
     }
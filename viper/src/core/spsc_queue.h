@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+ *  spsc_queue.h
+ *
+ *  Bounded lock-free queue between exactly one producer thread and one
+ *  consumer thread. Items move in batches so the atomic indices are touched
+ *  once per batch instead of once per item. Each side keeps a cached copy of
+ *  the other side's index and only reloads it when the queue looks full or
+ *  empty, so the two threads rarely share a cache line
+ */
+
+#include "defines.h"
+
+#include <array>
+#include <atomic>
+#include <thread>
+
+namespace viper {
+
+template <typename T, u32 N>
+class SpscQueue {
+    static_assert(N != 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of 2");
+
+    public:
+        SpscQueue() {}
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        /// @brief Copy up to count items in without waiting. Producer only
+        /// @returns How many items were copied
+        u32 try_push(const T* items, u32 count) {
+            u64 tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head_cache + count > N) {
+                m_head_cache = m_head.load(std::memory_order_acquire);
+            }
+
+            u64 space = N - (tail - m_head_cache);
+            u32 n = count < space ? count : static_cast<u32>(space);
+            for (u32 i = 0; i < n; i++) {
+                m_items[(tail + i) & (N - 1)] = items[i];
+            }
+            m_tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        /// @brief Copy every item in, waiting for the consumer to make room. Producer only
+        /// @returns false if the consumer closed the queue. The items left are dropped
+        bool push(const T* items, u32 count) {
+            u32 spins = 0;
+            while (count > 0) {
+                if (m_closed.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+
+                u32 n = try_push(items, count);
+                items += n;
+                count -= n;
+                if (n == 0) {
+                    backoff(&spins);
+                }
+            }
+            return true;
+        }
+
+        /// @brief Copy up to capacity items out without waiting. Consumer only
+        /// @returns How many items were copied, 0 when the queue is empty
+        u32 try_pop(T* out, u32 capacity) {
+            u64 head = m_head.load(std::memory_order_relaxed);
+            if (m_tail_cache == head) {
+                m_tail_cache = m_tail.load(std::memory_order_acquire);
+            }
+
+            u64 ready = m_tail_cache - head;
+            u32 n = capacity < ready ? capacity : static_cast<u32>(ready);
+            for (u32 i = 0; i < n; i++) {
+                out[i] = m_items[(head + i) & (N - 1)];
+            }
+            m_head.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        /// @brief Copy up to capacity items out, waiting until there is at least one. Consumer only
+        u32 pop(T* out, u32 capacity) {
+            u32 spins = 0;
+            u32 n;
+            while ((n = try_pop(out, capacity)) == 0) {
+                backoff(&spins);
+            }
+            return n;
+        }
+
+        /// @brief Tell the producer nothing more will be read. Consumer only
+        void close() {
+            m_closed.store(true, std::memory_order_relaxed);
+        }
+
+    private:
+        /// @brief Spin a little while the other side catches up, then give up the core
+        static void backoff(u32* spins) {
+            if (++*spins < 64) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        static constexpr u64 CACHE_LINE = 64;
+
+        alignas(CACHE_LINE) std::atomic<u64> m_head { 0 }; // Items read so far. Written by the consumer
+        u64 m_tail_cache = 0;                               // Consumer's last look at m_tail
+
+        alignas(CACHE_LINE) std::atomic<u64> m_tail { 0 }; // Items written so far. Written by the producer
+        u64 m_head_cache = 0;                               // Producer's last look at m_head
+
+        alignas(CACHE_LINE) std::atomic<bool> m_closed { false };
+        alignas(CACHE_LINE) std::array<T, N> m_items {};
+};
+
+} // viper namespace
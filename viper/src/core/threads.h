@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ *  threads.h
+ *
+ *  Running one piece of work on several threads at once. The threads live
+ *  for the one call, which is cheap next to the lexing or parsing they do
+ */
+
+#include "defines.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace viper {
+
+/// @brief Run func(0) ... func(count - 1) on their own threads. func(0) runs on the caller
+template <typename F>
+void run_on_threads(u64 count, F&& func) {
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for (u64 i = 1; i < count; i++) {
+        workers.emplace_back(func, i);
+    }
+    func(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/// @brief Run func(0) ... func(jobs - 1) on a pool of threads. Each thread takes the
+///        next job as soon as it finishes one, so jobs that take longer than the
+///        others do not hold the rest up. Jobs are taken in order
+/// @param threads Threads in the pool. 0 uses one per hardware thread
+template <typename F>
+void run_jobs(u64 jobs, u32 threads, F&& func) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    u64 workers = threads < jobs ? threads : jobs;
+
+    std::atomic<u64> next { 0 };
+    run_on_threads(workers, [&](u64) {
+        for (u64 job = next.fetch_add(1, std::memory_order_relaxed); job < jobs; job = next.fetch_add(1, std::memory_order_relaxed)) {
+            func(job);
+        }
+    });
+}
+
+} // viper namespace
@@ -0,0 +1,34 @@
+#include "verror.h"
+
+#include <algorithm>
+
+namespace viper {
+
+/// @brief Keep an error. Every record is allocated on its own, so handles to the
+///        others stay valid when one is released or the store grows
+const error_record* ErrorStore::add(error_type type, std::string msg) {
+    m_records.push_back(std::make_unique<error_record>(error_record { type, std::move(msg) }));
+    return m_records.back().get();
+}
+
+
+/// @brief Free the record of an error. Errors are few, so finding it is a scan
+void ErrorStore::release(VError error) {
+    const error_record* record = reinterpret_cast<const error_record*>(error.to_bits());
+    auto it = std::find_if(m_records.begin(), m_records.end(), [record](const std::unique_ptr<error_record>& kept) {
+        return kept.get() == record;
+    });
+    if (it != m_records.end()) {
+        std::swap(*it, m_records.back());
+        m_records.pop_back();
+    }
+}
+
+
+/// @brief Take over the records of another store, leaving it empty
+void ErrorStore::adopt(ErrorStore& other) {
+    m_records.insert(m_records.end(), std::make_move_iterator(other.m_records.begin()), std::make_move_iterator(other.m_records.end()));
+    other.m_records.clear();
+}
+
+} // viper namespace
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdio>
 #include <format>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace viper {
 
@@ -13,27 +16,52 @@ enum class error_type {
     PARSER_ERR,
 };
 
+// What an error says. Kept out of line, a VError only points at it
+struct error_record {
+    error_type type;
+    std::string msg;
+};
+
+class ErrorStore;
+
+/* Handle to an error we ran into when compiling. One pointer and trivially
+ * copyable, so a result::Result of a pointer and a VError is one word. The
+ * error it points at is kept by the ErrorStore that reported it */
 class VError {
     public:
-        ~VError() {}
+        error_type type() const { return m_record->type; }
+        const std::string& message() const { return m_record->msg; }
+
+        // What result::Result stores. Records are aligned, so the low bit is clear
+        std::uintptr_t to_bits() const { return reinterpret_cast<std::uintptr_t>(m_record); }
+        static VError from_bits(std::uintptr_t bits) { return VError(reinterpret_cast<const error_record*>(bits)); }
+
+    private:
+        friend class ErrorStore;
+        explicit VError(const error_record* record) : m_record(record) {}
+
+        const error_record* m_record;
+};
 
-        /// @brief Create a new VError and return it
+/* Keeps the errors reported into it until it is destroyed or they are released.
+ * A parse reports into the store of the tree it builds, so its errors live as
+ * long as the tree does and are freed with it. Not locked, like the tree */
+class ErrorStore {
+    public:
+        /// @brief Create a new VError kept by this store and return it
         template <typename ... Args>
-        static VError create_new(error_type type, const std::string_view& fmt, Args... args) {
-            VError err = VError();
-
-            // char buffer[400];
-            err.msg = std::vformat(fmt, std::make_format_args(args...));
-            // std::snprintf(buffer, sizeof(buffer), fmt, args...);
-            
-            // err.msg = buffer;
-            return err;
+        VError report(error_type type, const std::string_view& fmt, Args... args) {
+            return VError(add(type, std::vformat(fmt, std::make_format_args(args...))));
         }
 
+        void release(VError error);   // Free an error no one holds a handle to any more
+        void adopt(ErrorStore& other); // Keep the errors of other as well. Their handles stay valid
+        std::size_t size() const { return m_records.size(); }
+
     private:
-        VError() {}
+        const error_record* add(error_type type, std::string msg);
 
-        std::string msg;
+        std::vector<std::unique_ptr<error_record>> m_records;
 };
 
 }
@@ -0,0 +1,199 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <limits>
+#include <span>
+
+namespace viper {
+
+static constexpr u64 NO_STOP = std::numeric_limits<u64>::max();
+
+/// @brief Move every token of the trees under roots by delta bytes
+static void shift_trees(std::span<ASTNode* const> roots, i64 delta) {
+    std::vector<const ASTNode*> stack(roots.begin(), roots.end());
+    while (!stack.empty()) {
+        // The nodes are the tree's, which is being changed anyway
+        ASTNode* node = const_cast<ASTNode*>(stack.back());
+        stack.pop_back();
+        if (node == nullptr) {
+            continue;
+        }
+        visit(node, [&stack, delta](auto* typed) {
+            typed->shift_tokens(delta);
+            typed->append_children(&stack);
+        });
+    }
+}
+
+
+/// @brief Lex and parse the whole file, keeping what a reparse needs.
+///        Sets the tree and the errors of the file, like VFile::parse
+IncrementalParser IncrementalParser::create_new(VFile* file) {
+    IncrementalParser parser(file);
+    (void) parser.m_lexer.tokenize_file();
+    parser.parse_all();
+
+    return parser;
+}
+
+
+/// @brief Apply an edit to the file and parse again what it changed. The tree of the
+///        file keeps the nodes of every statement the edit did not reach, at the
+///        same addresses, and has those of the statements it did reach replaced.
+///        The nodes after the edit are moved with the source by tree()
+void IncrementalParser::reparse(const text_edit& edit) {
+    m_file->apply_edit(edit);
+    token_splice splice = m_lexer.relex(edit);
+    if (m_ast->memory_used() > MAX_GROWTH * m_parsed_memory) {
+        parse_all();
+        return;
+    }
+
+    i64 token_shift = static_cast<i64>(splice.inserted) - static_cast<i64>(splice.removed);
+    i64 byte_shift = static_cast<i64>(edit.inserted.size()) - static_cast<i64>(edit.removed);
+    u64 count = m_statements.size();
+
+    // Index of the first statement that starts at or after a token
+    auto starting_at = [this](u64 index) -> u64 {
+        auto it = std::partition_point(m_statements.begin(), m_statements.end(), [index](const statement_span& statement) {
+            return statement.start < index;
+        });
+        return it - m_statements.begin();
+    };
+
+    // A statement looks at its tokens and at the first token of the statement after
+    // it, so the one before the damage is parsed again too. The first statement that
+    // starts past the damage may be kept, if the parse comes back to its start
+    u64 first = starting_at(splice.first);
+    first = first > 0 ? first - 1 : 0;
+    u64 next = starting_at(splice.first + splice.removed);
+    u64 begin = first < count ? m_statements[first].start : 0;
+
+    u64 tail = m_ast->get_nodes().size();
+    std::vector<statement_span> fresh;
+    std::vector<VError> errors;
+    while (true) {
+        // The first token of the statement to stop at is part of the input, so the
+        // statement before it sees what really comes after it
+        u64 stop = next < count ? m_statements[next].start + token_shift : NO_STOP;
+        u64 end = next < count ? stop + 1 : tokens().size();
+
+        fresh.clear();
+        u64 reached = parse_statements(begin, end, stop, &fresh, &errors);
+        if (reached == stop || next == count) {
+            break;
+        }
+
+        // The parse ran past the start of the statement, so the edit joined it to
+        // the ones before. Drop what was parsed and go twice as far
+        m_ast->replace_nodes(tail, m_ast->get_nodes().size() - tail, m_ast->get_nodes().size());
+        release_errors(errors.begin(), errors.end());
+        u64 reach = reached + (reached - begin);
+        while (next < count && m_statements[next].start + token_shift <= reach) {
+            next++;
+        }
+    }
+
+    // Where the replaced statements' nodes and errors are
+    u64 node_first = 0;
+    u64 error_first = 0;
+    for (u64 i = 0; i < first; i++) {
+        node_first += m_statements[i].nodes;
+        error_first += m_statements[i].errors;
+    }
+    u64 node_count = 0;
+    u64 error_count = 0;
+    for (u64 i = first; i < next; i++) {
+        node_count += m_statements[i].nodes;
+        error_count += m_statements[i].errors;
+    }
+
+    m_ast->replace_nodes(node_first, node_count, tail);
+    release_errors(m_errors.begin() + error_first, m_errors.begin() + error_first + error_count);
+    m_errors.erase(m_errors.begin() + error_first, m_errors.begin() + error_first + error_count);
+    m_errors.insert(m_errors.begin() + error_first, errors.begin(), errors.end());
+
+    for (u64 i = next; i < count; i++) {
+        m_statements[i].start += token_shift;
+        m_statements[i].shift += byte_shift;
+    }
+    m_statements.erase(m_statements.begin() + first, m_statements.begin() + next);
+    m_statements.insert(m_statements.begin() + first, fresh.begin(), fresh.end());
+    publish();
+}
+
+
+/// @brief Move the nodes of the statements that edits left behind their source.
+///        Statements that did not move are skipped, not walked
+const std::shared_ptr<AST>& IncrementalParser::tree() {
+    std::span<ASTNode* const> nodes(m_ast->get_nodes());
+    u64 node = 0;
+    for (statement_span& statement : m_statements) {
+        if (statement.shift != 0) {
+            shift_trees(nodes.subspan(node, statement.nodes), statement.shift);
+            statement.shift = 0;
+            m_ast->nodes_changed();
+        }
+        node += statement.nodes;
+    }
+    return m_ast;
+}
+
+
+/// @brief Parse every token into a new tree
+void IncrementalParser::parse_all() {
+    m_ast = AST::create_new();
+    m_statements.clear();
+    (void) parse_statements(0, tokens().size(), NO_STOP, &m_statements, &m_errors);
+    m_parsed_memory = m_ast->memory_used();
+    publish();
+}
+
+
+/// @brief Parse the top-level statements of the tokens [begin, end) into the tree,
+///        recording where each starts. Stops before the statement that starts at
+///        stop, once past stop, or at the end of the tokens
+/// @param errors Set to the errors of the statements parsed
+/// @returns Index of the token the parse stopped at
+u64 IncrementalParser::parse_statements(u64 begin, u64 end, u64 stop, std::vector<statement_span>* out, std::vector<VError>* errors) {
+    std::span<const token> input = std::span<const token>(tokens()).subspan(begin, end - begin);
+    Parser parser = Parser::create_new(&m_lexer, input, m_ast);
+
+    u64 at = begin;
+    while (at < stop) {
+        u64 nodes = m_ast->get_nodes().size();
+        u64 reported = parser.errors().size();
+        if (!parser.parse_declaration().has_value()) {
+            break;
+        }
+
+        out->push_back({
+            at,
+            static_cast<u32>(m_ast->get_nodes().size() - nodes),
+            static_cast<u32>(parser.errors().size() - reported),
+            0,
+        });
+        at = begin + parser.position();
+    }
+
+    *errors = parser.errors();
+    return at;
+}
+
+
+/// @brief Free the errors of statements that were parsed again. The tree keeps
+///        every error reported into it, so a long edit session would fill it
+void IncrementalParser::release_errors(std::vector<VError>::iterator first, std::vector<VError>::iterator last) {
+    for (; first != last; ++first) {
+        m_ast->errors().release(*first);
+    }
+}
+
+
+/// @brief Give the file the tree and errors
+void IncrementalParser::publish() {
+    m_file->ast = m_ast;
+    m_file->parse_errors = m_errors;
+}
+
+} // viper namespace
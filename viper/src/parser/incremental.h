@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ *  incremental.h
+ *
+ *  Parsing a file again after an edit without starting over. The tokens of the
+ *  whole file are kept, and so is where each top-level statement starts in them.
+ *  An edit re-lexes only the tokens it touched, and re-parses from the statement
+ *  that looked at the first of them until the parse is back at the start of a
+ *  statement the edit left alone. Every other statement keeps its nodes, which
+ *  are moved by the size of the edit.
+ *
+ *  A top-level statement is parsed from a clean parser, and looks at no token
+ *  past the first one of the statement after it, so reparsing from the start of
+ *  a statement and stopping at the start of an unchanged one builds the same
+ *  tree as parsing the whole file. The errors are the same too, except for the
+ *  cap of Parser::MAX_ERRORS, which each reparse counts from zero
+ *
+ *  Moving the statements after an edit is put off. Each statement keeps how far
+ *  its nodes are behind the source, and tree() moves them, so a burst of typing
+ *  pays for walking the rest of the file once, when the tree is next read
+ */
+
+#include "defines.h"
+#include "parser.h"
+#include "tokenizer/tokenizer.h"
+#include "core/ast.h"
+#include "core/core.h"
+#include "core/verror.h"
+
+#include <memory>
+#include <vector>
+
+namespace viper {
+
+class IncrementalParser {
+    public:
+        static IncrementalParser create_new(VFile* file);
+        void reparse(const text_edit& edit);
+        const std::vector<token>& tokens() const { return m_lexer.get_tokens(); }
+        const std::shared_ptr<AST>& tree(); // The file's tree, with every node moved to where its source is
+
+        // Nodes an edit replaces stay in the tree's arena. Past this many times the
+        // memory of the last whole parse, the tree is parsed again whole to free them
+        static constexpr u64 MAX_GROWTH = 2;
+
+    private:
+        IncrementalParser(VFile* file) : m_file(file), m_lexer(Tokenizer::create_new(file)) {}
+
+        // A top-level statement of the tree
+        struct statement_span {
+            u64 start;  // Index of its first token
+            u32 nodes;  // Nodes it added to the tree: 1, or 0 for one that was skipped as an error
+            u32 errors; // Errors reported while parsing it
+            i64 shift;  // Bytes its nodes are behind the source, until tree() moves them
+        };
+
+        void parse_all();
+        u64 parse_statements(u64 begin, u64 end, u64 stop, std::vector<statement_span>* out, std::vector<VError>* errors);
+        void release_errors(std::vector<VError>::iterator first, std::vector<VError>::iterator last);
+        void publish();
+
+        VFile* m_file; // [NOT OWNED]
+        Tokenizer m_lexer; // Holds every token of the file and the values of its numbers
+        std::shared_ptr<AST> m_ast;
+        std::vector<statement_span> m_statements;
+        std::vector<VError> m_errors;
+        u64 m_parsed_memory = 0; // Memory of the tree after the last whole parse
+};
+
+}
@@ -0,0 +1,119 @@
+/*
+ *  parallel.cc
+ *
+ *  Parsing the top-level declarations of one file on several threads. One pass
+ *  over the tokens matches braces to find where each declaration starts, the
+ *  tokens are cut into runs of whole declarations, and a pool of threads parses
+ *  the runs, each into a tree of its own. The trees are appended in file order.
+ *
+ *  A run that parses without an error is parsed the way a serial parse would
+ *  parse it. Every declaration ends in a token the end of the input can not
+ *  stand in for, so a run with no errors ended between two declarations, where
+ *  a serial parser would be in the same state. Once a run has an error,
+ *  recovery may reach into the runs after it, so the rest of the file is parsed
+ *  again on one thread. A cut the brace matching gets wrong costs time, never
+ *  a different tree
+ */
+
+#include "parser.h"
+#include "core/threads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace viper {
+
+/// @brief Index of every token that starts a top-level declaration:
+///        a define, struct or let outside of any braces
+static std::vector<u64> find_declarations(std::span<const token> tokens) {
+    std::vector<u64> starts;
+    u64 depth = 0;
+    for (u64 i = 0; i < tokens.size(); i++) {
+        switch (tokens[i].kind) {
+            case TK_LSQUIRLY:
+                depth++;
+                break;
+            case TK_RSQUIRLY:
+                // A stray '}' is a syntax error. The run it is in is parsed again anyway
+                if (depth > 0) {
+                    depth--;
+                }
+                break;
+            case TK_DEFINE:
+            case TK_STRUCT:
+            case TK_LET:
+                if (depth == 0) {
+                    starts.push_back(i);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return starts;
+}
+
+
+/// @brief Parse the tokens of a whole file with its declarations split between threads.
+///        The tree and the errors are the same as parsing the tokens serially
+/// @param threads Most threads to use. 0 uses one per hardware thread
+/// @param errors Set to the syntax errors of the parse
+std::shared_ptr<AST> Parser::parse_parallel(Tokenizer* lexer, std::span<const token> tokens, u32 threads, std::vector<VError>* errors) {
+    if (threads == 0) {
+        // hardware_concurrency is 0 when it is not known
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Cut before declarations into runs long enough to be worth a job, and short
+    // enough that every thread gets several, so one slow run does not hold up the rest
+    u64 run_length = tokens.size() / (static_cast<u64>(threads) * PARALLEL_RUNS_PER_THREAD);
+    run_length = run_length > PARALLEL_MIN_RUN ? run_length : PARALLEL_MIN_RUN;
+    std::vector<u64> cuts = { 0 };
+    for (u64 start : find_declarations(tokens)) {
+        if (start - cuts.back() >= run_length) {
+            cuts.push_back(start);
+        }
+    }
+    cuts.push_back(tokens.size());
+
+    u64 runs = cuts.size() - 1;
+    if (threads < 2 || runs < 2) {
+        Parser parser = create_new(lexer, tokens);
+        std::shared_ptr<AST> ast = parser.parse();
+        *errors = parser.errors();
+        return ast;
+    }
+
+    std::vector<std::shared_ptr<AST>> trees(runs);
+    std::atomic<u64> first_failed { runs };
+    run_jobs(runs, threads, [&](u64 run) {
+        // Runs after one that failed are parsed again anyway
+        if (run > first_failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        Parser parser = create_new(lexer, tokens.subspan(cuts[run], cuts[run + 1] - cuts[run]));
+        trees[run] = parser.parse();
+        if (!parser.errors().empty()) {
+            u64 failed = first_failed.load();
+            while (run < failed && !first_failed.compare_exchange_weak(failed, run)) {}
+        }
+    });
+
+    std::shared_ptr<AST> ast = AST::create_new();
+    u64 failed = first_failed.load();
+    for (u64 run = 0; run < failed; run++) {
+        ast->append(*trees[run]);
+    }
+
+    errors->clear();
+    if (failed < runs) {
+        Parser parser = create_new(lexer, tokens.subspan(cuts[failed]));
+        ast->append(*parser.parse());
+        *errors = parser.errors();
+    }
+    return ast;
+}
+
+} // viper namespace
@@ -1,9 +1,9 @@
 #include "parser.h"
 #include "core/ast.h"
 #include "core/verror.h"
-#include "platform/platform.h"
 #include "token.h"
 #include "tokenizer/tokenizer.h"
+#include <array>
 #include <iostream>
 
 namespace viper {
@@ -11,48 +11,88 @@ namespace viper {
 using ResultNode = result::Result<ASTNode*, VError>;
 using ResultToken = result::Result<token, VError>;
 
-Parser::Parser() {
-    operator_precedences[TK_ASSIGN] = precedence::ASSIGN;
-    operator_precedences[TK_TIMESEQ] = precedence::ASSIGN;
-    operator_precedences[TK_DIVEQ] = precedence::ASSIGN;
-    operator_precedences[TK_MODEQ] = precedence::ASSIGN;
-    operator_precedences[TK_EQUALTO] = precedence::COMPARISON;
-    operator_precedences[TK_PLUSEQ] = precedence::COMPARISON;
-    operator_precedences[TK_MINUSEQ] = precedence::COMPARISON;
-    operator_precedences[TK_LOG_OR] = precedence::LOGICAL_OR_AND;
-    operator_precedences[TK_LOG_AND] = precedence::LOGICAL_OR_AND;
-    operator_precedences[TK_LT] = precedence::COMPARISON;
-    operator_precedences[TK_GT] = precedence::COMPARISON;
-    operator_precedences[TK_LTEQ] = precedence::COMPARISON;
-    operator_precedences[TK_GTEQ] = precedence::COMPARISON;
-    operator_precedences[TK_PLUS] = precedence::ADDSUB;
-    operator_precedences[TK_MINUS] = precedence::ADDSUB;
-    operator_precedences[TK_ASTERISK] = precedence::MULDIVMOD;
-    operator_precedences[TK_MOD] = precedence::MULDIVMOD;
-    operator_precedences[TK_SLASH] = precedence::MULDIVMOD;
-    operator_precedences[TK_BANG] = precedence::PREFIX;
-    operator_precedences[TK_TILDE] = precedence::PREFIX;
+// How tightly an operator holds the operands on each side of it. 0 on the left means
+// the token is not an infix operator. Left associative operators hold their right
+// operand tighter than their left, right associative ones the other way around
+struct binding_power {
+    u8 left = 0;
+    u8 right = 0;
+};
+
+static constexpr binding_power infix(prec_e prec) {
+    return { static_cast<u8>(2 * prec), static_cast<u8>(2 * prec + 1) };
 }
 
-/// @brief Get the precedence of the operator being 
-precedence Parser::get_operator_precedence(const token& tok) const {
-    if (operator_precedences.find(tok.kind) != operator_precedences.end()) {
-        return operator_precedences.find(tok.kind)->second;
-    }
+static constexpr binding_power infix_right(prec_e prec) {
+    return { static_cast<u8>(2 * prec + 1), static_cast<u8>(2 * prec) };
+}
 
-    return precedence::INVALID_OP;
+static constexpr std::array<binding_power, TK_EOF + 1> INFIX_BINDING = [] {
+    std::array<binding_power, TK_EOF + 1> table {};
+    table[TK_ASSIGN] = infix_right(precedence::ASSIGN);
+    table[TK_TIMESEQ] = infix_right(precedence::ASSIGN);
+    table[TK_DIVEQ] = infix_right(precedence::ASSIGN);
+    table[TK_MODEQ] = infix_right(precedence::ASSIGN);
+    table[TK_PLUSEQ] = infix_right(precedence::ASSIGN);
+    table[TK_MINUSEQ] = infix_right(precedence::ASSIGN);
+    table[TK_LOG_OR] = infix(precedence::LOGICAL_OR_AND);
+    table[TK_LOG_AND] = infix(precedence::LOGICAL_OR_AND);
+    table[TK_EQUALTO] = infix(precedence::COMPARISON);
+    table[TK_NEQUALTO] = infix(precedence::COMPARISON);
+    table[TK_LT] = infix(precedence::COMPARISON);
+    table[TK_GT] = infix(precedence::COMPARISON);
+    table[TK_LTEQ] = infix(precedence::COMPARISON);
+    table[TK_GTEQ] = infix(precedence::COMPARISON);
+    table[TK_PLUS] = infix(precedence::ADDSUB);
+    table[TK_MINUS] = infix(precedence::ADDSUB);
+    table[TK_ASTERISK] = infix(precedence::MULDIVMOD);
+    table[TK_MOD] = infix(precedence::MULDIVMOD);
+    table[TK_SLASH] = infix(precedence::MULDIVMOD);
+    table[TK_LSHIFT] = infix(precedence::BITSHIFT);
+    table[TK_RSHIFT] = infix(precedence::BITSHIFT);
+    return table;
+}();
+
+// A prefix operator holds its operand tighter than any infix operator
+static constexpr u8 PREFIX_BINDING = 2 * precedence::PREFIX;
+
+
+/// @brief How tightly tok binds as an infix operator. left is 0 if it is not one
+static binding_power infix_binding(const token& tok) {
+    return INFIX_BINDING[tok.kind];
 }
 
 /// @brief Determine if token is a valid prefix operator
-/// @returns Precedence if it is, INVALID_OP if not
-prec_e Parser::is_prefix_op(const token& tok) const {
+static bool is_prefix_op(const token& tok) {
     switch (tok.kind) {
         case TK_TILDE:
         case TK_MINUS:
         case TK_BANG:
-            return precedence::PREFIX;
+            return true;
         default:
-            return precedence::INVALID_OP;
+            return false;
+    }
+}
+
+/// @brief Determine if token can name a type: a builtin type keyword or a user type identifier
+bool Parser::is_type_specifier(const token& tok) const {
+    switch (tok.kind) {
+        case TK_IDENT:
+        case TK_TYPESPEC_BYTE:
+        case TK_TYPESPEC_I8:
+        case TK_TYPESPEC_I16:
+        case TK_TYPESPEC_I32:
+        case TK_TYPESPEC_I64:
+        case TK_TYPESPEC_F32:
+        case TK_TYPESPEC_F64:
+        case TK_TYPESPEC_U8:
+        case TK_TYPESPEC_U16:
+        case TK_TYPESPEC_U32:
+        case TK_TYPESPEC_U64:
+        case TK_TYPESPEC_BOOL:
+            return true;
+        default:
+            return false;
     }
 }
 
@@ -61,17 +101,79 @@ Parser Parser::create_new(Tokenizer* lexer) {
     Parser p = Parser();
     p.m_lexer = lexer;
     p.m_ast = AST::create_new();
+    p.m_context.file = lexer->get_file();
+    p.m_context.module = lexer->get_file()->module;
 
-    p.m_peek_token = p.m_lexer->next_token();
-    p.eat();
+    p.m_error_node = p.m_ast->error_node(p.m_context);
+    p.m_error_expr = p.m_ast->error_expr(p.m_context);
+
+    p.m_current_token = p.peek(0);
     // std::printf("1st token: %s\n", token::kind_to_str(p.m_current_token.kind).c_str());
 
     return p;
 }
 
+/// @brief Create a new parser that reads its tokens from a queue filled on another thread.
+///        The lexer that produced them is only asked for the values of number literals
+Parser Parser::create_new(Tokenizer* lexer, TokenQueue* input) {
+    Parser p = Parser();
+    p.m_lexer = lexer;
+    p.m_input = input;
+    p.m_ast = AST::create_new();
+    p.m_context.file = lexer->get_file();
+    p.m_context.module = lexer->get_file()->module;
+    p.m_error_node = p.m_ast->error_node(p.m_context);
+    p.m_error_expr = p.m_ast->error_expr(p.m_context);
+
+    p.m_current_token = p.peek(0);
+
+    return p;
+}
+
+
+/// @brief Create a new parser over tokens that are already lexed. They are read in
+///        place, so they must outlive the parser. They need not end in TK_EOF, the
+///        parser acts as if one came after them. The lexer that produced them is
+///        only asked for the values of number literals
+/// @param ast The tree to put the nodes in. A new one when nullptr
+Parser Parser::create_new(Tokenizer* lexer, std::span<const token> tokens, std::shared_ptr<AST> ast) {
+    Parser p = Parser();
+    p.m_lexer = lexer;
+    p.m_ast = ast != nullptr ? std::move(ast) : AST::create_new();
+    p.m_context.file = lexer->get_file();
+    p.m_context.module = lexer->get_file()->module;
+    p.m_error_node = p.m_ast->error_node(p.m_context);
+    p.m_error_expr = p.m_ast->error_expr(p.m_context);
+
+    p.m_view = tokens;
+    if (!tokens.empty() && tokens.back().kind == TK_EOF) {
+        p.m_eof = tokens.back();
+    } else {
+        u32 end = tokens.empty() ? 0 : tokens.back().offset + tokens.back().length;
+        p.m_eof = token::create_new(TK_EOF, end, 0);
+    }
+    p.m_lexer_done = true;
+
+    p.m_current_token = p.peek(0);
+
+    return p;
+}
+
 
-/// @brief Parse a code statement
+/// @brief Parse a code statement. The body of a statement that has one is
+///        parsed by the same loop as every other block, not by recursing
 ResultNode Parser::parse_statement() {
+    u64 base = m_open_blocks.size();
+    ResultNode node = open_statement();
+    parse_open_blocks(base);
+    return node;
+}
+
+
+/// @brief Parse a statement up to its body. A statement without a body is parsed
+///        whole. A statement with one has its body opened on the block stack, and
+///        parse_open_blocks fills it and finishes the statement
+ResultNode Parser::open_statement() {
     switch(m_current_token.kind) {
         case TK_LET: {
             // std::printf("Parsing let statement\n");
@@ -91,9 +193,8 @@ ResultNode Parser::parse_statement() {
             return parse_while_statement();
         } break;
         case TK_DO: {
-            ResultNode node = parse_do_while_statement();
-            (void) eat(TK_SEMICOLON);
-            return node;
+            // The ';' after the condition is eaten when the body closes
+            return parse_do_while_statement();
         } break;
         case TK_FOR: {
             return parse_for_statement();
@@ -113,28 +214,118 @@ ResultNode Parser::parse_statement() {
 ///      ...
 /// }
 ResultNode Parser::parse_scope() {
-    CodeBlockStatementNode* scope = new CodeBlockStatementNode();
-    (void) eat(TK_LSQUIRLY);
+    u64 base = m_open_blocks.size();
+    CodeBlockStatementNode* scope = open_block(nullptr);
+    parse_open_blocks(base);
+    return result::Ok(scope);
+}
+
+
+/// @brief Start a block. Statements go in it until its '}'
+/// @param owner The statement the block is the body of, nullptr for a block on its own
+CodeBlockStatementNode* Parser::open_block(ASTNode* owner) {
+    CodeBlockStatementNode* block = make_node<CodeBlockStatementNode>();
+    if (eat(TK_LSQUIRLY)) {
+        // Whatever went wrong in the header ends at the start of the body
+        m_panicking = false;
+    }
+    m_open_blocks.push_back({ block, owner });
+    return block;
+}
 
-    // Parse all the statements
-    while (m_current_token.kind != TK_RSQUIRLY) {
-        auto stmt_res = parse_statement();
-        if (stmt_res.is_err()) {
-            std::cout << "2" << std::endl;
-            error_msgs.push_back(stmt_res.unwrap_err());
+
+/// @brief Parse statements into the innermost open block until every block above
+///        base is closed. Nesting costs an entry on the block stack, not a call frame
+void Parser::parse_open_blocks(u64 base) {
+    while (m_open_blocks.size() > base) {
+        if (m_current_token.kind == TK_RSQUIRLY) {
+            (void) eat(TK_RSQUIRLY);
+            ASTNode* owner = m_open_blocks.back().owner;
+            m_open_blocks.pop_back();
+            close_block(owner);
+            if (m_panicking) {
+                synchronize();
+            }
+            continue;
         }
-        ASTNode* stmt = stmt_res.unwrap_or(
-            new ASTNode(NodeKind::AST_INVALID_NODE)
-        );
+
+        // A block can not hold a declaration, so reaching one, or the end of the file,
+        // means the '}' of this block is missing, and so is that of every block it is
+        // in. Close them all and leave the declaration to be parsed at the top level
+        token_kind kind = m_current_token.kind;
+        if (kind == TK_EOF || kind == TK_DEFINE || kind == TK_STRUCT) {
+            Location at = m_current_token.location(m_context.file);
+            (void) error(
+                "Parser::parse_open_blocks: expected '}' but got '{}' at {}:{}",
+                token::kind_to_str(kind),
+                at.line,
+                at.character
+            );
+            m_open_blocks.resize(base);
+            return;
+        }
+
+        // The statement belongs to this block even when it opens a body of its own
+        CodeBlockStatementNode* scope = m_open_blocks.back().block;
+        auto stmt_res = open_statement();
+        ASTNode* stmt = stmt_res.unwrap_or(m_error_node);
         scope->add_stmt(stmt);
+
+        // A statement that went wrong takes its own tokens with it. A statement that
+        // could not even start is skipped whole, so the loop always moves forward
+        if (m_panicking) {
+            synchronize();
+        }
     }
+}
 
-    (void) eat(TK_RSQUIRLY);
-    return result::Ok(scope);
+
+/// @brief Finish the statement whose body was just closed
+void Parser::close_block(ASTNode* owner) {
+    if (owner == nullptr) {
+        return;
+    }
+
+    switch (owner->kind) {
+        case AST_CONDITIONAL: {
+            ConditionalStatementNode* condition_node = cast<ConditionalStatementNode>(owner);
+            // Else marks the end of the conditional chain -- no further parsing
+            if (condition_node->get_variant().kind == TK_ELSE) {
+                break;
+            }
+
+            switch (m_current_token.kind) {
+                case TK_ELIF: { // elif clause
+                    ResultNode r_elif_node = parse_elif_statement();
+                    condition_node->set_else_clause(r_elif_node.unwrap_or_else([this] { return make_node<ConditionalStatementNode>(); }));
+                } break;
+                case TK_ELSE: { // else clause
+                    ResultNode r_else_node = parse_else_statement();
+                    condition_node->set_else_clause(r_else_node.unwrap_or_else([this] { return make_node<ConditionalStatementNode>(); }));
+                } break;
+                default:
+                    condition_node->set_else_clause(nullptr);
+                    break;
+            }
+        } break;
+        case AST_DO_WHILE_LOOP: {
+            DoWhileLoopStatementNode* do_while_node = cast<DoWhileLoopStatementNode>(owner);
+            (void) eat(TK_WHILE);
+
+            ResultNode r_condition = parse_expr();
+            ExpressionNode* condition = 
+                static_cast<ExpressionNode*>(r_condition.unwrap_or(m_error_expr));
+            do_while_node->set_condition(condition);
+            (void) eat(TK_SEMICOLON);
+        } break;
+        default:
+            break;
+    }
 }
 
 
-/// @brief Parse an if statement
+/// @brief Parse an if statement up to its body. The elif and else
+///        clauses are parsed when the body closes
 /// Represents a conditional statement
 /// if (condition) {
 ///  ...
@@ -144,91 +335,37 @@ ResultNode Parser::parse_scope() {
 ///  ...
 /// }
 ResultNode Parser::parse_if_statement() {
-    ConditionalStatementNode* condition_node = new ConditionalStatementNode();
+    ConditionalStatementNode* condition_node = make_node<ConditionalStatementNode>();
     // condition_node->tok = m_current_token;
     condition_node->set_variant(m_current_token);
 
     (void) eat(TK_IF);
 
     ResultNode r_condition = parse_expr();
-    if (r_condition.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(
-                error_type::PARSER_ERR,
-                "Parser::parse_if_statement: unable to parse condition expression"
-            )
-        );
-    }
     ExpressionNode* condition = 
-        static_cast<ExpressionNode*>(r_condition.unwrap_or(new ExpressionNode()));
+        static_cast<ExpressionNode*>(r_condition.unwrap_or(m_error_expr));
     // condition_node->condition = condition;
     condition_node->set_condition(condition);
 
-    // Parse the code body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        error_msgs.push_back(r_body.unwrap_err());
-    }
-    CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
-    condition_node->set_body(body);
-
-    switch (m_current_token.kind) {
-        case TK_ELIF: { // elif clause
-            ResultNode r_elif_node = parse_elif_statement();
-            if (r_elif_node.is_err()) {
-                error_msgs.push_back(r_elif_node.unwrap_err());
-            }
-            ConditionalStatementNode* elif_node = 
-                static_cast<ConditionalStatementNode*>(r_elif_node.unwrap_or(new ConditionalStatementNode()));
-
-            condition_node->set_else_clause(elif_node);
-        } break;
-        case TK_ELSE: { // else clause
-            ResultNode r_else_node = parse_else_statement();
-            if (r_else_node.is_err()) {
-                error_msgs.push_back(r_else_node.unwrap_err());
-            }
-            ConditionalStatementNode* else_node = 
-                static_cast<ConditionalStatementNode*>(r_else_node.unwrap_or(new ConditionalStatementNode()));
-
-            condition_node->set_else_clause(else_node);
-        } break;
-        default:
-            condition_node->set_else_clause(nullptr);
-            break;
-    }
+    // Open the code body
+    condition_node->set_body(open_block(condition_node));
 
     return result::Ok(condition_node);
 }
 
 
-/// @brief Parse a while loop statement
+/// @brief Parse a while loop statement up to its body
 ResultNode Parser::parse_while_statement() {
-    WhileLoopStatementNode* while_loop_node = new WhileLoopStatementNode();
+    WhileLoopStatementNode* while_loop_node = make_node<WhileLoopStatementNode>();
     (void) eat(TK_WHILE);
 
     ResultNode r_condition = parse_expr();
-    if (r_condition.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(
-                error_type::PARSER_ERR,
-                "Parser::parse_if_statement: unable to parse condition expression"
-            )
-        );
-    }
     ExpressionNode* condition = 
-        static_cast<ExpressionNode*>(r_condition.unwrap_or(new ExpressionNode()));
+        static_cast<ExpressionNode*>(r_condition.unwrap_or(m_error_expr));
     while_loop_node->set_condition(condition);
 
-    // Parse the code body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        error_msgs.push_back(r_body.unwrap_err());
-    }
-    CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
-    while_loop_node->set_body(body);
+    // Open the code body
+    while_loop_node->set_body(open_block(while_loop_node));
     
     return result::Ok(while_loop_node);
 }
@@ -237,164 +374,86 @@ ResultNode Parser::parse_while_statement() {
 /// @brief Parse an expression statement
 /// i = 22 + 4;
 ResultNode Parser::parse_expression_statement() {
-    ExpressionStatementNode* expr_stmt = new ExpressionStatementNode();
+    ExpressionStatementNode* expr_stmt = make_node<ExpressionStatementNode>();
     ResultNode r_expr = parse_expr();
-    if (r_expr.is_err()) {
-        error_msgs.push_back(r_expr.unwrap_err());
-    }
     ExpressionNode* expr = 
-        static_cast<ExpressionNode*>(r_expr.unwrap_or(new ExpressionNode()));
+        static_cast<ExpressionNode*>(r_expr.unwrap_or(m_error_expr));
 
     expr_stmt->set_expr(expr);
     return result::Ok(expr_stmt);
 }
 
-/// @brief Parse a do-while loop statement
+/// @brief Parse a do-while loop statement up to its body.
+///        The condition is parsed when the body closes
 /// do {
 ///     ...
 /// } while (condition);
 ResultNode Parser::parse_do_while_statement() {
-    DoWhileLoopStatementNode* do_while_node = new DoWhileLoopStatementNode();
+    DoWhileLoopStatementNode* do_while_node = make_node<DoWhileLoopStatementNode>();
     (void) eat(TK_DO);
 
-    // Parse code block body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        error_msgs.push_back(r_body.unwrap_err());
-    }
-    CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
-    do_while_node->set_body(body);
-
-    (void) eat(TK_WHILE);
-    
-    ResultNode r_condition = parse_expr();
-    if (r_condition.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(
-                error_type::PARSER_ERR,
-                "Parser::parse_if_statement: unable to parse condition expression"
-            )
-        );
-    }
-    ExpressionNode* condition = 
-        static_cast<ExpressionNode*>(r_condition.unwrap_or(new ExpressionNode()));
-    do_while_node->set_condition(condition);
+    // Open the code block body
+    do_while_node->set_body(open_block(do_while_node));
 
     return result::Ok(do_while_node);
 }
 
 
-/// @brief Parse a for loop statement
+/// @brief Parse a for loop statement up to its body
 /// for (init; condition; action) {...}
 /// for (let i: i32 = 0; i < 10; i += 1) {...}
 ResultNode Parser::parse_for_statement() {
-    ForLoopStatementNode* for_node = new ForLoopStatementNode();
+    ForLoopStatementNode* for_node = make_node<ForLoopStatementNode>();
     (void) eat(TK_FOR);
     (void) eat(TK_LPAREN);
 
     // Parse the initialization
     ResultNode r_init_node = parse_statement();
-    if (r_init_node.is_err()) {
-        error_msgs.push_back(r_init_node.unwrap_err());
-    }
-    ASTNode* init_node = r_init_node.unwrap_or(new ASTNode());
+    ASTNode* init_node = r_init_node.unwrap_or(m_error_node);
 
     // Parse the condition
     ResultNode r_condition = parse_expr();
-    if (r_init_node.is_err()) {
-        error_msgs.push_back(r_init_node.unwrap_err());
-    }
     ExpressionNode* condition = 
-        static_cast<ExpressionNode*>(r_condition.unwrap_or(new ExpressionNode()));
+        static_cast<ExpressionNode*>(r_condition.unwrap_or(m_error_expr));
     (void) eat(TK_SEMICOLON);
 
     // Parse the action
     ResultNode r_action_node = parse_expression_statement();
-    if (r_action_node.is_err()) {
-        error_msgs.push_back(r_action_node.unwrap_err());
-    }
-    ASTNode* action_node = r_action_node.unwrap_or(new ASTNode());
+    ASTNode* action_node = r_action_node.unwrap_or(m_error_node);
     (void) eat(TK_RPAREN);
 
-    // Parse code body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        std::cout << "1" << std::endl;
-        error_msgs.push_back(r_body.unwrap_err());
-    }
-    CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
-
     for_node->set_initialization(init_node);
     for_node->set_condition(condition);
     for_node->set_action(action_node);
-    for_node->set_body(body);
+
+    // Open the code body
+    for_node->set_body(open_block(for_node));
 
     return result::Ok(for_node);
 }
 
 
-/// @brief Parse elif clause portion of a conditional
+/// @brief Parse elif clause portion of a conditional up to its body
 ResultNode Parser::parse_elif_statement() {
-    ConditionalStatementNode* elif_node = new ConditionalStatementNode();
+    ConditionalStatementNode* elif_node = make_node<ConditionalStatementNode>();
     elif_node->set_variant(m_current_token);
     (void) eat(TK_ELIF);
 
     ResultNode r_condition = parse_expr();
-    if (r_condition.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(
-                error_type::PARSER_ERR,
-                "Parser::parse_if_statement: unable to parse condition expression"
-            )
-        );
-    }
     ExpressionNode* condition = 
-        static_cast<ExpressionNode*>(r_condition.unwrap_or(new ExpressionNode()));
+        static_cast<ExpressionNode*>(r_condition.unwrap_or(m_error_expr));
     elif_node->set_condition(condition);
 
-    // Parse the code body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        error_msgs.push_back(r_body.unwrap_err());
-    }
-    CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
-    elif_node->set_body(body);
-
-    switch (m_current_token.kind) {
-        case TK_ELIF: { // elif clause
-            ResultNode r_elif_node = parse_elif_statement();
-            if (r_elif_node.is_err()) {
-                error_msgs.push_back(r_elif_node.unwrap_err());
-            }
-            ConditionalStatementNode* node = 
-                static_cast<ConditionalStatementNode*>(r_elif_node.unwrap_or(new ConditionalStatementNode()));
-
-            elif_node->set_else_clause(node);
-        } break;
-        case TK_ELSE: { // else clause
-            ResultNode r_elif_node = parse_else_statement();
-            if (r_elif_node.is_err()) {
-                error_msgs.push_back(r_elif_node.unwrap_err());
-            }
-            ConditionalStatementNode* node = 
-                static_cast<ConditionalStatementNode*>(r_elif_node.unwrap_or(new ConditionalStatementNode()));
+    // Open the code body
+    elif_node->set_body(open_block(elif_node));
 
-            elif_node->set_else_clause(node);
-        } break;
-        default:
-            elif_node->set_else_clause(nullptr);
-            break;
-    }
     return result::Ok(elif_node);
 }
 
 
-/// @brief Parse elif clause portion of a conditional
+/// @brief Parse else clause portion of a conditional up to its body
 ResultNode Parser::parse_else_statement() {
-    ConditionalStatementNode* else_node = new ConditionalStatementNode();
+    ConditionalStatementNode* else_node = make_node<ConditionalStatementNode>();
     else_node->set_variant(m_current_token);
     // else_node->tok = m_current_token;
     (void) eat(TK_ELSE);
@@ -402,19 +461,10 @@ ResultNode Parser::parse_else_statement() {
     // No condition for else claus
     else_node->set_condition(nullptr);
     // else_node->condition = nullptr;
-
-    // Parse the code body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        error_msgs.push_back(r_body.unwrap_err());
-    }
-    CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
-    else_node->set_body(body);
-    
     else_node->set_else_clause(nullptr);
 
-    // Else marks the end of the conditional chain -- no further parsing
+    // Open the code body
+    else_node->set_body(open_block(else_node));
 
     return result::Ok(else_node);
 }
@@ -422,18 +472,10 @@ ResultNode Parser::parse_else_statement() {
 
 /// @brief Parse the return statement
 ResultNode Parser::parse_return_statement() {
-    ReturnStatementNode* return_node = new ReturnStatementNode();
+    ReturnStatementNode* return_node = make_node<ReturnStatementNode>();
     (void) eat(TK_RETURN);
     ResultNode r_expr = parse_expr();
-    if (r_expr.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(
-                error_type::PARSER_ERR,
-                "Parser::parse_return_statement: unable to parse expression!"
-            )
-        );
-    }
-    ExpressionNode* expr = static_cast<ExpressionNode*>(r_expr.unwrap_or(new ExpressionNode()));
+    ExpressionNode* expr = static_cast<ExpressionNode*>(r_expr.unwrap_or(m_error_expr));
     return_node->set_expr(expr);
     // return_node->expr = expr;
     return result::Ok(return_node);
@@ -442,12 +484,6 @@ ResultNode Parser::parse_return_statement() {
 
 ResultNode Parser::parse_expr_primary() {
     switch(m_current_token.kind) {
-        // Unary or prefix expressions
-        case token_kind::TK_BANG:
-        case token_kind::TK_MINUS:
-        case token_kind::TK_TILDE:
-            return parse_expr_prefix();
-
         // Boolean Expression
         case token_kind::TK_TRUE: return parse_expr_boolean();
         case token_kind::TK_FALSE: return parse_expr_boolean();
@@ -456,12 +492,11 @@ ResultNode Parser::parse_expr_primary() {
         case token_kind::TK_NUM_FLOAT: return parse_expr_float();
         case token_kind::TK_NUM_INT: return parse_expr_integer();
         
-        case token_kind::TK_IDENT: return parse_expr_identifier();
-        
-        case token_kind::TK_LPAREN: return parse_expr_grouping();
         case token_kind::TK_STR: return parse_expr_str();
-        default:
-            return result::Err(VError::create_new(error_type::PARSER_ERR, "Parser::parse_expr_primary: Invalid token '{}' when parsing primary expression", token::kind_to_str(m_current_token.kind)));
+        default: {
+            Location at = m_current_token.location(m_context.file);
+            return result::Err(error("Parser::parse_expr_primary: Expected expression but got '{}' at {}:{}", text(m_current_token), at.line, at.character));
+        }
     }
 }
 
@@ -469,7 +504,7 @@ ResultNode Parser::parse_expr_primary() {
 /// @brief Parse a string literal expression
 /// "string example"
 ResultNode Parser::parse_expr_str() {
-    ExpressionStringLiteralNode* str_expr = new ExpressionStringLiteralNode();
+    ExpressionStringLiteralNode* str_expr = make_node<ExpressionStringLiteralNode>();
     token str = m_current_token;
     (void) eat(TK_STR);
    
@@ -481,253 +516,263 @@ ResultNode Parser::parse_expr_str() {
 
 
 
-/// @brief Parse a grouping expression.
-///        (1 + 3)
-///        (num_seconds * 4)
-ResultNode Parser::parse_expr_grouping() {
-    (void) eat(TK_LPAREN);
-    ResultNode expr =  parse_expr();
-    (void) eat(TK_RPAREN);
-    return expr;
-}
-
-
-/// @brief Parse an expression being passed to a procedure
-ResultNode Parser::parse_proc_argument() {
-    return parse_expr();
-}
-
-
-/// @brief Parse an identifier expression. This could
-///        be either a function call [foo(...)]
-///        or a variable reference [num_seconds]
-ResultNode Parser::parse_expr_identifier() {
-    token identifier = m_current_token;
-    (void) eat(TK_IDENT);
-
-    // See if we have a function call
-    if (m_current_token.kind == TK_LPAREN) {
-        (void) eat(TK_LPAREN);
-        ExpressionProcedureCallNode* call_expr = new ExpressionProcedureCallNode();
-        while (m_current_token.kind != TK_RPAREN) {
-            ResultNode r_arg_expr = parse_proc_argument();
-            if (r_arg_expr.is_err()) {
-                std::printf("COULD NOT PARSE ARG\n");
-                error_msgs.push_back(
-                    VError::create_new(error_type::PARSER_ERR, "Parser::parse_expr_identifier: unable to parse procedure argument")
-                );
-            }
-            ExpressionNode* arg_expr = static_cast<ExpressionNode*>(r_arg_expr.unwrap_or(new ExpressionNode()));
-            //call_expr->arguments.push_back(arg_expr);
-            call_expr->add_argument(arg_expr);
-
-            if (m_current_token.kind == TK_COMMA) {
-                (void) eat(TK_COMMA);
-            } else if (m_current_token.kind != TK_RPAREN) {
-                // If we do not read a comma, we need to read a ')'
-                // If we do not get that either, then this is an error
-                error_msgs.push_back(
-                    VError::create_new(
-                        error_type::PARSER_ERR, 
-                        "Expected to get ')' but got {}! when parsing procedure arguments!", 
-                        m_current_token.name
-                    )
-                );
-            }
-        }
-
-        (void) eat(TK_RPAREN);
-        call_expr->set_identifier(identifier);
-        // call_expr->identifier = identifier;
-        return result::Ok(call_expr);
-    } else if (m_current_token.kind == TK_LBRACKET) {
-        // Dimension access
-        // ident[expr]
-        (void) eat(TK_LBRACKET);
-        ResultNode r_expr = parse_expr();
-        (void) eat(TK_RBRACKET);
-
-        if (r_expr.is_err()) {
-            error_msgs.push_back(
-                VError::create_new(
-                    error_type::PARSER_ERR,
-                    "Parser::parse_identifier: unable to parse expression for [] access!"
-                )
-            );
-        }
-        
-        ExpressionNode* expr = static_cast<ExpressionNode*>(r_expr.unwrap_or(new ExpressionNode()));
-        ExpressionIdentifierNode* ident_expr = new ExpressionIdentifierNode();
-        // ident_expr->expr = expr;
-        ident_expr->set_expr(expr);
-        ident_expr->set_identifier(identifier);
-        // ident_expr->identifier = identifier;
-        return result::Ok(ident_expr);
-    } else if (m_current_token.kind == TK_DOT) {
-        // Member access
-        // test_struct.field;
-        // test_struct.method();
-        (void) eat(TK_DOT);
-        ResultNode r_access_expr = parse_expr_identifier();
-        if (r_access_expr.is_err()) {
-            error_msgs.push_back(
-                VError::create_new(
-                    error_type::PARSER_ERR,
-                    "Parser::parse_expr_identifier: error parsing member access"
-                )
-            );
-        }
-        ExpressionNode* access_expr = static_cast<ExpressionNode*>(r_access_expr.unwrap_or(new ExpressionNode()));
-        ExpressionMemberAccessNode* member_expr = new ExpressionMemberAccessNode();
-        member_expr->set_identifier(identifier);
-        member_expr->set_access(access_expr);
-
-        return result::Ok(member_expr);
-    }
-
-    // If not procedure call, then normal variable reference
-    ExpressionIdentifierNode* ident_expr = new ExpressionIdentifierNode();
-    ident_expr->set_identifier(identifier);
-    ident_expr->set_expr(nullptr);
-    
-    return result::Ok(ident_expr);
-}
-
-
 /// @brief Parse a true or false boolean expression
 ResultNode Parser::parse_expr_boolean() {
     token bool_tok;
     switch(m_current_token.kind) {
         case TK_TRUE:
-            bool_tok = eat(TK_TRUE).unwrap();
-            return result::Ok(new BooleanLiteralNode(true));
+            bool_tok = eat();
+            return result::Ok(make_node<BooleanLiteralNode>(true));
             break;
         case TK_FALSE:
-            bool_tok = eat(TK_FALSE).unwrap();
-            return result::Ok(new BooleanLiteralNode(false));
+            bool_tok = eat();
+            return result::Ok(make_node<BooleanLiteralNode>(false));
             break;
         default:
-            return result::Err(VError::create_new(error_type::PARSER_ERR, "Parser::parse_expr_boolean: expected true or false. Got {}", m_current_token.name));
+            return result::Err(error("Parser::parse_expr_boolean: expected true or false. Got {}", text(m_current_token)));
     }
 }
 
 /// @brief Parse an integer literal expression
 ResultNode Parser::parse_expr_integer() {
     token int_tok = m_current_token;
-    auto integer_res = eat(TK_NUM_INT);
-    integer_res.unwrap(); // we should only get here if a parent function read an integer literal,
-
+    (void) eat(TK_NUM_INT); // we should only get here if a parent function read an integer literal,
 
-    u64 value = std::atoi(int_tok.name.c_str());
-    return result::Ok(new IntegerLiteralNode(value));
+    // The tokenizer already decoded the literal
+    return result::Ok(make_node<IntegerLiteralNode>(m_lexer->integer_value(int_tok)));
 }
 
 
 /// @brief Parse a float literal expression
 ResultNode Parser::parse_expr_float() {
     token fp_tok = m_current_token;
-    auto float_res = eat(TK_NUM_FLOAT);
-    token float_tok = float_res.unwrap();
+    (void) eat(TK_NUM_FLOAT);
 
-    f64 value = std::atof(fp_tok.name.c_str());
-
-    return result::Ok(new FloatLiteralNode(value));
+    return result::Ok(make_node<FloatLiteralNode>(m_lexer->float_value(fp_tok)));
 }
 
 
-/// @brief Parse an expression
+/// @brief Parse an expression. Operators are applied with a Pratt loop over a heap
+///        stack of pending operators, so a long chain like a + b + ... + z costs
+///        one table lookup per operator and no recursion. Brackets go on the same
+///        stack, so groups, procedure arguments and indexes nest without recursing
+///        either
 ResultNode Parser::parse_expr() {
-    ResultNode r_lhs = parse_expr_primary();
-    if (r_lhs.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(
-                error_type::PARSER_ERR,
-                "Parser::parse_expr: Expected expression!"
-            )
-        );
-    }
-    ExpressionNode* lhs = static_cast<ExpressionNode*>(r_lhs.unwrap_or(new ExpressionNode()));
-  
-    /* See if we are at an infix (binary) operator.
-     * If so, parse a binary expression */
-    while (get_operator_precedence(m_current_token) != precedence::INVALID_OP) {
-        // std::printf("GOT OP\n");
-        r_lhs = parse_expr_binary(lhs, get_operator_precedence(m_current_token));
-        if (r_lhs.is_err()) {
-            error_msgs.push_back(
-                VError::create_new(error_type::PARSER_ERR, "Parser::parse_expr: Unable to parse rhs of binary expression!")
-            );
+    // Nested expressions share the stacks above where this one starts
+    u64 op_base = m_expr_ops.size();
+    u64 operand_base = m_expr_operands.size();
+    bool want_operand = true;
+
+    while (true) {
+        if (want_operand) {
+            want_operand = open_expr_operand();
+            continue;
+        }
+
+        binding_power power = infix_binding(m_current_token);
+        if (power.left != 0) {
+            // Everything pending that holds its right operand tighter takes it now
+            while (m_expr_ops.size() > op_base && power.left < m_expr_ops.back().right) {
+                reduce_expr();
+            }
+            m_expr_ops.push_back({ m_current_token, power.right, pending_kind::INFIX });
+            (void) eat();
+            want_operand = true;
+            continue;
         }
-        lhs = static_cast<ExpressionNode*>(r_lhs.unwrap_or(new ExpressionNode()));
+
+        // Not an operator. Apply everything inside the innermost bracket, then see
+        // whether the token closes it. With no bracket open the expression ends here
+        while (m_expr_ops.size() > op_base && m_expr_ops.back().right != 0) {
+            reduce_expr();
+        }
+        if (m_expr_ops.size() == op_base) {
+            break;
+        }
+        want_operand = close_expr_bracket();
     }
 
-    return result::Ok(lhs);
+    ExpressionNode* expr = m_expr_operands.back();
+    m_expr_operands.resize(operand_base);
+    return result::Ok(expr);
 }
 
 
-// @brief Parse expressions according to operator precedence
-// @param lhs The left-hand-side of the binary expression
-// @param min_prec The minimum precedence (binding) for the lhs expression
-//                 Basically, if we find an operator that "binds" tighter
-//                 we then parse that binary expression first and so on
-ResultNode Parser::parse_expr_binary(ExpressionNode* lhs, prec_e min_prec) {
-    token op = m_current_token;
-    // prec_e op_prec = get_operator_precedence(op);
-    (void) eat(); // eat the operator
-
-    ResultNode r_rhs = parse_expr_primary();
-    if (r_rhs.is_err()) {
-        error_msgs.push_back(
-            VError::create_new(error_type::PARSER_ERR, "Parser::parse_expr_binary: unable to parse RHS!")
-        );
+/// @brief Read what goes where an operand is expected: a prefix operator,
+///        an opening bracket or an operand
+/// @returns Whether an operand is still wanted
+bool Parser::open_expr_operand() {
+    token tok = m_current_token;
+    if (is_prefix_op(tok)) {
+        // !x
+        // ~x
+        m_expr_ops.push_back({ tok, PREFIX_BINDING, pending_kind::PREFIX });
+        (void) eat();
+        return true;
     }
-    ExpressionNode* rhs = static_cast<ExpressionNode*>(r_rhs.unwrap_or(new ExpressionNode()));
 
-    prec_e next_prec = get_operator_precedence(m_current_token);
-    if (next_prec > min_prec) {
-        r_rhs = parse_expr_binary(rhs, next_prec);
-        
-        if (r_rhs.is_err()) {
-            error_msgs.push_back(
-                VError::create_new(error_type::PARSER_ERR, "Parser::parse_expr_binary: unable to parse RHS!")
-            );
+    if (tok.kind == TK_LPAREN) {
+        // Grouping expression
+        // (1 + 3)
+        // (num_seconds * 4)
+        m_expr_ops.push_back({ tok, 0, pending_kind::GROUP });
+        (void) eat();
+        return true;
+    }
+
+    if (tok.kind == TK_IDENT) {
+        return open_expr_identifier();
+    }
+
+    ResultNode r_operand = parse_expr_primary();
+    m_expr_operands.push_back(static_cast<ExpressionNode*>(r_operand.unwrap_or(m_error_expr)));
+    return false;
+}
+
+
+/// @brief Read an identifier expression. This could
+///        be either a function call [foo(...)]
+///        or an indexed variable [values[i]]
+///        or a variable reference [num_seconds]
+///        or a member access [test_struct.field] ending in any of those
+/// @returns Whether a call or index was opened and its first operand is wanted
+bool Parser::open_expr_identifier() {
+    // Member access
+    // test_struct.field;
+    // test_struct.method();
+    // Every name before the last dot is the object of a member access whose
+    // access is the rest of the chain. The names wait in m_member_chain until
+    // the last one is finished
+    u32 chain_base = static_cast<u32>(m_member_chain.size());
+    token identifier = m_current_token;
+    (void) eat(TK_IDENT);
+    while (m_current_token.kind == TK_DOT) {
+        m_member_chain.push_back(identifier);
+        (void) eat(TK_DOT);
+        identifier = m_current_token;
+        (void) eat(TK_IDENT);
+    }
+
+    // See if we have a function call
+    if (m_current_token.kind == TK_LPAREN) {
+        ExpressionProcedureCallNode* call_expr = make_node<ExpressionProcedureCallNode>();
+        call_expr->set_identifier(identifier);
+        (void) eat(TK_LPAREN);
+        if (m_current_token.kind == TK_RPAREN) {
+            (void) eat(TK_RPAREN);
+            finish_expr_operand(call_expr, chain_base);
+            return false;
         }
-        rhs = static_cast<ExpressionNode*>(r_rhs.unwrap_or(new ExpressionNode()));
+        m_expr_ops.push_back({ identifier, 0, pending_kind::CALL, chain_base, call_expr });
+        return true;
     }
 
-    ExpressionBinaryNode* expr = new ExpressionBinaryNode();
-    expr->set_lhs(lhs);
-    expr->set_operator(op);
-    expr->set_rhs(rhs);
+    ExpressionIdentifierNode* ident_expr = make_node<ExpressionIdentifierNode>();
+    ident_expr->set_identifier(identifier);
+    ident_expr->set_expr(nullptr);
 
-    return result::Ok(expr);
+    if (m_current_token.kind == TK_LBRACKET) {
+        // Dimension access
+        // ident[expr]
+        (void) eat(TK_LBRACKET);
+        m_expr_ops.push_back({ identifier, 0, pending_kind::INDEX, chain_base, ident_expr });
+        return true;
+    }
+
+    // If not procedure call, then normal variable reference
+    finish_expr_operand(ident_expr, chain_base);
+    return false;
 }
 
 
-/// @brief Parse an expression with a prefix operator
-/// !x
-/// ~x
-ResultNode Parser::parse_expr_prefix() {
-    ExpressionPrefixNode* expr = new ExpressionPrefixNode();
-    token prefix = m_current_token;
-    if (!is_prefix_op(prefix)) {
-        return result::Err(VError::create_new(error_type::PARSER_ERR, "Invalid prefix operator {}. Did you mean ! or ~?", token::kind_to_str(prefix.kind)));
+/// @brief Push a finished operand, inside the member accesses that lead to it
+void Parser::finish_expr_operand(ExpressionNode* expr, u32 chain_base) {
+    while (m_member_chain.size() > chain_base) {
+        ExpressionMemberAccessNode* member_expr = make_node<ExpressionMemberAccessNode>();
+        member_expr->set_identifier(m_member_chain.back());
+        member_expr->set_access(expr);
+        m_member_chain.pop_back();
+        expr = member_expr;
     }
-  
-    expr->set_operator(prefix);
-    (void) eat(prefix.kind).unwrap();
-    
-    ResultNode r_RHS = parse_expr_primary();
-    expr->set_rhs(r_RHS);
+    m_expr_operands.push_back(expr);
+}
 
-    return result::Ok(expr);
+
+/// @brief Read the token after an operand while the innermost bracket is open:
+///        the comma before the next procedure argument, or the closing bracket.
+///        Anything else is missing the closing bracket, which is reported and
+///        treated as if it were there
+/// @returns Whether an operand is wanted next
+bool Parser::close_expr_bracket() {
+    pending_op bracket = m_expr_ops.back();
+    ExpressionNode* inner = m_expr_operands.back();
+
+    if (bracket.kind == pending_kind::CALL && m_current_token.kind == TK_COMMA) {
+        cast<ExpressionProcedureCallNode>(bracket.node)->add_argument(inner);
+        m_expr_operands.pop_back();
+        (void) eat(TK_COMMA);
+        return true;
+    }
+
+    token_kind closer = bracket.kind == pending_kind::INDEX ? TK_RBRACKET : TK_RPAREN;
+    if (m_current_token.kind == closer) {
+        (void) eat(closer);
+    } else {
+        (void) error(
+            "Expected to get '{}' but got {}! when parsing expression!", 
+            closer == TK_RBRACKET ? "]" : ")",
+            text(m_current_token)
+        );
+    }
+    m_expr_ops.pop_back();
+
+    switch (bracket.kind) {
+        case pending_kind::CALL:
+            cast<ExpressionProcedureCallNode>(bracket.node)->add_argument(inner);
+            m_expr_operands.pop_back();
+            finish_expr_operand(bracket.node, bracket.chain_base);
+            break;
+        case pending_kind::INDEX:
+            cast<ExpressionIdentifierNode>(bracket.node)->set_expr(inner);
+            m_expr_operands.pop_back();
+            finish_expr_operand(bracket.node, bracket.chain_base);
+            break;
+        default:
+            // The value of a group is the expression inside it
+            break;
+    }
+    return false;
+}
+
+
+/// @brief Apply the newest pending operator to the operands on top of the stack
+void Parser::reduce_expr() {
+    pending_op op = m_expr_ops.back();
+    m_expr_ops.pop_back();
+
+    ExpressionNode* rhs = m_expr_operands.back();
+    m_expr_operands.pop_back();
+
+    if (op.kind == pending_kind::PREFIX) {
+        ExpressionPrefixNode* expr = make_node<ExpressionPrefixNode>();
+        expr->set_operator(op.op);
+        expr->set_rhs(rhs);
+        m_expr_operands.push_back(expr);
+        return;
+    }
+
+    ExpressionBinaryNode* expr = make_node<ExpressionBinaryNode>();
+    expr->set_lhs(m_expr_operands.back());
+    expr->set_operator(op.op);
+    expr->set_rhs(rhs);
+    m_expr_operands.back() = expr;
 }
 
 
 /// @brief Parse the definition of a struct
 /// struct Ident
 ResultNode Parser::parse_struct() {
-    StructDefinitionNode* struct_node = new StructDefinitionNode();
+    StructDefinitionNode* struct_node = make_node<StructDefinitionNode>();
     (void) eat(TK_STRUCT);
     token identifier = m_current_token;
     struct_node->set_identifier(identifier);
@@ -735,18 +780,18 @@ ResultNode Parser::parse_struct() {
 
     // Read the definition body
     (void) eat(TK_LSQUIRLY);
-    while (m_current_token.kind != TK_RSQUIRLY) {
+    // Another struct, like the end of the file, means the '}' is missing
+    while (m_current_token.kind != TK_RSQUIRLY && m_current_token.kind != TK_EOF && m_current_token.kind != TK_STRUCT) {
         ResultNode r_field = parse_struct_member();
         if (r_field.is_err()) {
-            error_msgs.push_back(
-                VError::create_new(
-                    error_type::PARSER_ERR,
-                    "Parser::parse_struct: unable to parse member field or method!"
-                )
-            );
+            // Nothing of the member was read. Skip the token it could not start with
+            (void) eat();
         }
-        ASTNode* field = r_field.unwrap_or(new ASTNode());
+        ASTNode* field = r_field.unwrap_or(m_error_node);
         struct_node->add_field(field);
+        if (m_panicking) {
+            synchronize();
+        }
     }
 
     (void) eat(TK_RSQUIRLY);
@@ -758,7 +803,7 @@ ResultNode Parser::parse_struct_member() {
     switch (m_current_token.kind) {
         case TK_IDENT:
             {
-                StructMemberFieldNode* field_node = new StructMemberFieldNode();
+                StructMemberFieldNode* field_node = make_node<StructMemberFieldNode>();
                 
                 token identifier = m_current_token;
                 (void) eat(TK_IDENT);
@@ -767,15 +812,7 @@ ResultNode Parser::parse_struct_member() {
                 (void) eat(TK_DOUBLECOLON);
                 
                 ResultNode r_data_type = parse_data_type();
-                if (r_data_type.is_err()) {
-                    error_msgs.push_back(
-                        VError::create_new(
-                            error_type::PARSER_ERR,
-                            "Parser::parse_struct_member: unable to parse field data type"
-                        )
-                    );
-                }
-                ASTNode* data_type = r_data_type.unwrap_or(new ASTNode());
+                ASTNode* data_type = r_data_type.unwrap_or(m_error_node);
                 field_node->set_type_spec(data_type);
                 // field_node->type_spec = data_type;
 
@@ -786,19 +823,11 @@ ResultNode Parser::parse_struct_member() {
             break;
         case TK_DEFINE: {
             ResultNode r_method_node = parse_procedure();
-            if (r_method_node.is_err()) {
-                error_msgs.push_back(
-                    VError::create_new(
-                        error_type::PARSER_ERR,
-                        "Parser::parse_struct_member: unable to parse struct method!"
-                    )
-                );
-            }
-            ASTNode* method_node = r_method_node.unwrap_or(new ASTNode());
+            ASTNode* method_node = r_method_node.unwrap_or(m_error_node);
             return result::Ok(method_node);
         } break;
         default:
-            return result::Err(VError::create_new(error_type::PARSER_ERR, "Parser::parse_struct_member: invalid token {}. Exected either identifier or 'proc'.", m_current_token.name));
+            return result::Err(error("Parser::parse_struct_member: invalid token {}. Exected either identifier or 'proc'.", text(m_current_token)));
     }
 }
 
@@ -810,62 +839,22 @@ ResultNode Parser::parse_let_statement() {
     
     // Get the variable name
     token id_tok = m_current_token;
-    auto variable_ident_res = eat(TK_IDENT);
-    if (variable_ident_res.is_err()) {
-        error_msgs.push_back(variable_ident_res.unwrap_err());
-    }
-    auto variable_ident_tok = variable_ident_res.unwrap_or(token::create_new(TK_IDENT, "__%internal_ident_err", m_current_token.line_num));
-
-    auto colon_res = eat(TK_COLON);
-    if (colon_res.is_err()) {
-        auto err = VError::create_new(
-            error_type::PARSER_ERR, 
-            "Parser::parse_let_statement: expected ':' but got {}.", 
-            token::kind_to_str(m_current_token.kind)
-        );
-        error_msgs.push_back(err);
-    }
+    (void) eat(TK_IDENT);
+    (void) eat(TK_COLON);
 
     // Eat type specifier
     auto typespec_res = parse_data_type();
-    if (typespec_res.is_err()) {
-        auto err = VError::create_new(
-            error_type::PARSER_ERR, 
-            "Parser::parse_let_statement: expected return type but got {}.", 
-            token::kind_to_str(m_current_token.kind)
-        );
-        error_msgs.push_back(err);
-    }
     auto typespec_node = typespec_res.unwrap();
 
     // Eat the '='
-    auto assign_res = eat(token_kind::TK_ASSIGN);
-    if (assign_res.is_err()) {
-        auto err = VError::create_new(
-            error_type::PARSER_ERR, 
-            "Parser::parse_let_statement: expected '=' but got {}.", 
-            token::kind_to_str(m_current_token.kind)
-        );
-        error_msgs.push_back(err);
-    }
+    (void) eat(token_kind::TK_ASSIGN);
 
     // Parse the expression it is being assigned to
     auto expr_res = parse_expr();
-    if (expr_res.is_err()) {
-        auto err = VError::create_new(
-            error_type::PARSER_ERR, 
-            "Parser::parse_let_statement: Error parsing expression being assigned"
-        );
-        error_msgs.push_back(err);
-    }
-    auto expr_node = expr_res.unwrap_or(
-        new ASTNode(
-            NodeKind::AST_INVALID_NODE
-        )
-    );
+    auto expr_node = expr_res.unwrap_or(m_error_expr);
 
-    return result::Ok(new VariableDeclarationNode(
-        id_tok.name,
+    return result::Ok(make_node<VariableDeclarationNode>(
+        id_tok.payload,
         typespec_node,
         expr_node
     ));
@@ -877,77 +866,92 @@ ResultNode Parser::parse_let_statement() {
 ///
 /// proc ident(ident: type [, ident: type]*) {...}
 ResultNode Parser::parse_procedure() {
-    ProcedureNode *proc_node = new ProcedureNode();
+    ProcedureNode *proc_node = make_node<ProcedureNode>();
     
     // Get the 'proc' token 
-    token proc_token = m_current_token;
-    auto r_proc =  eat(TK_DEFINE);
-    if (r_proc.is_err()) {
-        auto proc_err = r_proc.unwrap_err();
-        error_msgs.push_back(proc_err);
-    }
-    token proc_tok = r_proc.unwrap_or(
-        token::create_new(TK_DEFINE, "__%internal_proc_err", m_current_token.line_num)
-    );
+    (void) eat(TK_DEFINE);
    
     // Eat the identifier
     token ident_tok = m_current_token;
-    auto identifier_res = eat(TK_IDENT);
-    if (identifier_res.is_err()) {
-        auto identifier_err = identifier_res.unwrap_err();
-        error_msgs.push_back(identifier_err);
-    }
-    proc_node->set_name(ident_tok.name);
+    (void) eat(TK_IDENT);
+    proc_node->set_name(ident_tok.payload);
 
-    (void) eat(TK_LPAREN).unwrap_or(token::create_new(TK_LPAREN, "__%internal_lparen_err", m_current_token.line_num));
+    (void) eat(TK_LPAREN);
     
-    // Parse the procedure parameters
-    while (m_current_token.kind != TK_RPAREN) {
-        auto param = parse_proc_parameter()
-            .unwrap_or(nullptr);
-
-        proc_node->add_parameter(param);
-        if (m_current_token.kind != TK_COMMA) {
-            if (m_current_token.kind == TK_RPAREN) {
+    // Parse the procedure parameters. Every parameter after the first
+    // eats a ',', so a list that never closes still ends
+    if (m_current_token.kind != TK_RPAREN) {
+        while (true) {
+            auto param = parse_proc_parameter()
+                .unwrap_or(nullptr);
+            proc_node->add_parameter(param);
+
+            if (m_current_token.kind != TK_COMMA) {
                 break;
             }
-            VError::create_new(
-                error_type::PARSER_ERR, 
-                "Parser::parse_proc_parameter: expected ',' but got '{}'", 
-                token::kind_to_str(m_current_token.kind)
-            );
+            (void) eat(TK_COMMA);
         }
-        
-        (void) eat(TK_COMMA).unwrap();
     }
    
-    (void) eat(TK_RPAREN).unwrap_or(token::create_new(TK_RPAREN, "__%internal_rparen_err", m_current_token.line_num));
-    (void) eat(TK_COLON).unwrap_or(token::create_new(TK_COLON, "__%internal_colon_err", m_current_token.line_num));
+    (void) eat(TK_RPAREN);
+    (void) eat(TK_COLON);
 
     // Get the return type specification
     auto return_type = parse_data_type().unwrap();
     proc_node->set_return_type(return_type);
 
-    // Parse the code body
-    ResultNode r_body = parse_scope();
-    if (r_body.is_err()) {
-        error_msgs.push_back(r_body.unwrap_err());
+    // Parse the code body. When skimming, only find where it ends. A header with
+    // an error has its body parsed, so it recovers the same as without skimming
+    if (m_skimming && !m_panicking && m_current_token.kind == TK_LSQUIRLY) {
+        skim_body(proc_node);
+        return result::Ok(proc_node);
     }
+    ResultNode r_body = parse_scope();
     CodeBlockStatementNode* body = 
-        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or(new CodeBlockStatementNode()));
+        static_cast<CodeBlockStatementNode*>(r_body.unwrap_or_else([this] { return make_node<CodeBlockStatementNode>(); }));
     proc_node->set_body(body);
     
     return result::Ok(proc_node);
 }
 
 
+/// @brief Step over a procedure body by matching its braces, building no nodes, and
+///        give the procedure the range of source it spans. A body missing its '}'
+///        ends where parse_open_blocks would give up on it: at a declaration or the
+///        end of the file
+void Parser::skim_body(ProcedureNode* proc) {
+    u32 begin = m_current_token.offset;
+    u32 end = begin;
+    u64 depth = 0;
+    while (true) {
+        token_kind kind = m_current_token.kind;
+        if (kind == TK_EOF || kind == TK_DEFINE || kind == TK_STRUCT) {
+            end = m_current_token.offset;
+            break;
+        }
+
+        end = m_current_token.offset + m_current_token.length;
+        (void) eat();
+        if (kind == TK_LSQUIRLY) {
+            depth++;
+        } else if (kind == TK_RSQUIRLY && --depth == 0) {
+            break;
+        }
+    }
+    proc->skim_body(m_ast.get(), begin, end);
+    m_ast->add_skimmed(proc, m_context.file->revision);
+}
+
+
 /// @brief Parse a data type: i32, u8, bool, etc.
 ResultNode Parser::parse_data_type() {
-    ASTNode* node = new ASTNode();
+    ASTNode* node = make_node<ASTNode>(AST_DATA_TYPE);
     token dt_tok = m_current_token;
-    auto r_dt_tok = eat(TK_IDENT).unwrap_or(
-        token::create_new(TK_IDENT, "__%internal_data_type", m_current_token.line_num)
-    );
+    if (is_type_specifier(dt_tok)) {
+        (void) eat();
+    } else {
+        (void) eat(TK_IDENT);
+    }
     node->tok = dt_tok;
 
     return result::Ok(node);
@@ -958,27 +962,22 @@ ResultNode Parser::parse_data_type() {
 /// Return the ASTNode for it if successful, VError otherwise
 /// proc ident(ident: type, ident: type) {...}
 ResultNode Parser::parse_proc_parameter() {
-    ProcParameter* node = new ProcParameter();
+    ProcParameter* node = make_node<ProcParameter>();
     token id_tok = m_current_token;
     
     // Eat the first identifier
-    auto ident_res = eat(TK_IDENT);
-    if (ident_res.is_err()) {
-        error_msgs.push_back(ident_res.unwrap_err());
-    }
-    token identifier_token = ident_res.unwrap_or(
-        token::create_new(TK_IDENT, "__%internal_ident_err", m_current_token.line_num)
-    );
-    node->set_name(id_tok.name);
+    (void) eat(TK_IDENT);
+    node->set_name(id_tok.payload);
 
     // Eat the ":"
-    (void) eat(TK_COLON).unwrap();
+    (void) eat(TK_COLON);
 
     // Eat the type specifier
     token type_tok = m_current_token;
-    auto type_res = eat(TK_IDENT);
-    if (type_res.is_err()) {
-        error_msgs.push_back(type_res.unwrap_err());
+    if (is_type_specifier(type_tok)) {
+        (void) eat();
+    } else {
+        (void) eat(TK_IDENT);
     }
     node->set_data_type(type_tok);
 
@@ -986,7 +985,24 @@ ResultNode Parser::parse_proc_parameter() {
 }
 
 
-/// @brief Parse the tokens and generate the AST
+/// @brief Parse like parse, but leave every procedure body, methods included, to
+///        be parsed when it is first asked for (see ProcedureNode::get_body), into
+///        the tree skim returns. On source without syntax errors it is the same
+///        tree parse builds
+std::shared_ptr<AST> Parser::skim() {
+    m_skimming = true;
+    return parse();
+}
+
+
+/// @brief Parse the tokens as the one code block a skimmed procedure body is
+CodeBlockStatementNode* Parser::parse_skimmed_body() {
+    return cast<CodeBlockStatementNode>(parse_scope().unwrap());
+}
+
+
+/// @brief Parse the tokens and generate the AST. A declaration that fails
+///        to parse is reported, and parsing goes on from the next one
 /// @returns the Abstract Syntax tree
 std::shared_ptr<AST> Parser::parse() {
     /* Parse at the top level  of file */
@@ -1010,16 +1026,35 @@ std::shared_ptr<AST> Parser::parse() {
 //                break;
 //        }
 //    }
-    auto node = parse_top_level_statement();
-    while (node.has_value()
-           && node.value()->kind != AST_INVALID_NODE
-    ) {
-        node = parse_top_level_statement();
+    while (parse_declaration().has_value()) {}
+
+    // Let the stages feeding a queue stop if parsing ended before the input did
+    if (m_input != nullptr && !m_lexer_done) {
+        m_input->close();
     }
-    
     return m_ast;
 }
 
+/// @brief Parse one top-level statement. Whatever is left of a declaration that
+///        went wrong part way is skipped, so the parser is left at the start of the
+///        next statement, in the same state as at the start of the file
+/// @returns The node of the statement, or nothing at the end of the input
+std::optional<ASTNode*> Parser::parse_declaration() {
+    std::optional<ASTNode*> node = parse_top_level_statement();
+    if (node.has_value() && m_panicking) {
+        skip_to_declaration();
+    }
+    return node;
+}
+
+
+/// @brief Index of the current token in the input. Only meaningful for a parser
+///        over a span of tokens, which keeps every token of its input
+u64 Parser::position() const {
+    return m_cursor;
+}
+
+
 std::optional<ASTNode*> Parser::parse_top_level_statement() {
     if (m_current_token.kind == TK_EOF) {
         return std::nullopt;
@@ -1044,64 +1079,207 @@ std::optional<ASTNode*> Parser::parse_top_level_statement() {
             return node;
         } break;
         default: {
-            ASTNode* node = new ASTNode(AST_INVALID_NODE);
-            return node;
+            Location at = m_current_token.location(m_context.file);
+            (void) error(
+                "Parser::parse_top_level_statement: expected a procedure, struct or variable declaration but got '{}' at {}:{}",
+                text(m_current_token),
+                at.line,
+                at.character
+            );
+            skip_to_declaration();
+            return m_error_node;
         } break;
     }
 }
 
 
+/// @brief Leave panic mode after a statement that failed to parse. Skips to just
+///        past a ';', or to a token the enclosing block can go on from: a '}', a
+///        keyword that starts a statement or declaration, or the end of the file.
+///        Braces opened in what is skipped are skipped up to their '}'
+void Parser::synchronize() {
+    m_panicking = false;
+    u32 depth = 0;
+    while (true) {
+        switch (m_current_token.kind) {
+            case TK_EOF:
+            case TK_DEFINE:
+            case TK_STRUCT:
+                return;
+            case TK_LET:
+            case TK_RETURN:
+            case TK_IF:
+            case TK_WHILE:
+            case TK_DO:
+            case TK_FOR:
+                if (depth == 0) {
+                    return;
+                }
+                break;
+            case TK_SEMICOLON:
+                if (depth == 0) {
+                    (void) eat();
+                    return;
+                }
+                break;
+            case TK_LSQUIRLY:
+                depth++;
+                break;
+            case TK_RSQUIRLY:
+                if (depth == 0) {
+                    return;
+                }
+                depth--;
+                break;
+            default:
+                break;
+        }
+        (void) eat();
+    }
+}
+
+
+/// @brief Leave panic mode at the top level. Skips to the next procedure, struct,
+///        or variable declaration outside of any braces, or to the end of the file
+void Parser::skip_to_declaration() {
+    m_panicking = false;
+    u32 depth = 0;
+    while (true) {
+        switch (m_current_token.kind) {
+            case TK_EOF:
+            case TK_DEFINE:
+            case TK_STRUCT:
+                return;
+            case TK_LET:
+                if (depth == 0) {
+                    return;
+                }
+                break;
+            case TK_LSQUIRLY:
+                depth++;
+                break;
+            case TK_RSQUIRLY:
+                if (depth > 0) {
+                    depth--;
+                }
+                break;
+            default:
+                break;
+        }
+        (void) eat();
+    }
+}
+
+
+/// @brief Whether an error found now would be reported. Nothing is while the
+///        parser is in panic mode, or once it has reported MAX_ERRORS
+bool Parser::reporting() const {
+    return !m_panicking && error_msgs.size() < MAX_ERRORS;
+}
+
+
+/// @brief What a parse function that failed returns when its error was not reported
+VError Parser::suppressed_error() {
+    static ErrorStore store;
+    static const VError suppressed = store.report(
+        error_type::PARSER_ERR,
+        "Parser: error not reported, it followed another one"
+    );
+    return suppressed;
+}
+
+
+/// @brief Syntax errors the parse reported, in the order it found them
+const std::vector<VError>& Parser::errors() const {
+    return error_msgs;
+}
+
+
+/// @brief Text of a token in the file being parsed
+std::string_view Parser::text(const token& tok) const {
+    return tok.text(m_context.file);
+}
+
+
 /// @brief Look at the next token in the stream without advancing the current token
 token Parser::peek_token() {
-    // return m_lexer->peek_token();
-    return m_peek_token;
+    return peek(1);
+}
+
+
+/// @brief Look at the token ahead tokens past the current one. Past the end of the input it is TK_EOF
+const token& Parser::peek(u32 ahead) {
+    if (m_cursor + ahead >= m_view.size()) {
+        fetch_tokens(ahead);
+        if (m_cursor + ahead >= m_view.size()) {
+            return m_eof;
+        }
+    }
+    return m_view[m_cursor + ahead];
+}
+
+
+/// @brief Take batches from the lexer until the token ahead tokens past the current one is buffered.
+///        Consumed tokens are dropped before a batch is added, so the buffer stays a couple of batches long
+void Parser::fetch_tokens(u32 ahead) {
+    while (!m_lexer_done && m_cursor + ahead >= m_tokens.size()) {
+        if (m_cursor >= Tokenizer::TOKEN_BATCH) {
+            m_tokens.erase(m_tokens.begin(), m_tokens.begin() + m_cursor);
+            m_cursor = 0;
+        }
+
+        u64 filled = m_tokens.size();
+        m_tokens.resize(filled + Tokenizer::TOKEN_BATCH);
+        u32 count = m_input != nullptr
+            ? m_input->pop(m_tokens.data() + filled, Tokenizer::TOKEN_BATCH)
+            : m_lexer->next_tokens(m_tokens.data() + filled, Tokenizer::TOKEN_BATCH);
+        m_tokens.resize(filled + count);
+        m_view = m_tokens;
+        m_lexer_done = count == 0 || m_tokens.back().kind == TK_EOF;
+        if (m_lexer_done) {
+            m_eof = !m_tokens.empty() ? m_tokens.back() : token::create_new(TK_EOF, 0, 0);
+        }
+    }
 }
 
 
 /// @brief Return the current token
 token Parser::current_token() {
     return m_current_token;
-    // return token_queue[0];
 }
 
 /// @brief Eat the expected token
 token Parser::eat() {
-//    std::printf(
-//        "current: %s. peek: %s\n",
-//        token::kind_to_str(m_current_token.kind).c_str(),
-//        token::kind_to_str(m_peek_token.kind).c_str()
-//    );
-
-    // m_current_token = m_lexer->next_token();
-    m_current_token = m_peek_token;
-    m_peek_token = m_lexer->next_token();
+    // The cursor stays on TK_EOF once it gets there
+    if (m_current_token.kind != TK_EOF) {
+        m_cursor++;
+    }
+    m_current_token = peek(0);
     return m_current_token;
 }
 
-/// @brief Eat the expected token
-result::Result<token, VError> Parser::eat(token_kind type) {
-    if (m_current_token.kind != type) {
-        platform::print_line(platform::CYAN, "Parser::eat(type): meant to read [%s] but got [%s]!\n"
-                ,token::kind_to_str(type).c_str()
-                ,token::kind_to_str(m_current_token.kind).c_str()
+/// @brief Eat the expected token. Any other token is reported and left where
+///        it is, so whoever called can go on as if the expected one was there
+/// @returns Whether the token was the expected one
+bool Parser::eat(token_kind type) {
+    if (m_current_token.kind == type) {
+        (void) eat();
+        return true;
+    }
+
+    // Naming the tokens is only worth it for an error that is reported
+    if (reporting()) {
+        Location at = m_current_token.location(m_context.file);
+        (void) error(
+            "Parser::eat: Expected {} but got {} at {}:{}",
+            token::kind_to_str(type),
+            token::kind_to_str(m_current_token.kind),
+            at.line,
+            at.character
         );
-        return result::Err(VError::create_new(
-            error_type::PARSER_ERR,
-            "Parser::eat: Expected {} but got {}\n",
-            token::kind_to_str(type).c_str(),
-            token::kind_to_str(m_current_token.kind).c_str()
-        ));
     }
-   
-//    std::printf(
-//        "current: %s. peek: %s\n",
-//        token::kind_to_str(m_current_token.kind).c_str(),
-//        token::kind_to_str(m_peek_token.kind).c_str()
-//    );
-    // m_current_token = m_lexer->next_token();
-    m_current_token = m_peek_token;
-    m_peek_token = m_lexer->next_token();
-    return result::Ok(m_current_token);
+    m_panicking = true;
+    return false;
 }
 
 }
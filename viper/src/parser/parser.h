@@ -10,13 +10,11 @@
 #include "tokenizer/tokenizer.h"
 #include "token.h"
 #include "core/ast.h"
-#include "core/vresult.h"
 #include "core/result.h"
 #include "core/verror.h"
 
-#include <deque>
 #include <memory>
-#include <unordered_map>
+#include <span>
 #include <vector>
 
 namespace viper {
@@ -24,40 +22,86 @@ namespace viper {
 class Parser {
     public:
         ~Parser() {}
+        Parser(Parser&&) = default; // Moving keeps the buffer m_view may point into
         static Parser create_new(Tokenizer* lexer);
+        static Parser create_new(Tokenizer* lexer, TokenQueue* input);
+        static Parser create_new(Tokenizer* lexer, std::span<const token> tokens, std::shared_ptr<AST> ast = nullptr);
+        static std::shared_ptr<AST> parse_parallel(Tokenizer* lexer, std::span<const token> tokens, u32 threads, std::vector<VError>* errors);
         std::shared_ptr<AST> parse();
+        std::shared_ptr<AST> skim();
+        CodeBlockStatementNode* parse_skimmed_body();
         std::optional<ASTNode*> parse_top_level_statement();
+        std::optional<ASTNode*> parse_declaration();
+        u64 position() const;
+        const std::vector<VError>& errors() const;
+
+        // Errors reported at most. Past this many the parse goes on, only quietly
+        static constexpr u64 MAX_ERRORS = 100;
+
+        static constexpr u64 PARALLEL_MIN_RUN = 4096;   // Fewest tokens of declarations a thread parses at a time
+        static constexpr u64 PARALLEL_RUNS_PER_THREAD = 8; // Runs of declarations the tokens are cut into per thread
 
     private:
         using ResultNode = result::Result<ASTNode*, VError>;
-        Parser();
+        Parser() {}
 
-        prec_e get_operator_precedence(const token& tok) const;
-        prec_e is_prefix_op(const token& tok) const;
+        bool is_type_specifier(const token& tok) const;
 
-        result::Result<token, VError> eat(token_kind type);
+        bool eat(token_kind type);
         token eat();
         token peek_token();
+        const token& peek(u32 ahead);
+        void fetch_tokens(u32 ahead);
         token current_token();
+        std::string_view text(const token& tok) const;
+
+        /// @brief Allocate a node in the tree's arena and attach it to the file being parsed
+        template <typename T, typename... Args>
+        T* make_node(Args&&... args) {
+            T* node = m_ast->make<T>(std::forward<Args>(args)...);
+            node->set_context(m_context);
+            return node;
+        }
+
+        /// @brief Report a syntax error and enter panic mode. Until the parser
+        ///        synchronizes, errors are fallout from this one and are not reported,
+        ///        and past MAX_ERRORS none are. The message is only formatted when reported
+        template <typename... Args>
+        VError error(const std::string_view& fmt, Args... args) {
+            if (!reporting()) {
+                m_panicking = true;
+                return suppressed_error();
+            }
+            m_panicking = true;
+            VError err = m_ast->errors().report(error_type::PARSER_ERR, fmt, args...);
+            error_msgs.push_back(err);
+            return err;
+        }
+        bool reporting() const;
+        static VError suppressed_error();
+        void synchronize();
+        void skip_to_declaration();
 
-        // ResultNode parse_expr(prec_e precedence = precedence::LOWEST, ExpressionNode* lhs = nullptr);
         ResultNode parse_expr();
-        ResultNode parse_expr_binary(ExpressionNode* lhs, prec_e min_prec);
+        bool open_expr_operand();
+        bool open_expr_identifier();
+        void finish_expr_operand(ExpressionNode* expr, u32 chain_base);
+        bool close_expr_bracket();
+        void reduce_expr();
 
         // Primary Expressions
         ResultNode parse_expr_primary();
-        ResultNode parse_expr_identifier();
         ResultNode parse_expr_str();
-        ResultNode parse_expr_grouping();
         ResultNode parse_expr_boolean();
         ResultNode parse_expr_integer();
         ResultNode parse_expr_float();
-        ResultNode parse_expr_prefix();
-        ResultNode parse_proc_argument();
-        ResultNode parse_expr_infix(ExpressionNode* lhs);
 
         ResultNode parse_statement();
+        ResultNode open_statement();
         ResultNode parse_scope();
+        CodeBlockStatementNode* open_block(ASTNode* owner);
+        void parse_open_blocks(u64 base);
+        void close_block(ASTNode* owner);
         ResultNode parse_expression_statement();
         ResultNode parse_let_statement();
         ResultNode parse_return_statement();
@@ -78,17 +122,46 @@ class Parser {
         ResultNode parse_let_declaration();
 
         ResultNode parse_procedure();
+        void skim_body(ProcedureNode* proc);
         ResultNode parse_proc_parameter();
 
         ResultNode parse_data_type();
 
-        token m_current_token;
-        token m_peek_token;
-        std::unordered_map<token_kind, prec_e> operator_precedences;
+        token m_current_token;          // Copy of m_view[m_cursor]
+        std::vector<token> m_tokens;    // Tokens taken from the lexer a batch at a time and not yet dropped
+        std::span<const token> m_view;  // Tokens being parsed: m_tokens, or the tokens the parser was created over
+        token m_eof {};                 // What peeking past the end of the tokens gives
+        u64 m_cursor = 0;               // Index of the current token in m_view
+        bool m_lexer_done = false;      // Whether the lexer has handed over TK_EOF
         Tokenizer* m_lexer; // [NOT OWNED] 
+        TokenQueue* m_input = nullptr; // [NOT OWNED] Where tokens come from when the lexer runs on another thread
+        Context m_context {};  // File and module the nodes being parsed belong to
         std::shared_ptr<AST> m_ast;
         std::vector<VError> error_msgs;
-        std::deque<token> token_queue;
+        bool m_panicking = false;               // An error was found and the parser has not synchronized since
+        bool m_skimming = false;                // Procedure bodies are matched brace to brace and not parsed
+        ASTNode* m_error_node = nullptr;        // Shared by every statement that failed to parse
+        ExpressionNode* m_error_expr = nullptr; // Shared by every expression that failed to parse
+
+        // An operator or bracket parse_expr has read but not yet applied
+        enum class pending_kind : u8 { PREFIX, INFIX, GROUP, CALL, INDEX };
+        struct pending_op {
+            token op;
+            u8 right;                       // How tightly it holds the operand to its right. 0 for a bracket
+            pending_kind kind;
+            u32 chain_base = 0;             // Calls and indexes: where their member access chain starts
+            ExpressionNode* node = nullptr; // Calls and indexes: the node the bracket fills
+        };
+        std::vector<pending_op> m_expr_ops;           // Operators and open brackets of the expressions being parsed
+        std::vector<ExpressionNode*> m_expr_operands; // Operands not yet given to an operator
+        std::vector<token> m_member_chain;            // Objects of the member accesses being parsed
+
+        // A block whose statements are being parsed
+        struct open_block_frame {
+            CodeBlockStatementNode* block;
+            ASTNode* owner; // The statement it is the body of. nullptr for a block on its own
+        };
+        std::vector<open_block_frame> m_open_blocks;  // Blocks being parsed, innermost last
 };
 
 }
@@ -25,4 +25,27 @@ void print_line(color_e color, const char* fmt, ...);
 /// Print an error line to the console
 void print_error(const char* fmt, ...);
 
+/// A read-only view of a file's bytes mapped into memory
+struct file_mapping {
+    const char* data;    // nullptr when nothing is mapped
+    u64 size;            // Bytes of the file
+    u64 mapped_size;     // Bytes that were mapped
+};
+
+/// Map a regular file read-only into memory
+/// Returns false if the file cannot be mapped (pipes, devices, empty files...)
+bool map_file(const char* path, file_mapping* out_mapping);
+
+/// Release a mapping created with map_file
+void unmap_file(file_mapping* mapping);
+
+/// Drop the pages of [offset, offset + size) of a mapping from memory.
+/// They are read back from the file if they are touched again.
+void release_mapped_range(const file_mapping* mapping, u64 offset, u64 size);
+
+/// Replace the content of a file with data. It is written to a uniquely named file
+/// next to path and renamed over it, so readers see the old file or the new one.
+/// Returns false and leaves no temporary file behind if any step fails
+bool replace_file(const char* path, const char* data, u64 size);
+
 } // Platform namespace
@@ -1,9 +1,16 @@
 #include "defines.h"
 #include "platform.h"
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
 #include <unordered_map>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifdef Q_PLATFORM_LINUX
 
@@ -48,7 +55,101 @@ void print_error(const char* fmt, ...) {
     vsnprintf(msg, msg_len, fmt, arg_ptr);
     va_end(arg_ptr);
     
-    std::fprintf(stderr, "\x1b[31m%s\n\x1b[0m", fmt);
+    std::fprintf(stderr, "\x1b[31m%s\n\x1b[0m", msg);
+}
+
+
+/// Map a regular file read-only into memory
+bool map_file(const char* path, file_mapping* out_mapping) {
+    *out_mapping = {};
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Only regular files have a stable size we can map.
+    // Pipes, sockets and ttys are left to the buffered reader
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    // Source is scanned front to back exactly once
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    out_mapping->data = static_cast<const char*>(addr);
+    out_mapping->size = st.st_size;
+    out_mapping->mapped_size = st.st_size;
+    return true;
+}
+
+
+/// Release a mapping created with map_file
+void unmap_file(file_mapping* mapping) {
+    if (mapping->data != nullptr) {
+        munmap(const_cast<char*>(mapping->data), mapping->mapped_size);
+    }
+
+    *mapping = {};
+}
+
+
+/// Drop the pages of a range of a mapping from memory
+void release_mapped_range(const file_mapping* mapping, u64 offset, u64 size) {
+    if (mapping->data == nullptr || offset >= mapping->size) {
+        return;
+    }
+    if (size > mapping->size - offset) {
+        size = mapping->size - offset;
+    }
+
+    // Only whole pages inside the range are dropped
+    u64 page = static_cast<u64>(sysconf(_SC_PAGESIZE));
+    u64 begin = (offset + page - 1) & ~(page - 1);
+    u64 end = (offset + size) & ~(page - 1);
+    if (begin >= end) {
+        return;
+    }
+
+    // The mapping is private and read-only, so dropped pages are reloaded from the file
+    madvise(const_cast<char*>(mapping->data) + begin, end - begin, MADV_DONTNEED);
+}
+
+
+/// Write a file under a unique temporary name and rename it over path
+bool replace_file(const char* path, const char* data, u64 size) {
+    std::string temporary = std::string(path) + ".XXXXXX";
+    int fd = mkstemp(temporary.data());
+    if (fd < 0) {
+        return false;
+    }
+
+    u64 written = 0;
+    while (written < size) {
+        ssize_t count = write(fd, data + written, size - written);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        written += count;
+    }
+
+    bool ok = close(fd) == 0 && written == size;
+    if (!ok || rename(temporary.c_str(), path) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
 }
 
 }
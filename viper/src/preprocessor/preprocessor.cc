@@ -2,7 +2,9 @@
 #include "core/core.h"
 #include "defines.h"
 #include "token.h"
+#include "tokenizer/tokenizer.h"
 
+#include <array>
 #include <vector>
 
 namespace viper {
@@ -10,14 +12,14 @@ namespace viper {
 
 /// @brief Create a new preprocessor for a module
 /// @param input_tokens The list of tokens we are preprocessing
-Preprocessor Preprocessor::create_new(const std::vector<token>& input_tokens) {
+Preprocessor Preprocessor::create_new(std::vector<token> input_tokens) {
 // Preprocessor Preprocessor::create_new(const std::vector<token>& input_tokens) {
     Preprocessor pp = Preprocessor();
 
-    pp.m_tokens = input_tokens;
+    pp.m_tokens = std::move(input_tokens);
     pp.m_current_position = 0;
-    pp.m_current_token = token::create_new(TK_ILLEGAL, "", 0);
-    pp.m_peek_token = token::create_new(TK_ILLEGAL, "", 0);
+    pp.m_current_token = token::create_new(TK_ILLEGAL, 0, 0);
+    pp.m_peek_token = token::create_new(TK_ILLEGAL, 0, 0);
     pp.m_parent_file = nullptr;
 
     return pp;
@@ -25,14 +27,14 @@ Preprocessor Preprocessor::create_new(const std::vector<token>& input_tokens) {
 
 /// @brief Create a new preprocessor for a module
 /// @param input_tokens The list of tokens we are preprocessing
-Preprocessor Preprocessor::create_new(VFile* parent, const std::vector<token>& input_tokens) {
+Preprocessor Preprocessor::create_new(VFile* parent, std::vector<token> input_tokens) {
 // Preprocessor Preprocessor::create_new(const std::vector<token>& input_tokens) {
     Preprocessor pp = Preprocessor();
 
-    pp.m_tokens = input_tokens;
+    pp.m_tokens = std::move(input_tokens);
     pp.m_current_position = 0;
-    pp.m_current_token = token::create_new(TK_ILLEGAL, "", 0);
-    pp.m_peek_token = token::create_new(TK_ILLEGAL, "", 0);
+    pp.m_current_token = token::create_new(TK_ILLEGAL, 0, 0);
+    pp.m_peek_token = token::create_new(TK_ILLEGAL, 0, 0);
     pp.m_parent_file = parent;
 
     return pp;
@@ -91,6 +93,7 @@ void Preprocessor::_next_token() {
 
 
 /// @brief Take list of tokens and perform preprocessing transformations on them
+///        The processed tokens are moved out of the preprocessor
 std::vector<token> Preprocessor::process() {
     if (m_tokens.size() == 0) {
         std::printf("Preprocessor::process: Token input is empty\n");
@@ -100,17 +103,42 @@ std::vector<token> Preprocessor::process() {
     _next_token();
 
     while (m_current_token.kind != TK_EOF) {
-        switch(m_current_token.kind) {
-            case TK_PP_IMPORT:
-                // _handle_import();
-            default:
-                break;
-        }
-
+        _visit(m_current_token);
         _next_token();
     }
 
-    return m_tokens;
+    return std::move(m_tokens);
+}
+
+
+/// @brief Preprocess tokens from a queue filled by the lexer and hand them on to
+///        the parser's queue, up to and including TK_EOF. When the parser closes
+///        its queue early the lexer's queue is closed too
+void Preprocessor::process_stream(TokenQueue* input, TokenQueue* output) {
+    std::array<token, Tokenizer::TOKEN_BATCH> batch;
+    u32 count;
+    do {
+        count = input->pop(batch.data(), Tokenizer::TOKEN_BATCH);
+        for (u32 i = 0; i < count; i++) {
+            _visit(batch[i]);
+        }
+
+        if (!output->push(batch.data(), count)) {
+            input->close();
+            return;
+        }
+    } while (batch[count - 1].kind != TK_EOF);
+}
+
+
+/// @brief Apply the directive a token starts, if any
+void Preprocessor::_visit(const token& tok) {
+    switch(tok.kind) {
+        case TK_PP_IMPORT:
+            // _handle_import();
+        default:
+            break;
+    }
 }
 
 
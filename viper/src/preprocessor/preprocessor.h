@@ -31,15 +31,17 @@ struct macro {
 class Preprocessor {
     public:
         ~Preprocessor() {}
-        static Preprocessor create_new(const std::vector<token>& input_tokens);
-        static Preprocessor create_new(VFile* parent, const std::vector<token>& input_tokens);
+        static Preprocessor create_new(std::vector<token> input_tokens);
+        static Preprocessor create_new(VFile* parent, std::vector<token> input_tokens);
 
         std::vector<token> process(); // Preprocess tokens and 
+        void process_stream(TokenQueue* input, TokenQueue* output); // Preprocess tokens as another thread lexes them
 
     private:
         Preprocessor() {}
 
         void _next_token();
+        void _visit(const token& tok);
         // std::optional<VError> _handle_import();
 
         VFile* m_parent_file;
@@ -3,15 +3,17 @@
 #include "defines.h"
 //#include "core/span.h"
 #include "core/core.h"
+#include "core/spsc_queue.h"
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 
 namespace viper {
 
 // Kinds of tokens that exist
-enum token_kind {
+enum token_kind : u32 {
     TK_ILLEGAL,
     TK_IDENT,
   
@@ -121,52 +123,70 @@ enum token_kind {
 };
 
 // Data type for a token
+// Packed into 16 bytes and trivially copyable. The token does not own its text,
+// the text is recovered from the source buffer it was read from. Lines and
+// columns are not stored either, they are looked up from the offset when needed
 struct token {
-    token() {}
+    token_kind kind = TK_ILLEGAL;
+    u32 offset = 0;        // Byte offset of the token in the source
+    u32 length = 0;        // Length of the token text in bytes. 0 for tokens not read from source
+    u32 payload = 0;       // Index of extra data belonging to the token. Interned symbol for identifiers and keywords
 
-    token(const token& other) {
-        kind = other.kind;
-        value = other.value;
-        fvalue = other.fvalue;
-        name = other.name;
-        file = other.file;
-        line_num = other.line_num;
+    /// @brief The text of the token inside of the source it was read from
+    std::string_view text(std::string_view source) const {
+        if (offset + length > source.size()) {
+            return {};
+        }
+        return source.substr(offset, length);
     }
-    token(token&& other) {
-        std::swap(other.kind, kind);
-        std::swap(other.value, value);
-        std::swap(other.fvalue, fvalue);
-        std::swap(other.name, name);
-        std::swap(other.line_num, line_num);
-        std::swap(other.file, file);
-        std::swap(other.kind, kind);
+
+    /// @brief The text of the token inside of the file it was read from
+    std::string_view text(const VFile* file) const {
+        if (file == nullptr) {
+            return {};
+        }
+        return text(file->source());
     }
 
-    token& operator=(token other) {
-        kind = other.kind;
-        value = other.value;
-        fvalue = other.fvalue;
-        name = other.name;
-        file = other.file;
-        line_num = other.line_num;
+    /// @brief Value of a TK_STR token: its content with every CRLF and lone CR line
+    ///        ending read as '\n'. The source keeps its line endings, so the same
+    ///        literal has the same value on a CRLF and on an LF checkout
+    std::string string_value(const VFile* file) const {
+        std::string_view content = text(file);
+        std::string value;
+        value.reserve(content.size());
+        for (std::size_t i = 0; i < content.size();) {
+            std::size_t cr = content.find('\r', i);
+            if (cr == std::string_view::npos) {
+                value.append(content, i);
+                break;
+            }
+            value.append(content, i, cr - i);
+            value.push_back('\n');
+            i = cr + 1 < content.size() && content[cr + 1] == '\n' ? cr + 2 : cr + 1;
+        }
+        return value;
+    }
 
-        return *this;
+    /// @brief Line and column of the token in the file it was read from
+    Location location(VFile* file) const {
+        return file->location_of(offset);
     }
 
-    token_kind kind;
-    u64 value;
-    f64 fvalue;
-    std::string name;
-    //Span span;
-    
-    viper::VFile* file;
-    u32 line_num;
+    /// @brief Move the token by delta bytes, for an edit of the source before it.
+    ///        A token that was not read from the source has no offset and stays put.
+    ///        The only empty tokens the lexer reads are TK_EOF and the empty string
+    void shift(i64 delta) {
+        if (length != 0 || kind == TK_EOF || kind == TK_STR) {
+            offset = static_cast<u32>(offset + delta);
+        }
+    }
 
-    static token create_new(token_kind kind, std::string name, u64 line_num) {
+    static token create_new(token_kind kind, u32 offset, u32 length) {
         token tok;
         tok.kind = kind;
-        tok.name = name;
-        tok.line_num = line_num;
+        tok.offset = offset;
+        tok.length = length;
         return tok;
     }
 
@@ -180,6 +200,7 @@ struct token {
         kind_map[TK_RETURN] = "TK_RETURN";
         kind_map[TK_STRUCT] = "TK_STRUCT";
         kind_map[TK_ENUM] = "TK_ENUM";
+        kind_map[TK_MATCH] = "TK_MATCH";
         kind_map[TK_UNION] = "TK_UNION";
         kind_map[TK_CONTINUE] = "TK_CONTINUE";
         kind_map[TK_BREAK] = "TK_BREAK";
@@ -190,14 +211,20 @@ struct token {
         kind_map[TK_VOID] = "TK_VOID";
         kind_map[TK_FOR] = "TK_FOR";
         kind_map[TK_WHILE] = "TK_WHILE";
+        kind_map[TK_DO] = "TK_DO";
         kind_map[TK_IF] = "TK_IF";
         kind_map[TK_ELIF] = "TK_ELIF";
         kind_map[TK_ELSE] = "TK_ELSE";
+        kind_map[TK_PP_DEFINE] = "TK_PP_DEFINE";
+        kind_map[TK_PP_IMPORT] = "TK_PP_IMPORT";
+        kind_map[TK_PP_EXPORT] = "TK_PP_EXPORT";
+        kind_map[TK_STR] = "TK_STR";
         kind_map[TK_NUM_FLOAT] = "TK_NUM_FLOAT" ;
         kind_map[TK_NUM_INT] =   "TK_NUM_INT" ;
         kind_map[TK_PP_NUM] = "TK_PP_NUM";
         kind_map[TK_TRUE] = "TK_TRUE";
         kind_map[TK_FALSE] = "TK_FALSE";
+        kind_map[TK_TYPESPEC_BYTE] = "TK_TYPESPEC_BYTE" ;
         kind_map[TK_TYPESPEC_I8] =   "TK_TYPESPEC_I8" ;
         kind_map[TK_TYPESPEC_I16] =  "TK_TYPESPEC_I16" ;
         kind_map[TK_TYPESPEC_I32] =  "TK_TYPESPEC_I32" ;
@@ -252,14 +279,21 @@ struct token {
         kind_map[TK_RBRACKET] = "TK_RBRACKET" ;
         kind_map[TK_LSQUIRLY] = "TK_LSQUIRLY" ;
         kind_map[TK_RSQUIRLY] = "TK_RSQUIRLY";
+        kind_map[TK_COMMENT] = "TK_COMMENT";
         kind_map[TK_EOF] = "TK_EOF";
 
         return kind_map[kind];
     }
 
-    void print_name() const {
-        std::printf("Name: %s Kind: %s\n", name.c_str(), kind_to_str(kind).c_str());
+    void print_name(const VFile* file) const {
+        std::string_view name = text(file);
+        std::printf("Name: %.*s Kind: %s\n", (int)name.size(), name.data(), kind_to_str(kind).c_str());
     }
 };
 
+static_assert(sizeof(token) == 16, "token is expected to be packed into 16 bytes");
+
+// Tokens handed from one stage of a pipelined parse to the next. 64 KB of tokens
+using TokenQueue = SpscQueue<token, 4096>;
+
 }
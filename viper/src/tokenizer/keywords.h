@@ -0,0 +1,162 @@
+#pragma once
+
+/*
+ *  keywords.h
+ *
+ *  The keywords of the Viper language and a perfect hash table over them that
+ *  is generated at compile time. Looking up an identifier hashes it once and
+ *  does at most one string compare, with no allocation and no per-tokenizer setup
+ */
+
+#include "defines.h"
+#include "token.h"
+
+#include <array>
+#include <string_view>
+
+namespace viper {
+
+struct keyword {
+    std::string_view spelling;
+    token_kind kind;
+};
+
+// Every keyword of the language. The lookup table is generated from this list
+constexpr keyword KEYWORDS[] = {
+    {"const",   TK_CONST},
+    {"let",     TK_LET},
+    {"define",  TK_DEFINE},
+    {"return",  TK_RETURN},
+    {"struct",  TK_STRUCT},
+    {"enum",    TK_ENUM},
+    {"module",  TK_MODULE},
+    {"void",    TK_VOID},
+    {"for",     TK_FOR},
+    {"while",   TK_WHILE},
+    {"do",      TK_DO},
+    {"if",      TK_IF},
+    {"elif",    TK_ELIF},
+    {"else",    TK_ELSE},
+
+    {"#define", TK_PP_DEFINE},
+    {"#import", TK_PP_IMPORT},
+    {"#export", TK_PP_EXPORT},
+
+    {"true",    TK_TRUE},
+    {"false",   TK_FALSE},
+
+    {"byte",    TK_TYPESPEC_BYTE},
+    {"i8",      TK_TYPESPEC_I8},
+    {"i16",     TK_TYPESPEC_I16},
+    {"i32",     TK_TYPESPEC_I32},
+    {"i64",     TK_TYPESPEC_I64},
+    {"f32",     TK_TYPESPEC_F32},
+    {"f64",     TK_TYPESPEC_F64},
+    {"u8",      TK_TYPESPEC_U8},
+    {"u16",     TK_TYPESPEC_U16},
+    {"u32",     TK_TYPESPEC_U32},
+    {"u64",     TK_TYPESPEC_U64},
+    {"bool",    TK_TYPESPEC_BOOL},
+};
+
+namespace keyword_table {
+
+constexpr u64 COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+constexpr u32 BITS = 7;
+constexpr u32 SIZE = 1u << BITS;
+static_assert(COUNT < SIZE, "keyword table is too small for the keyword list");
+
+constexpr u64 min_length() {
+    u64 len = KEYWORDS[0].spelling.size();
+    for (const keyword& kw : KEYWORDS) {
+        len = kw.spelling.size() < len ? kw.spelling.size() : len;
+    }
+    return len;
+}
+
+constexpr u64 max_length() {
+    u64 len = 0;
+    for (const keyword& kw : KEYWORDS) {
+        len = kw.spelling.size() > len ? kw.spelling.size() : len;
+    }
+    return len;
+}
+
+constexpr u64 MIN_LENGTH = min_length();
+constexpr u64 MAX_LENGTH = max_length();
+static_assert(MIN_LENGTH >= 2, "the hash key reads the first two characters of a keyword");
+
+/// @brief Pack the length and the first, second and last characters of a word
+constexpr u32 key_of(std::string_view str) {
+    return static_cast<u32>(static_cast<u8>(str[0]))
+        | static_cast<u32>(static_cast<u8>(str[1])) << 8
+        | static_cast<u32>(static_cast<u8>(str[str.size() - 1])) << 16
+        | static_cast<u32>(str.size()) << 24;
+}
+
+/// @brief Multiplicative hash of a key into the table
+constexpr u32 slot_of(u32 key, u32 seed) {
+    return (key * seed) >> (32 - BITS);
+}
+
+/// @brief Whether a seed sends every keyword to a different slot
+constexpr bool is_perfect(u32 seed) {
+    std::array<bool, SIZE> used {};
+    for (const keyword& kw : KEYWORDS) {
+        u32 slot = slot_of(key_of(kw.spelling), seed);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+/// @brief Search for the first odd seed without collisions
+constexpr u32 find_seed() {
+    for (u32 i = 0; i < 100000; i++) {
+        u32 seed = 0x9E3779B1u + 2 * i;
+        if (is_perfect(seed)) {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+constexpr u32 SEED = find_seed();
+static_assert(SEED != 0, "no perfect hash seed found for the keyword list");
+
+/// @brief Table from slot to 1 + index into KEYWORDS. 0 is an empty slot
+constexpr std::array<u8, SIZE> build_slots() {
+    std::array<u8, SIZE> slots {};
+    for (u64 i = 0; i < COUNT; i++) {
+        slots[slot_of(key_of(KEYWORDS[i].spelling), SEED)] = static_cast<u8>(i + 1);
+    }
+    return slots;
+}
+
+constexpr std::array<u8, SIZE> SLOTS = build_slots();
+
+} // keyword_table namespace
+
+/// @brief Find the keyword kind of a word
+/// @returns The keyword's token kind, or TK_IDENT if the word is not a keyword
+constexpr token_kind lookup_keyword(std::string_view str) {
+    if (str.size() < keyword_table::MIN_LENGTH || str.size() > keyword_table::MAX_LENGTH) {
+        return TK_IDENT;
+    }
+
+    u8 entry = keyword_table::SLOTS[keyword_table::slot_of(keyword_table::key_of(str), keyword_table::SEED)];
+    if (entry == 0 || KEYWORDS[entry - 1].spelling != str) {
+        return TK_IDENT;
+    }
+    return KEYWORDS[entry - 1].kind;
+}
+
+static_assert(lookup_keyword("define") == TK_DEFINE);
+static_assert(lookup_keyword("#import") == TK_PP_IMPORT);
+static_assert(lookup_keyword("#export") == TK_PP_EXPORT);
+static_assert(lookup_keyword("i32") == TK_TYPESPEC_I32);
+static_assert(lookup_keyword("definer") == TK_IDENT);
+
+} // viper namespace
@@ -0,0 +1,238 @@
+#pragma once
+
+/*
+ *  lexer_table.h
+ *
+ *  Character class and transition tables for the table driven lexer. The tables
+ *  are generated at compile time from the list of punctuators: every punctuator
+ *  spelling becomes a path through the transition table, and the longest path
+ *  that matches the input is the token. Identifiers, numbers, strings and
+ *  comments only use the table to be recognized, their bodies are read by the
+ *  tokenizer's scanning routines
+ */
+
+#include "defines.h"
+#include "token.h"
+
+#include <array>
+#include <string_view>
+
+namespace viper {
+
+// What the tokenizer does once the table stops on a state
+enum lexer_action : u8 {
+    LA_NONE,          // Not a token. Only the dead state and prefixes of nothing
+    LA_PUNCTUATOR,    // The matched characters are the token
+    LA_IDENTIFIER,    // Read an identifier or keyword
+    LA_NUMBER,        // Read a number literal
+    LA_STRING,        // Read a string literal
+    LA_LINE_COMMENT,  // Skip to the end of the line
+    LA_BLOCK_COMMENT, // Skip to the closing */
+    LA_EOF,
+    LA_ILLEGAL,
+};
+
+struct lexeme {
+    std::string_view spelling;
+    token_kind kind;
+    lexer_action action = LA_PUNCTUATOR;
+};
+
+// Every punctuator of the language and the comment openers
+constexpr lexeme PUNCTUATORS[] = {
+    {"&",   TK_AMPERSAND},
+    {"&&",  TK_LOG_AND},
+    {"&=",  TK_ANDEQ},
+    {"=",   TK_ASSIGN},
+    {"==",  TK_EQUALTO},
+    {"!",   TK_BANG},
+    {"!=",  TK_NEQUALTO},
+    {"+",   TK_PLUS},
+    {"+=",  TK_PLUSEQ},
+    {"-",   TK_MINUS},
+    {"-=",  TK_MINUSEQ},
+    {"*",   TK_ASTERISK},
+    {"*=",  TK_TIMESEQ},
+    {"/",   TK_SLASH},
+    {"/=",  TK_DIVEQ},
+    {"%",   TK_MOD},
+    {"%=",  TK_MODEQ},
+    {"~",   TK_TILDE},
+    {"~=",  TK_NEGATEEQ},
+    {"<",   TK_LT},
+    {"<=",  TK_LTEQ},
+    {"<<",  TK_LSHIFT},
+    {"<<=", TK_LSHIFTEQ},
+    {">",   TK_GT},
+    {">=",  TK_GTEQ},
+    {">>",  TK_RSHIFT},
+    {">>=", TK_RSHIFTEQ},
+    {"|",   TK_PIPE},
+    {"||",  TK_LOG_OR},
+    {"|=",  TK_OREQ},
+    {"^",   TK_CARET},
+    {"^=",  TK_XOREQ},
+    {",",   TK_COMMA},
+    {".",   TK_DOT},
+    {":",   TK_COLON},
+    {"::",  TK_DOUBLECOLON},
+    {";",   TK_SEMICOLON},
+    {"(",   TK_LPAREN},
+    {")",   TK_RPAREN},
+    {"[",   TK_LBRACKET},
+    {"]",   TK_RBRACKET},
+    {"{",   TK_LSQUIRLY},
+    {"}",   TK_RSQUIRLY},
+
+    {"//",  TK_COMMENT, LA_LINE_COMMENT},
+    {"/*",  TK_COMMENT, LA_BLOCK_COMMENT},
+};
+
+namespace lexer_table {
+
+constexpr u32 MAX_CLASSES = 32;
+constexpr u32 MAX_STATES = 64;
+
+// Character classes that are not punctuator characters
+constexpr u8 CLASS_OTHER = 0;
+constexpr u8 CLASS_ALPHA = 1;
+constexpr u8 CLASS_DIGIT = 2;
+constexpr u8 CLASS_QUOTE = 3;
+constexpr u8 CLASS_NUL = 4;
+constexpr u8 FIRST_PUNCTUATOR_CLASS = 5;
+
+// States that are not punctuator prefixes
+constexpr u8 DEAD = 0;
+constexpr u8 START = 1;
+constexpr u8 IDENTIFIER = 2;
+constexpr u8 NUMBER = 3;
+constexpr u8 STRING = 4;
+constexpr u8 END = 5;
+constexpr u8 ILLEGAL = 6;
+constexpr u8 FIRST_PUNCTUATOR_STATE = 7;
+
+struct table {
+    std::array<u8, 256> char_class {};
+    std::array<std::array<u8, MAX_CLASSES>, MAX_STATES> next {};
+    std::array<token_kind, MAX_STATES> kind {};
+    std::array<lexer_action, MAX_STATES> action {};
+    u32 class_count = FIRST_PUNCTUATOR_CLASS;
+    u32 state_count = FIRST_PUNCTUATOR_STATE;
+    bool valid = true; // False if the punctuator list does not fit the table
+};
+
+/// @brief Build the tables from the punctuator list
+constexpr table build_table() {
+    table t;
+
+    for (u32 c = 'a'; c <= 'z'; c++) {
+        t.char_class[c] = CLASS_ALPHA;
+        t.char_class[c - 'a' + 'A'] = CLASS_ALPHA;
+    }
+    for (u32 c = '0'; c <= '9'; c++) {
+        t.char_class[c] = CLASS_DIGIT;
+    }
+    t.char_class['"'] = CLASS_QUOTE;
+    t.char_class['\0'] = CLASS_NUL;
+
+    // Every character of a punctuator gets a class of its own
+    for (const lexeme& lx : PUNCTUATORS) {
+        for (char ch : lx.spelling) {
+            u8 c = static_cast<u8>(ch);
+            if (t.char_class[c] != CLASS_OTHER) {
+                continue;
+            }
+            if (t.class_count >= MAX_CLASSES) {
+                t.valid = false;
+                return t;
+            }
+            t.char_class[c] = static_cast<u8>(t.class_count++);
+        }
+    }
+
+    // Whatever does not begin a token is illegal
+    for (u32 c = 0; c < MAX_CLASSES; c++) {
+        t.next[START][c] = ILLEGAL;
+    }
+    t.next[START][CLASS_ALPHA] = IDENTIFIER;
+    t.next[START][CLASS_DIGIT] = NUMBER;
+    t.next[START][CLASS_QUOTE] = STRING;
+    t.next[START][CLASS_NUL] = END;
+    t.action[IDENTIFIER] = LA_IDENTIFIER;
+    t.action[NUMBER] = LA_NUMBER;
+    t.action[STRING] = LA_STRING;
+    t.action[END] = LA_EOF;
+    t.kind[END] = TK_EOF;
+    t.action[ILLEGAL] = LA_ILLEGAL;
+
+    // Punctuator start states must not be taken by the classes above
+    for (const lexeme& lx : PUNCTUATORS) {
+        u8 c = t.char_class[static_cast<u8>(lx.spelling[0])];
+        if (c < FIRST_PUNCTUATOR_CLASS) {
+            t.valid = false;
+            return t;
+        }
+        t.next[START][c] = DEAD;
+    }
+
+    // Add each spelling to the trie of punctuators
+    for (const lexeme& lx : PUNCTUATORS) {
+        u8 state = START;
+        for (char ch : lx.spelling) {
+            u8 c = t.char_class[static_cast<u8>(ch)];
+            if (t.next[state][c] == DEAD) {
+                if (t.state_count >= MAX_STATES) {
+                    t.valid = false;
+                    return t;
+                }
+                t.next[state][c] = static_cast<u8>(t.state_count++);
+            }
+            state = t.next[state][c];
+        }
+        t.kind[state] = lx.kind;
+        t.action[state] = lx.action;
+    }
+
+    // The lexer never backtracks, so every prefix of a punctuator must be a token itself
+    for (u32 s = FIRST_PUNCTUATOR_STATE; s < t.state_count; s++) {
+        if (t.action[s] == LA_NONE) {
+            t.valid = false;
+        }
+    }
+
+    return t;
+}
+
+constexpr table TABLE = build_table();
+static_assert(TABLE.valid, "the punctuator list does not fit the lexer table");
+
+/// @brief Follow the transition out of a state on a character
+constexpr u8 step(u8 state, char ch) {
+    return TABLE.next[state][TABLE.char_class[static_cast<u8>(ch)]];
+}
+
+/// @brief Run the table from the start state over a string and return the state it stops on
+constexpr u8 match(std::string_view str) {
+    u8 state = START;
+    for (char ch : str) {
+        u8 next = step(state, ch);
+        if (next == DEAD) {
+            break;
+        }
+        state = next;
+    }
+    return state;
+}
+
+} // lexer_table namespace
+
+static_assert(lexer_table::TABLE.kind[lexer_table::match("<<=")] == TK_LSHIFTEQ);
+static_assert(lexer_table::TABLE.kind[lexer_table::match(">>=")] == TK_RSHIFTEQ);
+static_assert(lexer_table::TABLE.kind[lexer_table::match("&&")] == TK_LOG_AND);
+static_assert(lexer_table::TABLE.kind[lexer_table::match("::")] == TK_DOUBLECOLON);
+static_assert(lexer_table::TABLE.kind[lexer_table::match("/=")] == TK_DIVEQ);
+static_assert(lexer_table::TABLE.kind[lexer_table::match("<<x")] == TK_LSHIFT);
+static_assert(lexer_table::TABLE.action[lexer_table::match("/*")] == LA_BLOCK_COMMENT);
+static_assert(lexer_table::match("name") == lexer_table::IDENTIFIER);
+
+} // viper namespace
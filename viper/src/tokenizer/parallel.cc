@@ -0,0 +1,222 @@
+/*
+ *  parallel.cc
+ *
+ *  Lexing one file on several threads. The source is cut into chunks and each
+ *  chunk is split again at its first newline that is not inside a string
+ *  literal or a comment, so no token crosses a split. Finding that newline
+ *  depends on what the lexer was in the middle of when the chunk began, which
+ *  is only known once the chunks before it have been scanned. Every chunk is
+ *  scanned assuming it starts in code, and a serial fix-up pass rescans the
+ *  chunks whose guess was wrong.
+ *
+ *  The pieces are lexed with their own interners and stitched together in
+ *  order, so tokens, literals and symbols are the same as lexing serially
+ */
+
+#include "tokenizer.h"
+#include "core/interner.h"
+#include "core/threads.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace viper {
+
+// What the lexer is in the middle of at some byte of the source
+enum class split_state : u8 {
+    CODE,
+    STRING,
+    LINE_COMMENT,
+    BLOCK_COMMENT,
+};
+
+constexpr u64 NO_SPLIT = ~0ull;
+
+// Result of scanning one chunk for a split point
+struct chunk_scan {
+    split_state start_state = split_state::CODE; // State the scan assumed at its start
+    u64 start_depth = 0;                         // Block comment nesting the scan assumed at its start
+    u64 start = 0;                               // Where the scan began
+    u64 split = NO_SPLIT;                        // One past the first newline that leaves the scan in code
+    split_state end_state = split_state::CODE;
+    u64 end_depth = 0;
+    u64 end = 0;                                 // Where the scan of the next chunk has to begin
+};
+
+
+/// @brief Scan [pos, limit) starting in a state and find the first safe split.
+///        A two character opener or closer may run one byte past limit.
+///        Delimiters are matched left to right like the tokenizer matches them
+static chunk_scan scan_chunk(std::string_view src, u64 pos, u64 limit, split_state state, u64 depth) {
+    chunk_scan out;
+    out.start_state = state;
+    out.start_depth = depth;
+    out.start = pos;
+
+    while (pos < limit) {
+        char c = src[pos];
+        char next = pos + 1 < src.size() ? src[pos + 1] : '\0';
+
+        switch (state) {
+            case split_state::CODE:
+                if (c == '"') {
+                    state = split_state::STRING;
+                } else if (c == '/' && next == '/') {
+                    state = split_state::LINE_COMMENT;
+                    pos++;
+                } else if (c == '/' && next == '*') {
+                    state = split_state::BLOCK_COMMENT;
+                    depth = 1;
+                    pos++;
+                }
+                break;
+
+            case split_state::STRING:
+                if (c == '"') {
+                    state = split_state::CODE;
+                }
+                break;
+
+            case split_state::LINE_COMMENT:
+                if (c == '\n' || c == '\r') {
+                    state = split_state::CODE;
+                }
+                break;
+
+            case split_state::BLOCK_COMMENT:
+                if (c == '/' && next == '*') {
+                    depth++;
+                    pos++;
+                } else if (c == '*' && next == '/') {
+                    depth--;
+                    state = depth == 0 ? split_state::CODE : state;
+                    pos++;
+                }
+                break;
+        }
+        pos++;
+
+        if ((c == '\n' || c == '\r') && state == split_state::CODE && out.split == NO_SPLIT) {
+            out.split = pos;
+        }
+    }
+
+    out.end_state = state;
+    out.end_depth = depth;
+    out.end = pos;
+    return out;
+}
+
+
+/// @brief Lex [begin, end) of the input on its own
+/// @param literals Set to the literal pool the payloads of the number tokens index
+std::vector<token> Tokenizer::tokenize_range(u64 begin, u64 end, Interner* interner, std::vector<u64>* literals) const {
+    Tokenizer lexer = create_new(m_file, m_mode);
+    lexer.m_symbols = InternCache(interner);
+    lexer.m_input = m_input.substr(0, end);
+    lexer.seek(begin);
+
+    lexer.tokenize();
+    *literals = std::move(lexer.m_literals);
+    return std::move(lexer.tokens);
+}
+
+
+/// @brief Tokenize the input on several threads. The tokens are the same as tokenize_file,
+///        and are kept in the tokenizer the same way
+/// @param threads Most threads to use. 0 uses one per hardware thread
+/// @param min_chunk Fewest bytes each thread lexes
+std::vector<token> Tokenizer::tokenize_file_parallel(u32 threads, u64 min_chunk) {
+    u64 size = m_input.size();
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    u64 chunks = min_chunk == 0 ? threads : size / min_chunk;
+    chunks = chunks < threads ? chunks : threads;
+    if (chunks < 2) {
+        return tokenize_file();
+    }
+
+    // Guess that every chunk starts in code
+    std::vector<chunk_scan> scans(chunks);
+    run_on_threads(chunks, [&](u64 i) {
+        u64 begin = size * i / chunks;
+        u64 limit = size * (i + 1) / chunks;
+        scans[i] = scan_chunk(m_input, begin, limit, split_state::CODE, 0);
+    });
+
+    // Fix up the guesses. A rescan is a byte loop, far cheaper than lexing the chunk
+    std::vector<u64> splits = { 0 };
+    for (u64 i = 1; i < chunks; i++) {
+        const chunk_scan& prev = scans[i - 1];
+        if (scans[i].start != prev.end
+            || scans[i].start_state != prev.end_state
+            || scans[i].start_depth != prev.end_depth) {
+            scans[i] = scan_chunk(m_input, prev.end, size * (i + 1) / chunks, prev.end_state, prev.end_depth);
+        }
+        if (scans[i].split != NO_SPLIT && scans[i].split < size) {
+            splits.push_back(scans[i].split);
+        }
+    }
+    splits.push_back(size);
+
+    // Lex every piece with its own interner
+    u64 pieces = splits.size() - 1;
+    std::vector<std::vector<token>> piece_tokens(pieces);
+    std::vector<std::unique_ptr<Interner>> interners(pieces);
+    std::vector<std::vector<u64>> piece_literals(pieces);
+    run_on_threads(pieces, [&](u64 i) {
+        interners[i] = std::make_unique<Interner>();
+        piece_tokens[i] = tokenize_range(splits[i], splits[i + 1], interners[i].get(), &piece_literals[i]);
+
+        // Only the last piece ends the file
+        if (i + 1 < pieces) {
+            piece_tokens[i].pop_back();
+        }
+    });
+
+    // Intern in file order so symbols are handed out in the order a serial lexer would
+    std::vector<std::vector<symbol>> remaps(pieces);
+    std::vector<u64> token_base(pieces);
+    std::vector<u32> literal_base(pieces);
+    u64 total = 0;
+    for (u64 i = 0; i < pieces; i++) {
+        u64 count = interners[i]->symbol_count();
+        remaps[i].resize(count);
+        for (symbol sym = 1; sym < count; sym++) {
+            remaps[i][sym] = m_symbols.intern(interners[i]->get(sym));
+        }
+
+        literal_base[i] = static_cast<u32>(m_literals.size());
+        m_literals.insert(m_literals.end(), piece_literals[i].begin(), piece_literals[i].end());
+
+        token_base[i] = total;
+        total += piece_tokens[i].size();
+    }
+
+    // Stitch the pieces together
+    std::vector<token> out(total);
+    run_on_threads(pieces, [&](u64 i) {
+        token* dest = out.data() + token_base[i];
+        for (const token& piece_tok : piece_tokens[i]) {
+            token tok = piece_tok;
+            if (tok.kind == TK_NUM_INT || tok.kind == TK_NUM_FLOAT) {
+                if ((tok.payload & LITERAL_POOLED) != 0) {
+                    tok.payload += literal_base[i];
+                }
+            } else {
+                tok.payload = remaps[i][tok.payload];
+            }
+            *dest++ = tok;
+        }
+        std::vector<token>().swap(piece_tokens[i]);
+    });
+
+    // Kept like tokenize_file keeps them, for get_tokens and relex
+    tokens = std::move(out);
+    return tokens;
+}
+
+} // viper namespace
@@ -0,0 +1,373 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VIPER_SCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define VIPER_SCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace viper {
+namespace scan {
+
+//////////////////////////////////////
+///            SCALAR              ///
+//////////////////////////////////////
+
+static inline bool is_whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_identifier(char c) {
+    char lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || is_digit(c) || c == '_';
+}
+
+static u64 skip_whitespace_scalar(const char* data, u64 size, u64 pos) {
+    while (pos < size && is_whitespace(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+static u64 skip_identifier_scalar(const char* data, u64 size, u64 pos) {
+    while (pos < size && is_identifier(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+static u64 skip_digits_scalar(const char* data, u64 size, u64 pos) {
+    while (pos < size && is_digit(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+// A line ends at '\n', or at a '\r' that is not the first half of "\r\n"
+static void find_newlines_scalar(const char* data, u64 size, u64 base, std::vector<u32>* line_starts) {
+    for (u64 i = 0; i < size; i++) {
+        if (data[i] == '\n' || (data[i] == '\r' && (i + 1 == size || data[i + 1] != '\n'))) {
+            line_starts->push_back(static_cast<u32>(base + i + 1));
+        }
+    }
+}
+
+/// @brief Line breaks of a block from its '\n' and '\r' masks. A '\r' breaks the line
+///        unless a '\n' follows it, in this block or as the first byte after it
+static inline u32 line_breaks(u32 nl, u32 cr, u32 width, bool nl_after) {
+    u32 nl_next = (nl >> 1) | (nl_after ? 1u << (width - 1) : 0u);
+    return nl | (cr & ~nl_next);
+}
+
+//////////////////////////////////////
+///             SSE2               ///
+//////////////////////////////////////
+#ifdef VIPER_SCAN_SSE2
+
+// Blocks are only loaded when they are entirely inside the input.
+// The tail is left to the scalar kernels so we never read past a mapping
+
+static inline __m128i in_range_sse2(__m128i v, char lo, char hi) {
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1))
+    );
+}
+
+static u64 skip_whitespace_sse2(const char* data, u64 size, u64 pos) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i is_ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, nl))
+        );
+        u32 mask = static_cast<u32>(_mm_movemask_epi8(is_ws));
+
+        if (mask != 0xFFFF) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 16;
+    }
+
+    return skip_whitespace_scalar(data, size, pos);
+}
+
+static u64 skip_identifier_sse2(const char* data, u64 size, u64 pos) {
+    const __m128i lower_bit = _mm_set1_epi8(0x20);
+    const __m128i underscore = _mm_set1_epi8('_');
+
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i is_ident = _mm_or_si128(
+            _mm_or_si128(
+                in_range_sse2(_mm_or_si128(block, lower_bit), 'a', 'z'),
+                in_range_sse2(block, '0', '9')
+            ),
+            _mm_cmpeq_epi8(block, underscore)
+        );
+        u32 mask = static_cast<u32>(_mm_movemask_epi8(is_ident));
+
+        if (mask != 0xFFFF) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 16;
+    }
+
+    return skip_identifier_scalar(data, size, pos);
+}
+
+static u64 skip_digits_sse2(const char* data, u64 size, u64 pos) {
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        u32 mask = static_cast<u32>(_mm_movemask_epi8(in_range_sse2(block, '0', '9')));
+
+        if (mask != 0xFFFF) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 16;
+    }
+
+    return skip_digits_scalar(data, size, pos);
+}
+
+static void find_newlines_sse2(const char* data, u64 size, u64 base, std::vector<u32>* line_starts) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    u64 pos = 0;
+
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        u32 mask = line_breaks(
+            static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl))),
+            static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, cr))),
+            16, pos + 16 < size && data[pos + 16] == '\n');
+        while (mask != 0) {
+            line_starts->push_back(static_cast<u32>(base + pos + __builtin_ctz(mask) + 1));
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
+
+    find_newlines_scalar(data + pos, size - pos, base + pos, line_starts);
+}
+
+#endif // VIPER_SCAN_SSE2
+
+//////////////////////////////////////
+///             AVX2               ///
+//////////////////////////////////////
+#ifdef VIPER_SCAN_AVX2
+
+#define VIPER_AVX2 __attribute__((target("avx2,popcnt,bmi")))
+
+VIPER_AVX2 static inline __m256i in_range_avx2(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v)
+    );
+}
+
+VIPER_AVX2 static u64 skip_whitespace_avx2(const char* data, u64 size, u64 pos) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i nl = _mm256_set1_epi8('\n');
+
+    while (pos + 32 <= size) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i is_ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(block, nl))
+        );
+        u32 mask = static_cast<u32>(_mm256_movemask_epi8(is_ws));
+
+        if (mask != 0xFFFFFFFF) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 32;
+    }
+
+    return skip_whitespace_sse2(data, size, pos);
+}
+
+VIPER_AVX2 static u64 skip_identifier_avx2(const char* data, u64 size, u64 pos) {
+    const __m256i lower_bit = _mm256_set1_epi8(0x20);
+    const __m256i underscore = _mm256_set1_epi8('_');
+
+    while (pos + 32 <= size) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i is_ident = _mm256_or_si256(
+            _mm256_or_si256(
+                in_range_avx2(_mm256_or_si256(block, lower_bit), 'a', 'z'),
+                in_range_avx2(block, '0', '9')
+            ),
+            _mm256_cmpeq_epi8(block, underscore)
+        );
+        u32 mask = static_cast<u32>(_mm256_movemask_epi8(is_ident));
+
+        if (mask != 0xFFFFFFFF) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 32;
+    }
+
+    return skip_identifier_sse2(data, size, pos);
+}
+
+VIPER_AVX2 static u64 skip_digits_avx2(const char* data, u64 size, u64 pos) {
+    while (pos + 32 <= size) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        u32 mask = static_cast<u32>(_mm256_movemask_epi8(in_range_avx2(block, '0', '9')));
+
+        if (mask != 0xFFFFFFFF) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 32;
+    }
+
+    return skip_digits_sse2(data, size, pos);
+}
+
+VIPER_AVX2 static void find_newlines_avx2(const char* data, u64 size, u64 base, std::vector<u32>* line_starts) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    u64 pos = 0;
+
+    while (pos + 32 <= size) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        u32 mask = line_breaks(
+            static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl))),
+            static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr))),
+            32, pos + 32 < size && data[pos + 32] == '\n');
+        while (mask != 0) {
+            line_starts->push_back(static_cast<u32>(base + pos + __builtin_ctz(mask) + 1));
+            mask &= mask - 1;
+        }
+        pos += 32;
+    }
+
+    find_newlines_sse2(data + pos, size - pos, base + pos, line_starts);
+}
+
+#endif // VIPER_SCAN_AVX2
+
+//////////////////////////////////////
+///           DISPATCH             ///
+//////////////////////////////////////
+
+struct kernels {
+    isa set;
+    u64 (*skip_whitespace)(const char*, u64, u64);
+    u64 (*skip_identifier)(const char*, u64, u64);
+    u64 (*skip_digits)(const char*, u64, u64);
+    void (*find_newlines)(const char*, u64, u64, std::vector<u32>*);
+};
+
+static kernels kernels_for(isa set) {
+    switch (set) {
+#ifdef VIPER_SCAN_AVX2
+        case isa::AVX2:
+            return { isa::AVX2, skip_whitespace_avx2, skip_identifier_avx2, skip_digits_avx2, find_newlines_avx2 };
+#endif
+#ifdef VIPER_SCAN_SSE2
+        case isa::SSE2:
+            return { isa::SSE2, skip_whitespace_sse2, skip_identifier_sse2, skip_digits_sse2, find_newlines_sse2 };
+#endif
+        default:
+            return { isa::SCALAR, skip_whitespace_scalar, skip_identifier_scalar, skip_digits_scalar, find_newlines_scalar };
+    }
+}
+
+/// @brief Pick the widest kernels the CPU supports
+static kernels detect_kernels() {
+    if (is_supported(isa::AVX2)) {
+        return kernels_for(isa::AVX2);
+    }
+    if (is_supported(isa::SSE2)) {
+        return kernels_for(isa::SSE2);
+    }
+    return kernels_for(isa::SCALAR);
+}
+
+// Constant initialized to the scalar kernels so scanning is safe even before
+// static initialization of this file has picked the best kernels
+static kernels s_kernels = { isa::SCALAR, skip_whitespace_scalar, skip_identifier_scalar, skip_digits_scalar, find_newlines_scalar };
+static const bool s_kernels_detected = (s_kernels = detect_kernels(), true);
+
+
+u64 skip_whitespace(const char* data, u64 size, u64 pos) {
+    return s_kernels.skip_whitespace(data, size, pos);
+}
+
+u64 skip_identifier(const char* data, u64 size, u64 pos) {
+    return s_kernels.skip_identifier(data, size, pos);
+}
+
+u64 skip_digits(const char* data, u64 size, u64 pos) {
+    return s_kernels.skip_digits(data, size, pos);
+}
+
+
+void find_newlines(const char* data, u64 size, u64 base, std::vector<u32>* line_starts) {
+    s_kernels.find_newlines(data, size, base, line_starts);
+}
+
+
+isa active_isa() {
+    return s_kernels.set;
+}
+
+bool is_supported(isa set) {
+    switch (set) {
+        case isa::SCALAR:
+            return true;
+        case isa::SSE2:
+#ifdef VIPER_SCAN_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case isa::AVX2:
+#ifdef VIPER_SCAN_AVX2
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2")
+                && __builtin_cpu_supports("popcnt")
+                && __builtin_cpu_supports("bmi");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool set_isa(isa set) {
+    if (!is_supported(set)) {
+        return false;
+    }
+    s_kernels = kernels_for(set);
+    return true;
+}
+
+const char* isa_name(isa set) {
+    switch (set) {
+        case isa::SCALAR: return "scalar";
+        case isa::SSE2: return "sse2";
+        case isa::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+} // scan namespace
+} // viper namespace
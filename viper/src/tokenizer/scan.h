@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+ *  scan.h
+ *
+ *  Character scanning kernels for the tokenizer. Each kernel classifies a block
+ *  of 16 (SSE2) or 32 (AVX2) bytes at once and returns the end of the run it
+ *  was asked to skip. SSE2 is the baseline on x86-64, AVX2 is chosen at runtime
+ *  when the CPU supports it, and every other target uses the scalar kernels
+ */
+
+#include "defines.h"
+
+#include <vector>
+
+namespace viper {
+namespace scan {
+
+enum class isa {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+/// @brief Skip a run of ' ', '\t', '\r' and '\n' starting at pos
+/// @returns Position of the first byte that is not whitespace, or size
+u64 skip_whitespace(const char* data, u64 size, u64 pos);
+
+/// @brief Skip a run of [A-Za-z0-9_] starting at pos
+/// @returns Position of the first byte that is not an identifier character, or size
+u64 skip_identifier(const char* data, u64 size, u64 pos);
+
+/// @brief Skip a run of [0-9] starting at pos
+/// @returns Position of the first byte that is not a digit, or size
+u64 skip_digits(const char* data, u64 size, u64 pos);
+
+/// @brief Append base + i + 1 to line_starts for every line ending at index i of a
+///        block, which is where the line after it starts. A line ends at '\n' or at a
+///        lone '\r', so "\r\n" ends one line. A '\r' that is the last byte of the block
+///        ends a line
+void find_newlines(const char* data, u64 size, u64 base, std::vector<u32>* line_starts);
+
+/// @brief The instruction set the kernels are currently using
+isa active_isa();
+
+/// @brief Whether the CPU can run kernels for an instruction set
+bool is_supported(isa set);
+
+/// @brief Force the kernels of an instruction set. Used to compare implementations
+/// @returns false and changes nothing if the instruction set is not supported
+bool set_isa(isa set);
+
+const char* isa_name(isa set);
+
+} // scan namespace
+} // viper namespace
@@ -1,169 +1,616 @@
 #include "tokenizer.h"
+#include "keywords.h"
+#include "lexer_table.h"
+#include "scan.h"
 #include "token.h"
 #include "platform/platform.h"
+#include "core/interner.h"
+#include <algorithm>
+#include <bit>
 #include <cctype>
-#include <unordered_map>
-#include <iostream>
+#include <charconv>
+#include <cstring>
 
 namespace viper {
 
-/// TODO: This is bugged, but it is probably good for now
-/// @brief Turn all \r or \r\n into just \n
-void Tokenizer::canonicalize_newline() {
-    u64 i = 0, j = 0;
-
-    while (
-        m_input_ptr->at(i) && 
-        i < m_input_ptr->size()-1
-    ) {
-        if (m_input_ptr->at(i) == '\r' && m_input_ptr->at(i+1) == '\n') {
-            i += 2;
-            m_input_ptr->at(j++) = '\n';
-        } else if (m_input_ptr->at(i) == '\r') {
-            i++;
-            m_input_ptr->at(j++) = '\n';
-        } else {
-            m_input_ptr->at(j++) = m_input_ptr->at(i++);
-        }
-    }
-    m_input_ptr->at(j) = '\0';
-}
-
 /// @brief Eat a character and put it in current_char
 void Tokenizer::read_char() {
-    if(read_position >= m_input_ptr->length()) {
+    if(read_position >= m_input.length()) {
         current_char = '\0';
     } else {
-        current_char = m_input_ptr->at(read_position);
+        current_char = m_input[read_position];
     }
 
     position = read_position;
     read_position++;
 }
 
+/// @brief Move to a position in the input and read the character there
+void Tokenizer::seek(u64 pos) {
+    read_position = pos;
+    read_char();
+}
+
 /// @brief Skip over whitespace characters
 void Tokenizer::skip_whitespace() {
-    while (current_char == ' ' ||
-           current_char == '\n' ||
-           current_char == '\t' ||
-           current_char == '\r') {
-        if (current_char == '\n') {
-            line_num++;
+    if (current_char != ' ' &&
+        current_char != '\n' &&
+        current_char != '\t' &&
+        current_char != '\r') {
+        return;
+    }
+
+    seek(scan::skip_whitespace(m_input.data(), m_input.size(), position));
+}
+
+
+/// @brief Value of a digit in bases up to 16. 16 for anything that is not a digit
+static inline u32 digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    char lower = c | 0x20;
+    if (lower >= 'a' && lower <= 'f') {
+        return lower - 'a' + 10;
+    }
+    return 16;
+}
+
+
+/// @brief Whether the '_' at index i of a literal sits between two digits
+static inline bool is_separator_placed(std::string_view text, u64 i, u32 base) {
+    return i > 0 && i + 1 < text.size()
+        && digit_value(text[i - 1]) < base
+        && digit_value(text[i + 1]) < base;
+}
+
+
+/// @brief Decode the digits of an integer literal, without its prefix
+/// @returns nullptr on success, or what is wrong with the literal
+static const char* decode_integer(std::string_view digits, u32 base, u64* out) {
+    if (digits.empty()) {
+        return "it has no digits";
+    }
+
+    u64 value = 0;
+    for (u64 i = 0; i < digits.size(); i++) {
+        if (digits[i] == '_') {
+            if (!is_separator_placed(digits, i, base)) {
+                return "a digit separator must be between two digits";
+            }
+            continue;
         }
 
-        read_char();
+        u32 digit = digit_value(digits[i]);
+        if (digit >= base) {
+            return "it has a digit that is not valid in its base";
+        }
+        if (__builtin_mul_overflow(value, static_cast<u64>(base), &value)
+            || __builtin_add_overflow(value, static_cast<u64>(digit), &value)) {
+            return "it does not fit in 64 bits";
+        }
     }
+
+    *out = value;
+    return nullptr;
 }
 
 
-/// @brief Read a number literal. Either floating point or integer
-token Tokenizer::read_number() {
-    token tok;
-    u64 pos = position;
-    bool decimal = false;
-    bool is_legal = true;
+/// @brief Decode a decimal floating point literal
+/// @returns nullptr on success, or what is wrong with the literal
+static const char* decode_float(std::string_view text, f64* out) {
+    bool separated = false;
+    for (u64 i = 0; i < text.size(); i++) {
+        if (text[i] == '_') {
+            if (!is_separator_placed(text, i, 10)) {
+                return "a digit separator must be between two digits";
+            }
+            separated = true;
+        } else if (text[i] != '.' && digit_value(text[i]) >= 10) {
+            return "it has a digit that is not valid in its base";
+        }
+    }
 
-    while (isdigit(current_char) != 0 || current_char == '.') {
-        if (current_char == '.' && decimal == true) {
-            is_legal = false;
+    // from_chars does not know about separators. Literals with them are rare, so copy only then
+    std::string stripped;
+    if (separated) {
+        for (char c : text) {
+            if (c != '_') {
+                stripped += c;
+            }
         }
+        text = stripped;
+    }
 
-        if (current_char == '.') decimal = true;
-        read_char();
+    std::from_chars_result res = std::from_chars(text.data(), text.data() + text.size(), *out);
+    if (res.ec == std::errc::result_out_of_range) {
+        return "it is out of the range of an f64";
+    }
+    if (res.ec != std::errc() || res.ptr != text.data() + text.size()) {
+        return "it is not a valid number";
     }
+    return nullptr;
+}
+
 
-    if (!is_legal) {
-        tok.kind = token_kind::TK_ILLEGAL;
-    } else if (decimal) {
-        tok.kind = token_kind::TK_NUM_FLOAT;
+/// @brief Read a number literal and decode its value into the token's payload,
+///        so nothing after the tokenizer converts text to numbers.
+///        Integers may have a 0x, 0o or 0b prefix. Digits may be separated with '_'
+token Tokenizer::read_number() {
+    u64 start = position;
+    u32 base = 10;
+    if (current_char == '0') {
+        switch (peek_char() | 0x20) {
+            case 'x': base = 16; break;
+            case 'o': base = 8; break;
+            case 'b': base = 2; break;
+            default: break;
+        }
+    }
+    u64 digits = base == 10 ? start : start + 2;
+
+    // The literal runs over everything that could continue it, so "12ab" is
+    // one bad literal instead of a number followed by an identifier
+    u64 end = scan::skip_identifier(m_input.data(), m_input.size(), digits);
+    u32 points = 0;
+    while (char_at(end) == '.') {
+        points++;
+        end = scan::skip_identifier(m_input.data(), m_input.size(), end + 1);
+    }
+    seek(end);
+
+    std::string_view text = m_input.substr(start, end - start);
+    token tok = token::create_new(points > 0 ? TK_NUM_FLOAT : TK_NUM_INT, start, text.size());
+
+    const char* error = nullptr;
+    if (points > 1) {
+        error = "it has more than one decimal point";
+    } else if (points == 1 && base != 10) {
+        error = "only decimal literals can have a fraction";
+    } else if (points == 1) {
+        f64 value = 0;
+        error = decode_float(text, &value);
+        if (error == nullptr) {
+            store_literal(&tok, std::bit_cast<u64>(value));
+        }
     } else {
-        tok.kind = token_kind::TK_NUM_INT;
+        u64 value = 0;
+        error = decode_integer(m_input.substr(digits, end - digits), base, &value);
+        if (error == nullptr) {
+            store_literal(&tok, value);
+        }
     }
 
-    tok.name = m_input_ptr->substr(pos, position-pos);
+    if (error != nullptr) {
+        Location loc = m_file->location_of(start);
+        platform::print_error("Invalid number literal '%.*s' at %d:%d in file %s: %s",
+            static_cast<int>(text.size()),
+            text.data(),
+            loc.line,
+            loc.character,
+            m_file->name.c_str(),
+            error
+        );
+        tok.kind = TK_ILLEGAL;
+        tok.payload = 0;
+    }
     return tok;
 }
 
 
+// A parser reads the value of a number while it holds at most a couple of batches
+// and the lookahead window of tokens after it, far fewer than the ring has slots
+static_assert(Tokenizer::LITERAL_RING >= 4 * (2 * Tokenizer::TOKEN_BATCH + Tokenizer::TOKEN_WINDOW));
+static_assert((Tokenizer::LITERAL_RING & (Tokenizer::LITERAL_RING - 1)) == 0, "the ring is indexed with a mask");
+
+
+/// @brief Put the bits of a number in the token. Integers small enough are kept
+///        in the payload itself, anything else goes to the literal pool. When
+///        streaming the pool is a ring, so it stays the same size however many
+///        numbers the file has, and the value of a token can be read until
+///        LITERAL_RING more numbers were pooled after it
+void Tokenizer::store_literal(token* tok, u64 bits) {
+    if (tok->kind == TK_NUM_INT && bits < LITERAL_POOLED) {
+        tok->payload = static_cast<u32>(bits);
+        return;
+    }
+
+    if (m_literal_ring) {
+        u64 slot = m_literals_stored++ & (LITERAL_RING - 1);
+        tok->payload = LITERAL_POOLED | static_cast<u32>(slot);
+        if (slot < m_literals.size()) {
+            m_literals[slot] = bits;
+        } else {
+            m_literals.push_back(bits);
+        }
+        return;
+    }
+
+    tok->payload = LITERAL_POOLED | static_cast<u32>(m_literals.size());
+    if (m_literals_lock) {
+        std::lock_guard<std::mutex> guard(*m_literals_lock);
+        m_literals.push_back(bits);
+        return;
+    }
+    m_literals.push_back(bits);
+}
+
+
+/// @brief Bits of the number held by a number token
+u64 Tokenizer::literal_bits(const token& tok) const {
+    if ((tok.payload & LITERAL_POOLED) == 0) {
+        return tok.payload;
+    }
+    if (m_literals_lock) {
+        std::lock_guard<std::mutex> guard(*m_literals_lock);
+        return m_literals[tok.payload & ~LITERAL_POOLED];
+    }
+    return m_literals[tok.payload & ~LITERAL_POOLED];
+}
+
+
+/// @brief Whether a token refers to an entry of the literal pool
+static bool pooled(const token& tok) {
+    return (tok.kind == TK_NUM_INT || tok.kind == TK_NUM_FLOAT) && (tok.payload & Tokenizer::LITERAL_POOLED) != 0;
+}
+
+
+/// @brief Copy the pool entries the tokens still refer to into a new pool, in
+///        token order, and point the tokens at their new place
+void Tokenizer::compact_literals() {
+    std::vector<u64> live;
+    for (token& tok : tokens) {
+        if (pooled(tok)) {
+            live.push_back(m_literals[tok.payload & ~LITERAL_POOLED]);
+            tok.payload = LITERAL_POOLED | static_cast<u32>(live.size() - 1);
+        }
+    }
+    m_literals = std::move(live);
+    m_dead_literals = 0;
+}
+
+
+u64 Tokenizer::memory_used() const {
+    return tokens.capacity() * sizeof(token) + m_literals.capacity() * sizeof(u64);
+}
+
+
+/// @brief Value of a TK_NUM_INT token
+u64 Tokenizer::integer_value(const token& tok) const {
+    return literal_bits(tok);
+}
+
+
+/// @brief Value of a TK_NUM_FLOAT token
+f64 Tokenizer::float_value(const token& tok) const {
+    return std::bit_cast<f64>(literal_bits(tok));
+}
+
+
 /// @brief Look at the next character in input without incrimenting
 char Tokenizer::peek_char() {
-    if (read_position >= m_input_ptr->length()) {
+    if (read_position >= m_input.length()) {
         return '\0';
     }
     
-    return m_input_ptr->at(read_position);
+    return m_input[read_position];
+}
+
+
+/// @brief The character at a position in the input, or '\0' past the end
+char Tokenizer::char_at(u64 pos) const {
+    if (pos >= m_input.length()) {
+        return '\0';
+    }
+
+    return m_input[pos];
 }
 
 
 /// @brief Lookup an identifier string in the table of keywords, and if 
 ///        it is not a keyword it is just normal identifier
-token_kind Tokenizer::lookup_identifier(const std::string& identifier) {
-    if (keywords.find(identifier) != keywords.end()) {
-        return keywords[identifier];
-    }
+token_kind Tokenizer::lookup_identifier(std::string_view identifier) {
+    return lookup_keyword(identifier);
+}
+
 
-    return token_kind::TK_IDENT;
+/// @brief Read an identifier string. The view points into the source
+std::string_view Tokenizer::read_identifier() {
+    u64 pos = position;
+    seek(scan::skip_identifier(m_input.data(), m_input.size(), position));
+
+    return m_input.substr(pos, position-pos);
 }
 
 
-/// @brief Read an identifier string
-std::string Tokenizer::read_identifier() {
-    u32 pos = position;
-    while (isalpha(current_char) != 0 ||
-           current_char == '_' ||
-           isdigit(current_char) != 0) {
-        read_char();
+/// @brief Skip a line comment up to the '\n' or '\r' that ends it
+token Tokenizer::skip_single_line_comment() {
+    const char* start = m_input.data() + position;
+    const char* end = m_input.data() + m_input.size();
+    const char* newline = static_cast<const char*>(std::memchr(start, '\n', end - start));
+    newline = newline != nullptr ? newline : end;
+    const char* cr = static_cast<const char*>(std::memchr(start, '\r', newline - start));
+    seek((cr != nullptr ? cr : newline) - m_input.data());
+
+    return token::create_new(TK_COMMENT, 0, 0);
+}
+
+
+/// @brief Skip a block comment. Block comments nest, so each /* needs its own */
+token Tokenizer::skip_multi_line_comment() {
+    const char* data = m_input.data();
+    u64 size = m_input.size();
+    u64 begin = position;
+    u64 pos = position + 2; // past the opening /*
+    u64 depth = 1;
+
+    // Both delimiters hold a '*', so only stars need to be looked at
+    while (depth > 0) {
+        const char* star = static_cast<const char*>(std::memchr(data + pos, '*', size - pos));
+        if (star == nullptr) {
+            pos = size;
+            break;
+        }
+
+        u64 at = star - data;
+        if (at > pos && data[at - 1] == '/') {
+            depth++;
+            pos = at + 1;
+        } else if (at + 1 < size && data[at + 1] == '/') {
+            depth--;
+            pos = at + 2;
+        } else {
+            pos = at + 1;
+        }
     }
 
-    return m_input_ptr->substr(pos, position-pos);
+    seek(pos);
+
+    if (depth > 0) {
+        Location loc = m_file->location_of(begin);
+        platform::print_error("Unclosed block comment at %d:%d in file %s",
+            loc.line,
+            loc.character,
+            m_file->name.c_str()
+        );
+        return token::create_new(TK_ILLEGAL, begin, pos - begin);
+    }
+    return token::create_new(TK_COMMENT, begin, pos - begin);
 }
 
 
-/// @brief Skip over multi line comments
-token Tokenizer::skip_single_line_comment() {
-    while (current_char != '\n') {
-        read_char();
+/// @brief Read the content of a string literal. The view points into the source.
+///        Stops on the closing quote, or at the end of the input when there is none
+std::string_view Tokenizer::read_string_content() {
+    u64 begin = position + 1;
+    const char* quote = static_cast<const char*>(
+        std::memchr(m_input.data() + begin, '"', m_input.size() - begin));
+    u64 end = quote != nullptr ? quote - m_input.data() : m_input.size();
+    seek(end);
+
+    return m_input.substr(begin, end - begin);
+}
+
+
+/// @brief Read an identifier or keyword token starting at the current character
+token Tokenizer::identifier_token() {
+    u64 start = position;
+    std::string_view identifier = read_identifier();
+    token tok = token::create_new(lookup_identifier(identifier), start, identifier.size());
+    tok.payload = m_symbols.intern(identifier);
+    return tok;
+}
+
+
+/// @brief Read a number literal token starting at the current character
+token Tokenizer::number_token() {
+    return read_number();
+}
+
+
+/// @brief Read a string literal token starting at the opening quote
+token Tokenizer::string_token() {
+    u64 open = position;
+    std::string_view content = read_string_content();
+
+    if (current_char != '"') {
+        Location loc = m_file->location_of(open);
+        platform::print_error("Unterminated string literal at %d:%d in file %s",
+            loc.line,
+            loc.character,
+            m_file->name.c_str()
+        );
+        return token::create_new(TK_ILLEGAL, open, position - open);
     }
 
-    return token::create_new(TK_COMMENT, "__%internal_comment_single_line__", 0);
+    // The token spans the content of the literal, without the quotes
+    token tok = token::create_new(TK_STR, open + 1, content.size());
+    read_char(); // eat the closing quote
+    return tok;
 }
 
 
-/// @brief Skip block comment
-token Tokenizer::skip_multi_line_comment() {
-    if (m_input_ptr->find("*/") == std::string::npos) {
-        std::cout << "Unclosed block comment";
-        return token::create_new(TK_ILLEGAL, "__%internal_illegal__", 0);
+/// @brief Report the current character as illegal and make a token of it
+token Tokenizer::illegal_token() {
+    Location loc = m_file->location_of(position);
+    platform::print_error("Illegal token '%c' at %d:%d in file %s",
+        current_char,
+        loc.line,
+        loc.character,
+        m_file->name.c_str()
+    );
+
+    token tok = token::create_new(TK_ILLEGAL, position, 1);
+    read_char();
+    return tok;
+}
+
+
+static_assert((Tokenizer::TOKEN_WINDOW & (Tokenizer::TOKEN_WINDOW - 1)) == 0,
+    "the token window must be a power of two");
+
+/// @brief Lex one token from the input with the selected lexer
+token Tokenizer::lex_token() {
+    token tok = m_mode == lexer_mode::TABLE
+        ? next_token_table()
+        : next_token_switch();
+
+    // The pages of a mapped source are given back once the tokenizer is a chunk past
+    // them, so a large file is lexed in constant memory
+    if (m_streaming && !m_keep_source && position - m_released >= 2 * m_release_chunk) {
+        // Keep the last chunk mapped so the text of lookahead tokens stays warm
+        platform::release_mapped_range(&m_file->mapping, m_released, position - m_release_chunk - m_released);
+        m_released = position - m_release_chunk;
+    }
+    return tok;
+}
+
+
+/// @brief Get the next token and return it
+token Tokenizer::next_token() {
+    token tok;
+    if (m_window_count > 0) {
+        tok = m_window[m_window_head];
+        m_window_head = (m_window_head + 1) & (TOKEN_WINDOW - 1);
+        m_window_count--;
+    } else {
+        tok = lex_token();
+    }
+
+    if (!m_streaming) {
+        tokens.push_back(tok);
     }
-    while (1) {
-        if (current_char == '*' && peek_char() == '/') {
-            read_char();
+    return tok;
+}
+
+
+/// @brief Get the next tokens in one call so the caller pays for the call once per batch.
+///        The batch ends early at TK_EOF, which is the last token written
+/// @returns How many tokens were written to out
+u32 Tokenizer::next_tokens(token* out, u32 capacity) {
+    u32 count = 0;
+    while (count < capacity && m_window_count > 0) {
+        out[count++] = m_window[m_window_head];
+        m_window_head = (m_window_head + 1) & (TOKEN_WINDOW - 1);
+        m_window_count--;
+        if (out[count - 1].kind == TK_EOF) {
             break;
         }
     }
-    
-    return token::create_new(TK_COMMENT, "__%internal_comment_multi_line__", 0);
+
+    if (count == 0 || out[count - 1].kind != TK_EOF) {
+        while (count < capacity) {
+            out[count++] = lex_token();
+            if (out[count - 1].kind == TK_EOF) {
+                break;
+            }
+        }
+    }
+
+    if (!m_streaming) {
+        tokens.insert(tokens.end(), out, out + count);
+    }
+    return count;
 }
 
 
-/// @brief Read the content of a string literal
-std::string Tokenizer::read_string_content() {
-    read_char();
-    u32 pos = position;
-    while (current_char != '"') {
-        read_char(); 
+/// @brief Lex the whole input into a queue read by another thread.
+///        Stops early if the reader closes the queue
+void Tokenizer::lex_into(TokenQueue* out) {
+    std::array<token, TOKEN_BATCH> batch;
+    u32 count;
+    do {
+        count = next_tokens(batch.data(), TOKEN_BATCH);
+        if (!out->push(batch.data(), count)) {
+            return;
+        }
+    } while (batch[count - 1].kind != TK_EOF);
+}
+
+
+/// @brief Look at a token ahead of the next one without consuming anything.
+///        peek_token(0) is the token the next call to next_token returns
+token Tokenizer::peek_token(u32 ahead) {
+    if (ahead >= TOKEN_WINDOW) {
+        ahead = TOKEN_WINDOW - 1;
     }
 
-    return m_input_ptr->substr(pos, position-pos);
+    while (m_window_count <= ahead) {
+        m_window[(m_window_head + m_window_count) & (TOKEN_WINDOW - 1)] = lex_token();
+        m_window_count++;
+    }
+    return m_window[(m_window_head + ahead) & (TOKEN_WINDOW - 1)];
 }
 
 
-/// @brief Get the next token and return it
-token Tokenizer::next_token() {
+/// @brief Get the next token by running the lexer table over the input.
+///        Punctuators are matched entirely by table lookups
+token Tokenizer::next_token_table() {
+    u64 start;
+    u64 end;
+    u8 state;
+
+loop_begin:
+    skip_whitespace();
+    start = position;
+    end = position;
+    state = lexer_table::START;
+
+    // Longest match. Every state the table passes through is a token
+    while (true) {
+        u8 next = lexer_table::step(state, char_at(end));
+        if (next == lexer_table::DEAD) {
+            break;
+        }
+        state = next;
+        end++;
+    }
+
+    switch (lexer_table::TABLE.action[state]) {
+        case LA_PUNCTUATOR: {
+            token tok = token::create_new(lexer_table::TABLE.kind[state], start, end - start);
+            seek(end);
+            return tok;
+        }
+
+        case LA_IDENTIFIER:
+            return identifier_token();
+
+        case LA_NUMBER:
+            return number_token();
+
+        case LA_STRING:
+            return string_token();
+
+        case LA_LINE_COMMENT:
+            (void)skip_single_line_comment();
+            goto loop_begin;
+
+        case LA_BLOCK_COMMENT:
+            (void)skip_multi_line_comment();
+            goto loop_begin;
+
+        case LA_EOF:
+            return token::create_new(TK_EOF, position, 0);
+
+        case LA_ILLEGAL:
+        case LA_NONE:
+            break;
+    }
+
+    return illegal_token();
+}
+
+
+/// @brief Get the next token by switching over the current character
+token Tokenizer::next_token_switch() {
     token tok;
+    token_kind kind = TK_ILLEGAL;
+    u64 start;
 
 loop_begin:
     skip_whitespace();
+    start = position;
     switch(current_char) {
         case '/':
             if (peek_char() == '/') {
@@ -174,9 +621,9 @@ loop_begin:
                 goto loop_begin;
             } else if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_DIVEQ, "/=", line_num);
+                kind = TK_DIVEQ;
             } else {
-                tok = token::create_new(TK_SLASH, std::string(1, current_char), line_num);
+                kind = TK_SLASH;
             }
             break;
 
@@ -184,63 +631,63 @@ loop_begin:
         case '=':
             if (peek_char() == '=') {
                 read_char(); // eat the next =
-                tok = token::create_new(TK_EQUALTO, "==", line_num);
+                kind = TK_EQUALTO;
             } else {
-                tok = token::create_new(TK_ASSIGN, std::string(1, current_char), line_num);
+                kind = TK_ASSIGN;
             }
             break;
 
         case ';':
-            tok = token::create_new(TK_SEMICOLON, std::string(1, current_char), line_num);
+            kind = TK_SEMICOLON;
             break;
 
         case '(':
-            tok = token::create_new(TK_LPAREN, std::string(1, current_char), line_num);
+            kind = TK_LPAREN;
             break;
 
         case ')':
-            tok = token::create_new(TK_RPAREN, std::string(1, current_char), line_num);
+            kind = TK_RPAREN;
             break;
 
         case '{':
-            tok = token::create_new(TK_LSQUIRLY, std::string(1, current_char), line_num);
+            kind = TK_LSQUIRLY;
             break;
 
         case '}':
-            tok = token::create_new(TK_RSQUIRLY, std::string(1, current_char), line_num);
+            kind = TK_RSQUIRLY;
             break;
 
         case '[':
-            tok = token::create_new(TK_LBRACKET, std::string(1, current_char), line_num);
+            kind = TK_LBRACKET;
             break;
 
         case ']':
-            tok = token::create_new(TK_RBRACKET, std::string(1, current_char), line_num);
+            kind = TK_RBRACKET;
             break;
 
         case ',':
-            tok = token::create_new(TK_COMMA, std::string(1, current_char), line_num);
+            kind = TK_COMMA;
             break;
         
         case '.':
-            tok = token::create_new(TK_DOT, std::string(1, current_char), line_num);
+            kind = TK_DOT;
             break;
         
         case '+':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_PLUSEQ, "+=", line_num);
+                kind = TK_PLUSEQ;
             } else {
-                tok = token::create_new(TK_PLUS, std::string(1, current_char), line_num);
+                kind = TK_PLUS;
             }
             break;
         
         case '-':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_MINUSEQ, "-=", line_num);
+                kind = TK_MINUSEQ;
             } else {
-                tok = token::create_new(TK_MINUS, std::string(1, current_char), line_num);
+                kind = TK_MINUS;
             }
             break;
 
@@ -248,153 +695,133 @@ loop_begin:
         case '*':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_TIMESEQ, "*=", line_num);
+                kind = TK_TIMESEQ;
             } else {
-                tok = token::create_new(TK_ASTERISK, std::string(1, current_char), line_num);
+                kind = TK_ASTERISK;
             }
             break;
         
         case '%':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_MODEQ, "%=", line_num);
+                kind = TK_MODEQ;
             } else {
-                tok = token::create_new(TK_MOD, std::string(1, current_char), line_num);
+                kind = TK_MOD;
             }
             break;
         
         case '<':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_LTEQ, "<=", line_num);
+                kind = TK_LTEQ;
             } else if (peek_char() == '<') {
                 read_char();
                 if (peek_char() == '=') {
                     read_char();
-                    tok = token::create_new(token_kind::TK_LSHIFTEQ, "<<=", line_num);
+                    kind = TK_LSHIFTEQ;
                 } else {
-                    tok = token::create_new(TK_LTEQ, "<=", line_num);
+                    kind = TK_LSHIFT;
                 }
             } else {
-                tok = token::create_new(TK_LT, std::string(1, current_char), line_num);
+                kind = TK_LT;
             }
             break;
         
         case '>':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(TK_GTEQ, ">=", line_num);
+                kind = TK_GTEQ;
             } else if (peek_char() == '>') {
                 read_char();
                 if (peek_char() == '=') {
                     read_char();
-                    tok = token::create_new(token_kind::TK_RSHIFTEQ, ">>=", line_num);
+                    kind = TK_RSHIFTEQ;
                 } else {
-                    tok = token::create_new(TK_GTEQ, ">=", line_num);
+                    kind = TK_RSHIFT;
                 }
             } else {
-                tok = token::create_new(TK_GT, std::string(1, current_char), line_num);
+                kind = TK_GT;
             }
             break;
 
         case '!':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(token_kind::TK_NEQUALTO, "!=", line_num);
+                kind = TK_NEQUALTO;
             } else {
-                tok = token::create_new(TK_BANG, std::string(1, current_char), line_num);
+                kind = TK_BANG;
             }
             break;
 
         case '&':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(token_kind::TK_ANDEQ, "&=", line_num);
+                kind = TK_ANDEQ;
             } else if (peek_char() == '&') {
                 read_char();
-                tok = token::create_new(token_kind::TK_LOG_AND, "&&", line_num);
+                kind = TK_LOG_AND;
             } else {
-                tok = token::create_new(token_kind::TK_AMPERSAND, std::string(1, current_char), line_num);
+                kind = TK_AMPERSAND;
             }
             break;
         
         case '|':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(token_kind::TK_OREQ, "|=", line_num);
+                kind = TK_OREQ;
             } else if (peek_char() == '|') {
                 read_char();
-                tok = token::create_new(token_kind::TK_LOG_OR, "||", line_num);
+                kind = TK_LOG_OR;
             } else {
-                tok = token::create_new(token_kind::TK_PIPE, std::string(1, current_char), line_num);
+                kind = TK_PIPE;
             }
             break;
         
         case '^':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(token_kind::TK_XOREQ, "^=", line_num);
+                kind = TK_XOREQ;
             } else {
-                tok = token::create_new(token_kind::TK_CARET, std::string(1, current_char), line_num);
+                kind = TK_CARET;
             }
             break;
 
         case '~':
             if (peek_char() == '=') {
                 read_char();
-                tok = token::create_new(token_kind::TK_NEGATEEQ, "~=", line_num);
+                kind = TK_NEGATEEQ;
             } else {
-                tok = token::create_new(token_kind::TK_TILDE, std::string(1, current_char), line_num);
+                kind = TK_TILDE;
             }
             break;
 
         case ':':
             if (peek_char() == ':') {
                 read_char();
-                tok = token::create_new(token_kind::TK_DOUBLECOLON, "::", line_num);
+                kind = TK_DOUBLECOLON;
             } else {
-                tok = token::create_new(token_kind::TK_COLON, std::string(1, current_char), line_num);
+                kind = TK_COLON;
             }
             break;
 
         case '"':
-            tok = token::create_new(TK_STR, read_string_content(), line_num);
-            break;
+            return string_token();
 
         case '\0':
-            tok = token::create_new(token_kind::TK_EOF, "__%internal_eof", line_num);
-            break;
+            return token::create_new(TK_EOF, position, 0);
             
         default:
             if (isalpha(current_char) != 0) {
-                tok.name = read_identifier();
-                tok.kind = lookup_identifier(tok.name);
-                tok.line_num = line_num;
-                tokens.push_back(tok);
-                return tok;
+                return identifier_token();
             } else if (isdigit(current_char) != 0) {
-                tok = read_number();
-                tok.line_num = line_num;
-                tokens.push_back(tok);
-                return tok;
-            } else {
-                tok = token::create_new(token_kind::TK_ILLEGAL, "__%internal_illegal", line_num);
-                platform::print_error("Illegal token '%s' on line %lu in file %s",
-                    tok.name.c_str(),
-                    line_num,
-                    m_file->name.c_str()
-                );
-//                std::printf("Illegal token '%s' on line %lu in file %s", 
-//                    tok.name.c_str(),
-//                    line_num,
-//                    m_file->name.c_str()
-//                );
+                return number_token();
             }
-            break;
+            return illegal_token();
     }
 
+    // Punctuators end on the current character
+    tok = token::create_new(kind, start, position - start + 1);
     read_char();
-    tokens.push_back(tok);
     return tok;
 }
 
@@ -404,59 +831,149 @@ void Tokenizer::tokenize() {
     token tok;
     // read_char();
     tok.kind = token_kind::TK_ILLEGAL;
+    m_literal_ring = false; // Every token is kept, so every value must stay
     while (tok.kind != token_kind::TK_EOF) {
         tok = next_token();
+        if (m_streaming) {
+            tokens.push_back(tok);
+        }
     }
 }
 
-Tokenizer Tokenizer::create_new(VFile* file) {
+/// @brief Offset just past the source of a token. A string's span leaves out its
+///        quotes, and the closing one is still part of the token
+static u64 source_end(const token& tok) {
+    return tok.offset + tok.length + (tok.kind == TK_STR ? 1 : 0);
+}
+
+
+/// @brief Lex again the part of the source an edit changed, and update the tokens
+///        to match. The file has the edit applied already, and the tokens are those
+///        of the whole source before it. Lexing starts after the last token that
+///        can not have changed, and stops at the first token past the edit that
+///        starts where an old one did: from there the source is the old source, so
+///        the tokens are the old ones moved by the size of the edit
+token_splice Tokenizer::relex(const text_edit& edit) {
+    m_input = m_file->source();
+    i64 delta = static_cast<i64>(edit.inserted.size()) - static_cast<i64>(edit.removed);
+    u64 edit_end = edit.offset + edit.inserted.size();
+
+    // The first token that ends at or after the edit may run on into it, and the one
+    // before may have been cut short by a character the lexer looked past it at
+    auto touched = std::lower_bound(tokens.begin(), tokens.end(), edit.offset, [](const token& tok, u64 offset) {
+        return source_end(tok) < offset;
+    });
+    u64 first = touched - tokens.begin();
+    first = first > 0 ? first - 1 : 0;
+    seek(first > 0 ? source_end(tokens[first - 1]) : 0);
+
+    std::vector<token> fresh;
+    u64 old = first;
+    while (true) {
+        token tok = lex_token();
+        if (tok.offset >= edit_end) {
+            while (old < tokens.size() && tokens[old].offset + delta < tok.offset) {
+                old++;
+            }
+            if (old < tokens.size() && tokens[old].offset + delta == tok.offset && tokens[old].kind == tok.kind) {
+                break;
+            }
+        }
+
+        fresh.push_back(tok);
+        if (tok.kind == TK_EOF) {
+            old = tokens.size();
+            break;
+        }
+    }
+
+    // Tokens before the edit that were lexed again to be safe came out the same
+    u64 same = 0;
+    while (same < fresh.size() && first + same < old
+           && source_end(fresh[same]) <= edit.offset
+           && fresh[same].kind == tokens[first + same].kind
+           && fresh[same].offset == tokens[first + same].offset
+           && fresh[same].length == tokens[first + same].length) {
+        same++;
+    }
+
+    // The numbers of the replaced tokens, and of those lexed again only to be
+    // dropped, stay in the pool with nothing pointing at them. Once they are
+    // most of it the pool is rebuilt, so editing does not grow it without end
+    m_dead_literals += std::count_if(fresh.begin(), fresh.begin() + same, pooled);
+    m_dead_literals += std::count_if(tokens.begin() + first + same, tokens.begin() + old, pooled);
+    fresh.erase(fresh.begin(), fresh.begin() + same);
+    first += same;
+
+    // Move the tokens after the damage once, to where they go
+    u64 removed = old - first;
+    if (fresh.size() > removed) {
+        tokens.insert(tokens.begin() + old, fresh.size() - removed, token());
+    } else {
+        tokens.erase(tokens.begin() + first + fresh.size(), tokens.begin() + old);
+    }
+    std::copy(fresh.begin(), fresh.end(), tokens.begin() + first);
+    for (u64 i = first + fresh.size(); i < tokens.size(); i++) {
+        tokens[i].offset = static_cast<u32>(tokens[i].offset + delta);
+    }
+    if (m_dead_literals * 2 > m_literals.size()) {
+        compact_literals();
+    }
+
+    return { first, removed, fresh.size() };
+}
+
+/// @brief Create a tokenizer over a file. The source is lexed as it is, whatever
+///        its line endings: '\r' is whitespace and ends a line comment like '\n'
+Tokenizer Tokenizer::create_new(VFile* file, lexer_mode mode) {
     Tokenizer tok = Tokenizer();
     tok.m_file = file;
+    tok.m_mode = mode;
+    tok.m_symbols = InternCache(&Interner::global());
     tok.position = 0;
     tok.read_position = 0;
-    tok.line_num = 0;
-    tok.m_input_ptr = &tok.m_file->content;
-    // canonicalize_newline();
-
-    tok.keywords["const"] = TK_CONST;
-    tok.keywords["let"] = TK_LET;
-    tok.keywords["define"] = TK_DEFINE;
-    tok.keywords["return"] = TK_RETURN;
-    tok.keywords["struct"] = TK_STRUCT;
-    tok.keywords["enum"] = TK_ENUM;
-    tok.keywords["module"] = TK_MODULE;
-    tok.keywords["void"] = TK_VOID;
-    tok.keywords["for"] = TK_FOR;
-    tok.keywords["while"] = TK_WHILE;
-    tok.keywords["do"] = TK_DO;
-    tok.keywords["if"] = TK_IF;
-    tok.keywords["elif"] = TK_ELIF;
-    tok.keywords["else"] = TK_ELSE;
-    
-    tok.keywords["#define"] = TK_PP_DEFINE;
-    tok.keywords["#import"] = TK_PP_IMPORT;
-    tok.keywords["#export"] = TK_PP_EXPORT;
-
-    tok.keywords["true"] = TK_TRUE;
-    tok.keywords["false"] = TK_FALSE;
-
-//    tok.keywords["byte"] = TK_TYPESPEC_BYTE;   
-//    tok.keywords["i8"] = TK_TYPESPEC_I8;   
-//    tok.keywords["i16"] = TK_TYPESPEC_I16;  
-//    tok.keywords["i32"] = TK_TYPESPEC_I32;  
-//    tok.keywords["i64"] = TK_TYPESPEC_I64;  
-//    tok.keywords["f32"] = TK_TYPESPEC_F32;  
-//    tok.keywords["f64"] = TK_TYPESPEC_F64;  
-//    tok.keywords["u8"] = TK_TYPESPEC_U8;   
-//    tok.keywords["u16"] = TK_TYPESPEC_U16;  
-//    tok.keywords["u32"] = TK_TYPESPEC_U32;  
-//    tok.keywords["u64"] = TK_TYPESPEC_U64;  
-//    tok.keywords["bool"] = TK_TYPESPEC_BOOL; 
+    tok.m_input = tok.m_file->source();
+
     tok.read_char();
 
     return tok;
 }
 
+/// @brief Create a tokenizer that only keeps a window of lookahead tokens.
+///        Tokens are not collected, so memory stays the same whatever the size of the file
+Tokenizer Tokenizer::create_streaming(VFile* file, lexer_mode mode, u64 release_chunk) {
+    Tokenizer tok = create_new(file, mode);
+    tok.m_streaming = true;
+    tok.m_release_chunk = release_chunk;
+    tok.m_literal_ring = true;
+
+    return tok;
+}
+
+/// @brief Create a streaming tokenizer that lexes on its own thread ahead of a parser.
+///        The source stays mapped because the parser may read the text of tokens the
+///        lexer is far past, and for the same reason the literal pool is not a ring.
+///        It is locked so the parser can read it
+Tokenizer Tokenizer::create_pipelined(VFile* file, lexer_mode mode) {
+    Tokenizer tok = create_streaming(file, mode);
+    tok.m_keep_source = true;
+    tok.m_literal_ring = false;
+    tok.m_literals_lock = std::make_shared<std::mutex>();
+
+    return tok;
+}
+
+/// @brief Create a tokenizer over the bytes [begin, end) of a file that was already
+///        lexed whole, to lex a piece of it again. Offsets are still from the start
+///        of the file
+Tokenizer Tokenizer::create_range(VFile* file, u64 begin, u64 end, lexer_mode mode) {
+    Tokenizer tok = create_new(file, mode);
+    tok.m_input = tok.m_input.substr(0, end);
+    tok.seek(begin);
+
+    return tok;
+}
+
 /// @brief Entrypoint for the tokenizer
 std::vector<token> Tokenizer::tokenize_file() {
     tokenize();
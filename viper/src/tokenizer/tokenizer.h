@@ -2,56 +2,133 @@
 
 #include "token.h"
 #include "core/core.h"
-#include <unordered_map>
+#include "core/interner.h"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string_view>
 #include <vector>
 
 namespace viper {
 
+// Which implementation next_token uses. Both produce the same tokens
+enum class lexer_mode {
+    TABLE,  // Table driven state machine. See lexer_table.h
+    SWITCH, // Hand written switch over the current character
+};
+
+// Tokens an edit replaced: removed tokens from first gave way to inserted new ones
+struct token_splice {
+    u64 first;
+    u64 removed;
+    u64 inserted;
+};
+
 class Tokenizer {
     public:
         ~Tokenizer() {}
         Tokenizer(Tokenizer&&) = default;
         Tokenizer(const Tokenizer& tok) = default;
 
-        static Tokenizer create_new(VFile* file);
+        static constexpr u32 TOKEN_WINDOW = 16; // Tokens a streaming tokenizer can hold ahead of next_token
+        static constexpr u32 TOKEN_BATCH = 256; // Tokens a parser asks next_tokens for at a time
+        static constexpr u64 PARALLEL_MIN_CHUNK = 1024 * 1024; // Smallest piece of a file lexed on its own thread
+        static constexpr u32 LITERAL_POOLED = 0x80000000u;      // Set in the payload of a number kept in the literal pool
+        static constexpr u64 RELEASE_CHUNK = 16 * 1024 * 1024;  // A streaming tokenizer gives back mapped source this far behind it
+        static constexpr u32 LITERAL_RING = 4096;               // Pooled numbers a streaming tokenizer keeps before reusing their slots
+
+        static Tokenizer create_new(VFile* file, lexer_mode mode = lexer_mode::TABLE);
+        static Tokenizer create_streaming(VFile* file, lexer_mode mode = lexer_mode::TABLE, u64 release_chunk = RELEASE_CHUNK);
+        static Tokenizer create_pipelined(VFile* file, lexer_mode mode = lexer_mode::TABLE);
+        static Tokenizer create_range(VFile* file, u64 begin, u64 end, lexer_mode mode = lexer_mode::TABLE);
+        VFile* get_file() const { return m_file; } // The file the tokens' text lives in
         std::vector<token> tokenize_file();
+        std::vector<token> tokenize_file_parallel(u32 threads = 0, u64 min_chunk = PARALLEL_MIN_CHUNK);
+        const std::vector<token>& get_tokens() const { return tokens; } // Every token lexed, when not streaming
+        token_splice relex(const text_edit& edit);
 
-        token next_token(); // Get the next token from the input source
-        token peek_token(); // Peek a token without advancing through the code
+        token next_token();                 // Get the next token from the input source
+        token peek_token(u32 ahead = 0);    // Peek a token without advancing through the code. ahead < TOKEN_WINDOW
+        u32 next_tokens(token* out, u32 capacity); // Get up to capacity tokens at once, stopping after TK_EOF
+        void lex_into(TokenQueue* out);            // Push every token into a queue, up to and including TK_EOF
+        u64 integer_value(const token& tok) const; // Value of a TK_NUM_INT token this tokenizer produced
+        f64 float_value(const token& tok) const;   // Value of a TK_NUM_FLOAT token this tokenizer produced
+        u64 memory_used() const;                   // Bytes held by the tokens and the literal pool
 
     private:
         Tokenizer() {}
         Tokenizer(Tokenizer& t) {
             position = t.position;
-            line_num = t.line_num;
             read_position = t.read_position;
             current_char = t.current_char;
-            m_input_ptr = t.m_input_ptr;
+            m_mode = t.m_mode;
+            m_streaming = t.m_streaming;
+            m_window = t.m_window;
+            m_window_head = t.m_window_head;
+            m_window_count = t.m_window_count;
+            m_released = t.m_released;
+            m_release_chunk = t.m_release_chunk;
+            m_keep_source = t.m_keep_source;
+            m_literals_lock = t.m_literals_lock;
+            m_symbols = t.m_symbols;
+            m_literals = t.m_literals;
+            m_literal_ring = t.m_literal_ring;
+            m_literals_stored = t.m_literals_stored;
+            m_dead_literals = t.m_dead_literals;
+            m_input = t.m_input;
             // m_file = std::move(t.m_file);
             m_file = t.m_file;
         }
 
-        void canonicalize_newline();
         void read_char();
+        void seek(u64 pos);
         void skip_whitespace();
         token read_number();
+        void store_literal(token* tok, u64 bits);
+        u64 literal_bits(const token& tok) const;
+        void compact_literals();
         char peek_char();
-        token_kind lookup_identifier(const std::string& identifier);
-        std::string read_identifier();
+        char char_at(u64 pos) const;
+        token_kind lookup_identifier(std::string_view identifier);
+        std::string_view read_identifier();
         token skip_single_line_comment();
         token skip_multi_line_comment();
-        std::string read_string_content();
+        std::string_view read_string_content();
+        token identifier_token();
+        token number_token();
+        token string_token();
+        token illegal_token();
+        token lex_token();
+        token next_token_table();
+        token next_token_switch();
         void tokenize();
+        std::vector<token> tokenize_range(u64 begin, u64 end, Interner* interner, std::vector<u64>* literals) const;
 
 
         // std::unique_ptr<VFile> m_file;
         VFile* m_file;                                          // [NOT OWNED] Pointer to the file's content we are tokenizing
-        std::unordered_map<std::string, token_kind> keywords;   // Keywords with corresponding tokens
         std::vector<token> tokens;
-        u64 line_num = 0;                                       // Line number of the file we are currently on
         u64 position = 0;                                       
         u64 read_position = 0;
         char current_char;                                      // Current character of the source  code
-        std::string* m_input_ptr;                               // [NOT OWNED] The source code input we are tokenizing
+        std::string_view m_input;                               // [NOT OWNED] The source code input we are tokenizing. Scanned in place
+        lexer_mode m_mode = lexer_mode::TABLE;
+        InternCache m_symbols;                                  // Where identifiers are interned. The global interner unless lexing in parallel
+        std::vector<u64> m_literals;                            // Bits of the numbers that do not fit in a token payload
+        bool m_literal_ring = false;                            // Reuse the pool as a ring of LITERAL_RING slots. Only when tokens are not kept
+        u64 m_literals_stored = 0;                              // Numbers ever put in the ring
+        u64 m_dead_literals = 0;                                // Pool entries no token refers to since a relex dropped them
+
+        // Streaming mode keeps no token vector, only a ring buffer of lookahead
+        bool m_streaming = false;
+        std::array<token, TOKEN_WINDOW> m_window {};
+        u32 m_window_head = 0;                                  // Index of the oldest token in the window
+        u32 m_window_count = 0;                                 // Tokens lexed but not yet returned by next_token
+        u64 m_released = 0;                                     // Mapped source before this offset was given back to the OS
+        u64 m_release_chunk = RELEASE_CHUNK;
+        bool m_keep_source = false;                             // Never give the source back. Its reader may be far behind
+
+        // Set when the literal pool is read from another thread while this one lexes
+        std::shared_ptr<std::mutex> m_literals_lock;
 };
 } // viper namespace